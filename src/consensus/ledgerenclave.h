@@ -103,5 +103,15 @@ namespace consensus
     {
       RINGBUFFER_WRITE_MESSAGE(consensus::ledger_truncate, to_host, idx);
     }
+
+    /**
+     * Discard the ledger, which continues after a given index.
+     *
+     * @param idx Index of the snapshot installed in place of the ledger
+     */
+    void reset(Index idx)
+    {
+      RINGBUFFER_WRITE_MESSAGE(consensus::ledger_reset, to_host, idx);
+    }
   };
 }
\ No newline at end of file
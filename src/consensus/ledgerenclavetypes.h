@@ -19,11 +19,29 @@ namespace consensus
     DEFINE_RINGBUFFER_MSG_TYPE(ledger_no_entry),
     ///@}
 
+    /// Request a range of log entries. Enclave -> Host
+    DEFINE_RINGBUFFER_MSG_TYPE(ledger_get_range),
+
+    ///@{
+    /// Respond to ledger_get_range, with the framed entries of a prefix of the
+    /// requested range. Host -> Enclave
+    DEFINE_RINGBUFFER_MSG_TYPE(ledger_entry_range),
+    DEFINE_RINGBUFFER_MSG_TYPE(ledger_no_entry_range),
+    ///@}
+
     ///@{
     /// Modify the local log. Enclave -> Host
     DEFINE_RINGBUFFER_MSG_TYPE(ledger_append),
     DEFINE_RINGBUFFER_MSG_TYPE(ledger_truncate),
     ///@}
+
+    /// Discard the local log, which then continues after the given index, as
+    /// a snapshot of the state at that index was installed. Enclave -> Host
+    DEFINE_RINGBUFFER_MSG_TYPE(ledger_reset),
+
+    /// Report the last index of the local log that is durable, and the number
+    /// of truncations applied since the previous report. Host -> Enclave
+    DEFINE_RINGBUFFER_MSG_TYPE(ledger_durable),
   };
 }
 
@@ -31,7 +49,19 @@ DECLARE_RINGBUFFER_MESSAGE_PAYLOAD(consensus::ledger_get, consensus::Index);
 DECLARE_RINGBUFFER_MESSAGE_PAYLOAD(
   consensus::ledger_entry, std::vector<uint8_t>);
 DECLARE_RINGBUFFER_MESSAGE_PAYLOAD(consensus::ledger_no_entry);
+DECLARE_RINGBUFFER_MESSAGE_PAYLOAD(
+  consensus::ledger_get_range, consensus::Index, consensus::Index);
+DECLARE_RINGBUFFER_MESSAGE_PAYLOAD(
+  consensus::ledger_entry_range,
+  consensus::Index,
+  consensus::Index,
+  serializer::ByteRange);
+DECLARE_RINGBUFFER_MESSAGE_PAYLOAD(
+  consensus::ledger_no_entry_range, consensus::Index, consensus::Index);
 DECLARE_RINGBUFFER_MESSAGE_PAYLOAD(
   consensus::ledger_append, std::vector<uint8_t>);
 DECLARE_RINGBUFFER_MESSAGE_PAYLOAD(
   consensus::ledger_truncate, consensus::Index);
+DECLARE_RINGBUFFER_MESSAGE_PAYLOAD(consensus::ledger_reset, consensus::Index);
+DECLARE_RINGBUFFER_MESSAGE_PAYLOAD(
+  consensus::ledger_durable, consensus::Index, size_t);
@@ -7,10 +7,12 @@
 #include "ds/spinlock.h"
 #include "kv/kvtypes.h"
 #include "node/nodetypes.h"
+#include "raftbatching.h"
 #include "rafttypes.h"
 
 #include <algorithm>
 #include <deque>
+#include <functional>
 #include <list>
 #include <random>
 #include <unordered_map>
@@ -56,12 +58,42 @@ namespace raft
       Candidate
     };
 
+    struct InFlightBatch
+    {
+      Index end_idx;
+      size_t bytes;
+    };
+
     struct NodeState
     {
       // the highest matching index with the node that was confirmed
       Index match_idx;
       // the highest index sent to the node
       Index sent_idx;
+      // batches sent to the node but not yet acknowledged, oldest first
+      std::deque<InFlightBatch> in_flight = {};
+      size_t in_flight_bytes = 0;
+      // the index entries were last retransmitted from, after a negative
+      // acknowledgement
+      Index retransmit_idx = 0;
+      // when we sent the latest append entries the node is known to have
+      // received in this term
+      std::optional<std::chrono::milliseconds> contact_at = std::nullopt;
+      // while the node is sent a snapshot instead of entries, the index of
+      // that snapshot, and the bytes of it sent and acknowledged
+      Index snapshot_idx = 0;
+      size_t snapshot_sent = 0;
+      size_t snapshot_acked = 0;
+    };
+
+    struct Snapshot
+    {
+      Index idx;
+      Term term;
+      // Size of the whole serialised snapshot, of which data may only hold
+      // the chunks received so far
+      size_t size;
+      std::vector<uint8_t> data;
     };
 
     struct Configuration
@@ -88,6 +120,8 @@ namespace raft
 
     State state;
     std::chrono::milliseconds timeout_elapsed;
+    // Time elapsed since startup, as reported by periodic
+    std::chrono::milliseconds clock = std::chrono::milliseconds(0);
 
     // Timeouts
     std::chrono::milliseconds request_timeout;
@@ -97,12 +131,30 @@ namespace raft
     std::list<Configuration> configurations;
     std::unordered_map<NodeId, NodeState> nodes;
 
-    size_t entry_size_not_limited = 0;
-    size_t entry_count = 0;
+    // Decides when new entries are sent to followers. entries_batch_size is
+    // then the largest number of entries sent in one append entries.
+    BatchController batching;
+    // The last index when entries were last sent to followers
+    Index flushed_idx = 0;
+    // When entries up to each index were sent to followers, until a majority
+    // of nodes has replicated them
+    std::deque<std::pair<Index, std::chrono::milliseconds>> replicating;
     Index entries_batch_size = 1;
     static constexpr int batch_window_size = 100;
     int batch_window_sum = 0;
 
+    // Each follower is sent batches of entries without waiting for
+    // acknowledgements, up to this many batches and bytes in flight
+    size_t max_inflight_batches;
+    size_t max_inflight_bytes;
+
+    // Sizes of the entries after the commit index, starting at
+    // entry_sizes_start, to account for the bytes in flight to each follower
+    std::deque<size_t> entry_sizes;
+    Index entry_sizes_start = 0;
+    size_t entry_sizes_total = 0;
+    size_t committed_entry_size = 0;
+
     // Indices that are eligible for global commit, from a Node's perspective
     std::deque<Index> committable_indices;
 
@@ -115,12 +167,74 @@ namespace raft
     // should be replicated
     std::optional<Index> recovery_max_index;
 
+    // When this is set, entries are only acknowledged and committed once the
+    // ledger has reported them durable. Otherwise, entries are considered
+    // durable as soon as they are written.
+    bool wait_for_durable_ledger = false;
+    Index durable_idx = 0;
+    // Number of ledger truncations not yet accounted for in a durability
+    // report. Reports received in the meantime may be stale.
+    size_t pending_truncations = 0;
+    // Most recent commit index received from the leader, committed locally
+    // once durable
+    Index leader_commit_idx = 0;
+
+    // When this is set, followers acknowledge entries as soon as they are
+    // written to the ledger, and deserialise them later, when apply_entries is
+    // called on the thread that schedule_apply hands it to. Entries are only
+    // committed once applied, so that only verified signatures are committed.
+    std::function<void()> schedule_apply;
+    bool apply_scheduled = false;
+    // Entries written to the ledger but not yet deserialised, oldest first
+    std::deque<std::pair<Index, std::vector<uint8_t>>> pending_apply;
+
+    // While the leader holds a lease, no other leader can have been elected,
+    // so it can answer reads locally. The lease lasts for lease_duration after
+    // the latest time at which a majority had heard from it. Followers do not
+    // vote for another candidate until an election timeout has elapsed since
+    // they last heard from the leader, which lease_duration is shorter than by
+    // the configured clock drift.
+    bool leader_lease;
+    std::chrono::milliseconds lease_duration;
+    // The leader's clock when it sent the latest append entries received in
+    // this term, echoed back in responses, and our clock when it was received
+    std::chrono::milliseconds leader_clock = std::chrono::milliseconds(0);
+    std::optional<std::chrono::milliseconds> leader_contact_at = std::nullopt;
+
+    // Followers that lag behind the commit index by at least snapshot_min_lag
+    // entries, or that need entries we do not have as we installed a snapshot
+    // in their place, are sent a snapshot of the committed state instead, one
+    // chunk at a time. The latest snapshot taken as leader is reused until
+    // followers would lag behind it by snapshot_min_lag entries, and released
+    // once no follower is being sent it.
+    Index snapshot_min_lag;
+    std::optional<Snapshot> snapshot = std::nullopt;
+    // When this is set, only the state is captured under the lock, and the
+    // snapshot is serialised when serialise_snapshot is called on the thread
+    // that schedule_snapshot hands it to. Followers waiting for it are sent
+    // heartbeats meanwhile.
+    std::function<void()> schedule_snapshot;
+    struct PendingSnapshot
+    {
+      Index idx;
+      Term term;
+      // The term in which the snapshot was taken, as leader
+      Term leader_term;
+      SnapshotSerialiser serialise;
+    };
+    std::optional<PendingSnapshot> pending_snapshot = std::nullopt;
+    // The snapshot being received as a follower
+    std::optional<Snapshot> partial_snapshot = std::nullopt;
+    // Index of the latest snapshot installed, up to which the ledger is empty
+    Index installed_snapshot_idx = 0;
+
     // Randomness
     std::uniform_int_distribution<int> distrib;
     std::default_random_engine rand;
 
   public:
     static constexpr size_t append_entries_size_limit = 20000;
+    static constexpr size_t install_snapshot_chunk_size = 1 << 20;
     std::unique_ptr<LedgerProxy> ledger;
     std::shared_ptr<ChannelProxy> channels;
 
@@ -132,7 +246,16 @@ namespace raft
       NodeId id,
       std::chrono::milliseconds request_timeout_,
       std::chrono::milliseconds election_timeout_,
-      bool public_only_ = false) :
+      bool public_only_ = false,
+      bool wait_for_durable_ledger_ = false,
+      size_t max_inflight_batches_ = std::numeric_limits<size_t>::max(),
+      size_t max_inflight_bytes_ = std::numeric_limits<size_t>::max(),
+      std::chrono::milliseconds commit_latency_target_ =
+        std::chrono::milliseconds(0),
+      bool leader_lease_ = false,
+      std::chrono::milliseconds lease_clock_drift_ =
+        std::chrono::milliseconds(0),
+      Index snapshot_min_lag_ = 0) :
       store(std::move(store)),
 
       current_term(0),
@@ -148,7 +271,16 @@ namespace raft
 
       request_timeout(request_timeout_),
       election_timeout(election_timeout_),
+      batching(
+        append_entries_size_limit, commit_latency_target_, request_timeout_),
+      max_inflight_batches(max_inflight_batches_),
+      max_inflight_bytes(max_inflight_bytes_),
       public_only(public_only_),
+      wait_for_durable_ledger(wait_for_durable_ledger_),
+      leader_lease(leader_lease_),
+      lease_duration(std::max(
+        election_timeout_ - lease_clock_drift_, std::chrono::milliseconds(0))),
+      snapshot_min_lag(snapshot_min_lag_),
 
       ledger(std::move(ledger_)),
       channels(channels_),
@@ -177,6 +309,49 @@ namespace raft
       return state == Follower;
     }
 
+    bool uses_leader_lease()
+    {
+      return leader_lease;
+    }
+
+    bool has_lease()
+    {
+      std::lock_guard<SpinLock> guard(lock);
+
+      if (!leader_lease || state != Leader || configurations.empty())
+        return false;
+
+      // Until it commits an entry in its own term, a new leader may not have
+      // applied every entry committed by its predecessors
+      if (get_term_internal(commit_idx) != current_term)
+        return false;
+
+      for (auto& c : configurations)
+      {
+        // The lease must be held separately in each active configuration.
+        std::vector<std::chrono::milliseconds> contacts;
+        contacts.reserve(c.nodes.size());
+
+        for (auto node : c.nodes)
+        {
+          if (node == local_id)
+            contacts.push_back(clock);
+          else if (nodes.at(node).contact_at.has_value())
+            contacts.push_back(nodes.at(node).contact_at.value());
+        }
+
+        auto majority = (c.nodes.size() / 2) + 1;
+        if (contacts.size() < majority)
+          return false;
+
+        std::sort(contacts.begin(), contacts.end(), std::greater<>());
+        if (contacts.at(majority - 1) + lease_duration <= clock)
+          return false;
+      }
+
+      return true;
+    }
+
     void enable_all_domains()
     {
       // When receiving append entries as a follower, all security domains will
@@ -185,6 +360,85 @@ namespace raft
       public_only = false;
     }
 
+    void set_apply_scheduler(std::function<void()> schedule_apply_)
+    {
+      // Followers apply entries asynchronously from now on. This should not
+      // be used by nodes in recovery, which suspend replication from the
+      // commit hooks of the entries they apply.
+      std::lock_guard<SpinLock> guard(lock);
+      schedule_apply = schedule_apply_;
+    }
+
+    void set_snapshot_scheduler(std::function<void()> schedule_snapshot_)
+    {
+      // Snapshots for followers are serialised asynchronously from now on
+      std::lock_guard<SpinLock> guard(lock);
+      schedule_snapshot = schedule_snapshot_;
+    }
+
+    void serialise_snapshot()
+    {
+      // The snapshot is serialised, and encrypted, without holding the lock,
+      // so that followers can still be sent entries in the meantime
+      PendingSnapshot ps;
+      {
+        std::lock_guard<SpinLock> guard(lock);
+        if (!pending_snapshot.has_value())
+          return;
+
+        ps = pending_snapshot.value();
+      }
+
+      auto data = ps.serialise();
+
+      std::lock_guard<SpinLock> guard(lock);
+      if (
+        !pending_snapshot.has_value() || pending_snapshot->idx != ps.idx ||
+        pending_snapshot->leader_term != ps.leader_term)
+        return;
+
+      pending_snapshot.reset();
+      if (
+        state != Leader || current_term != ps.leader_term ||
+        ps.idx < installed_snapshot_idx)
+        return;
+
+      auto size = data.size();
+      snapshot = Snapshot{ps.idx, ps.term, size, std::move(data)};
+      LOG_INFO_FMT(
+        "Took snapshot at {} for followers ({} bytes)", ps.idx, size);
+
+      for (auto& it : nodes)
+      {
+        if (it.second.snapshot_idx == ps.idx)
+          send_snapshot(it.first);
+      }
+      release_snapshot_if_unused();
+    }
+
+    void apply_entries()
+    {
+      // Deserialise the entries written to the ledger since the last call, and
+      // commit them if the leader has. The lock is released between entries so
+      // that new entries can be acknowledged in the meantime.
+      while (true)
+      {
+        std::lock_guard<SpinLock> guard(lock);
+        if (pending_apply.empty())
+        {
+          apply_scheduled = false;
+          return;
+        }
+
+        auto [idx, entry] = std::move(pending_apply.front());
+        pending_apply.pop_front();
+        apply_entry(idx, entry);
+
+        if (state == Follower)
+          commit_if_possible(std::min(leader_commit_idx, get_durable_idx()));
+      }
+    }
+
     void suspend_replication(Index idx)
     {
       // Suspend replication of append entries up to a specific version
@@ -228,6 +482,7 @@ namespace raft
       std::lock_guard<SpinLock> guard(lock);
       current_term = term;
       last_idx = index;
+      durable_idx = index;
       commit_idx = commit_idx_;
       term_history.update(index, term);
       current_term += 2;
@@ -248,6 +503,7 @@ namespace raft
       std::lock_guard<SpinLock> guard(lock);
       current_term = term;
       last_idx = index;
+      durable_idx = index;
       commit_idx = commit_idx_;
       term_history.initialise(terms);
       term_history.update(index, term);
@@ -278,6 +534,33 @@ namespace raft
       return get_term_internal(idx);
     }
 
+    void ledger_durable(Index idx, size_t truncations)
+    {
+      std::lock_guard<SpinLock> guard(lock);
+
+      // A report sent before the ledger applied all the truncations we asked
+      // for may include entries that have since been rolled back
+      pending_truncations -= std::min(pending_truncations, truncations);
+      if (pending_truncations > 0 || idx <= durable_idx)
+        return;
+
+      LOG_DEBUG_FMT("Ledger durable on {}: {}", local_id, idx);
+      durable_idx = idx;
+
+      if (state == Leader)
+      {
+        if (!configurations.empty())
+          update_commit();
+      }
+      else if (state == Follower && leader_id != NoNode)
+      {
+        // Acknowledge the entries that have become durable since the last
+        // append entries response, and commit them if the leader has
+        send_append_entries_response(leader_id, true);
+        commit_if_possible(std::min(leader_commit_idx, get_durable_idx()));
+      }
+    }
+
     void add_configuration(Index idx, std::unordered_set<NodeId> conf)
     {
       // This should only be called when the spin lock is held.
@@ -331,21 +614,12 @@ namespace raft
 
         last_idx = index;
         auto s = write_to_ledger(data);
-        entry_size_not_limited += s;
-        entry_count++;
+        record_entry_size(index, s);
 
         term_history.update(index, current_term);
-        if (entry_size_not_limited >= append_entries_size_limit)
-        {
-          update_batch_size();
-          entry_count = 0;
-          entry_size_not_limited = 0;
-          for (const auto& it : nodes)
-          {
-            LOG_DEBUG_FMT("Sending updates to follower {}", it.first);
-            send_append_entries(it.first, it.second.sent_idx + 1);
-          }
-        }
+        auto flush_reason = batching.add_entry(s);
+        if (flush_reason != BatchController::NoFlush)
+          flush(flush_reason);
       }
 
       // If we are the only node, attempt to commit immediately.
@@ -383,6 +657,14 @@ namespace raft
           recv_request_vote_response(data, size);
           break;
 
+        case raft_install_snapshot:
+          recv_install_snapshot(data, size);
+          break;
+
+        case raft_install_snapshot_response:
+          recv_install_snapshot_response(data, size);
+          break;
+
         default:
         {}
       }
@@ -392,21 +674,20 @@ namespace raft
     {
       std::lock_guard<SpinLock> guard(lock);
       timeout_elapsed += elapsed;
+      clock += elapsed;
 
       if (state == Leader)
       {
-        if (timeout_elapsed >= request_timeout)
+        bool timed_out = timeout_elapsed >= request_timeout;
+        if (timed_out)
         {
           using namespace std::chrono_literals;
           timeout_elapsed = 0ms;
-
-          update_batch_size();
-          // Send newly available entries to all nodes.
-          for (const auto& it : nodes)
-          {
-            send_append_entries(it.first, it.second.sent_idx + 1);
-          }
         }
+
+        auto flush_reason = batching.tick(elapsed, timed_out);
+        if (flush_reason != BatchController::NoFlush)
+          flush(flush_reason);
       }
       else
       {
@@ -418,12 +699,58 @@ namespace raft
       }
     }
 
+    kv::Consensus::ReplicationMetrics get_replication_metrics()
+    {
+      std::lock_guard<SpinLock> guard(lock);
+      return {batching.get_batch_size(),
+              (size_t)batching.get_flush_delay().count(),
+              BatchController::flush_reason_name(
+                batching.get_last_flush_reason()),
+              (size_t)batching.get_replication_latency_p99().count(),
+              (size_t)(batching.get_arrival_rate() * 1000)};
+    }
+
   private:
+    void flush(BatchController::FlushReason reason)
+    {
+      LOG_DEBUG_FMT(
+        "Sending entries up to {} to followers: {}",
+        last_idx,
+        BatchController::flush_reason_name(reason));
+
+      update_batch_size();
+      batching.flushed(reason);
+      if (last_idx > flushed_idx)
+        replicating.emplace_back(last_idx, clock);
+      flushed_idx = last_idx;
+
+      for (auto& it : nodes)
+      {
+        if (reason == BatchController::RequestTimeout)
+        {
+          // Every node is sent at least a heartbeat on request timeout. A
+          // retransmission that was lost is only detected when the node
+          // rejects a later append entries, so negative acknowledgements are
+          // no longer considered duplicates once a timeout elapses. Likewise,
+          // the last chunk of a snapshot sent is sent again.
+          it.second.retransmit_idx = 0;
+          it.second.snapshot_sent = it.second.snapshot_acked;
+        }
+        else if (!can_send_batch(it.second))
+        {
+          continue;
+        }
+
+        send_append_entries(it.first, it.second.sent_idx + 1);
+      }
+    }
+
     inline void update_batch_size()
     {
+      auto entry_count = batching.get_pending_entries();
       auto avg_entry_size = (entry_count == 0) ?
         append_entries_size_limit :
-        entry_size_not_limited / entry_count;
+        batching.get_pending_bytes() / entry_count;
 
       auto batch_size = (avg_entry_size == 0) ?
         append_entries_size_limit / 2 :
@@ -435,6 +762,60 @@ namespace raft
       entries_batch_size = std::max((batch_window_sum / batch_window_size), 1);
     }
 
+    Index get_durable_idx()
+    {
+      if (!wait_for_durable_ledger)
+        return last_idx;
+
+      return std::min(durable_idx, last_idx);
+    }
+
+    void truncate_ledger(Index idx)
+    {
+      ledger->truncate(idx);
+      pending_truncations++;
+      durable_idx = std::min(durable_idx, idx);
+
+      while (!entry_sizes.empty() &&
+             entry_sizes_start + (Index)entry_sizes.size() - 1 > idx)
+      {
+        entry_sizes_total -= entry_sizes.back();
+        entry_sizes.pop_back();
+      }
+    }
+
+    void record_entry_size(Index idx, size_t size)
+    {
+      if (idx != entry_sizes_start + (Index)entry_sizes.size())
+      {
+        entry_sizes.clear();
+        entry_sizes_start = idx;
+        entry_sizes_total = 0;
+      }
+
+      entry_sizes.push_back(size);
+      entry_sizes_total += size;
+    }
+
+    size_t get_entry_size(Index idx)
+    {
+      if (idx >= entry_sizes_start &&
+          idx < entry_sizes_start + (Index)entry_sizes.size())
+        return entry_sizes[idx - entry_sizes_start];
+
+      // The sizes of committed entries are not kept, so are estimated
+      if (entry_sizes.empty())
+        return committed_entry_size;
+
+      return entry_sizes_total / entry_sizes.size();
+    }
+
+    bool can_send_batch(const NodeState& node)
+    {
+      return node.in_flight.size() < max_inflight_batches &&
+        node.in_flight_bytes < max_inflight_bytes;
+    }
+
     Term get_term_internal(Index idx)
     {
       if (idx > last_idx)
@@ -445,20 +826,157 @@ namespace raft
 
     void send_append_entries(NodeId to, Index start_idx)
     {
+      // Batches are sent without waiting for the node to acknowledge previous
+      // ones, as long as there is room in its window of batches in flight.
+      auto& node = nodes.at(to);
+      if (node.snapshot_idx != 0 || needs_snapshot(start_idx))
+      {
+        send_snapshot(to);
+        return;
+      }
+
+      bool sent = false;
+
       Index end_idx = (last_idx == 0) ?
         0 :
         std::min(start_idx + entries_batch_size, last_idx);
 
-      for (Index i = end_idx; i < last_idx; i += entries_batch_size)
+      for (Index i = end_idx; i < last_idx && can_send_batch(node);
+           i += entries_batch_size)
       {
         send_append_entries_range(to, start_idx, i);
         start_idx = std::min(i + 1, last_idx);
+        sent = true;
       }
 
-      if (last_idx == 0 || end_idx <= last_idx)
+      if (can_send_batch(node))
       {
         send_append_entries_range(to, start_idx, last_idx);
       }
+      else if (!sent)
+      {
+        // The window is full, so only send an empty append entries, which
+        // serves as a heartbeat
+        send_append_entries_range(to, start_idx, start_idx - 1);
+      }
+    }
+
+    bool needs_snapshot(Index start_idx)
+    {
+      if (start_idx <= installed_snapshot_idx)
+        return true;
+
+      // Only the public state is known while recovering, so it is not
+      // snapshotted
+      return snapshot_min_lag > 0 && !public_only && start_idx <= commit_idx &&
+        commit_idx - start_idx + 1 >= snapshot_min_lag;
+    }
+
+    bool snapshot_is_fresh()
+    {
+      if (!snapshot.has_value() || snapshot->idx < installed_snapshot_idx)
+        return false;
+
+      return snapshot_min_lag == 0 ||
+        commit_idx - snapshot->idx < snapshot_min_lag;
+    }
+
+    void release_snapshot_if_unused()
+    {
+      if (!snapshot.has_value())
+        return;
+
+      for (auto& it : nodes)
+      {
+        if (it.second.snapshot_idx == snapshot->idx)
+          return;
+      }
+
+      LOG_DEBUG_FMT("Releasing snapshot at {}", snapshot->idx);
+      snapshot.reset();
+    }
+
+    void start_snapshot(NodeId to, Index idx)
+    {
+      LOG_INFO_FMT("Sending snapshot at {} from {} to {}", idx, local_id, to);
+      auto& node = nodes.at(to);
+      node.snapshot_idx = idx;
+      node.snapshot_sent = 0;
+      node.snapshot_acked = 0;
+      node.in_flight.clear();
+      node.in_flight_bytes = 0;
+    }
+
+    void send_snapshot(NodeId to)
+    {
+      auto& node = nodes.at(to);
+
+      // Chunks are sent one at a time, once the previous one is acknowledged
+      if (node.snapshot_sent > node.snapshot_acked)
+        return;
+
+      if (
+        node.snapshot_idx == 0 || !snapshot.has_value() ||
+        snapshot->idx != node.snapshot_idx)
+      {
+        // Snapshots are taken at the commit index, which is a signature index
+        if (!snapshot_is_fresh())
+        {
+          if (schedule_snapshot)
+          {
+            if (!pending_snapshot.has_value())
+            {
+              pending_snapshot = PendingSnapshot{commit_idx,
+                                                 get_term_internal(commit_idx),
+                                                 current_term,
+                                                 store->snapshot(commit_idx)};
+              schedule_snapshot();
+            }
+
+            // The node is sent the snapshot once it has been serialised, and
+            // only heartbeats until then
+            if (node.snapshot_idx != pending_snapshot->idx)
+              start_snapshot(to, pending_snapshot->idx);
+            send_append_entries_range(to, node.sent_idx + 1, node.sent_idx);
+            return;
+          }
+
+          auto data = store->snapshot(commit_idx)();
+          auto size = data.size();
+          snapshot = Snapshot{
+            commit_idx, get_term_internal(commit_idx), size, std::move(data)};
+          LOG_INFO_FMT(
+            "Took snapshot at {} for followers ({} bytes)", commit_idx, size);
+        }
+
+        start_snapshot(to, snapshot->idx);
+      }
+
+      const auto& s = snapshot.value();
+      auto offset = node.snapshot_acked;
+      auto end = std::min(offset + install_snapshot_chunk_size, s.size);
+      std::vector<uint8_t> chunk(s.data.begin() + offset, s.data.begin() + end);
+
+      LOG_DEBUG_FMT(
+        "Send install snapshot from {} to {}: {} ({} to {} of {})",
+        local_id,
+        to,
+        s.idx,
+        offset,
+        end,
+        s.size);
+
+      InstallSnapshot is = {raft_install_snapshot,
+                            local_id,
+                            current_term,
+                            s.idx,
+                            s.term,
+                            offset,
+                            s.size,
+                            (uint64_t)clock.count()};
+
+      node.snapshot_sent = end;
+      channels->send_encrypted(ccf::NodeMsgType::consensus_msg, to, chunk, is);
     }
 
     void send_append_entries_range(NodeId to, Index start_idx, Index end_idx)
@@ -482,13 +1000,24 @@ namespace raft
                           current_term,
                           prev_term,
                           commit_idx,
-                          term_of_idx};
+                          term_of_idx,
+                          (uint64_t)clock.count()};
 
       auto& node = nodes.at(to);
 
       // Record the most recent index we have sent to this node.
       node.sent_idx = end_idx;
 
+      if (end_idx >= start_idx)
+      {
+        size_t bytes = 0;
+        for (Index i = start_idx; i <= end_idx; ++i)
+          bytes += get_entry_size(i);
+
+        node.in_flight.push_back({end_idx, bytes});
+        node.in_flight_bytes += bytes;
+      }
+
       // The host will append log entries to this message when it is
       // sent to the destination node.
       channels->send_authenticated(ccf::NodeMsgType::consensus_msg, to, ae);
@@ -556,6 +1085,10 @@ namespace raft
         return;
       }
 
+      leader_clock =
+        std::max(leader_clock, std::chrono::milliseconds(r.leader_clock));
+      leader_contact_at = clock;
+
       if (prev_term != r.prev_term)
       {
         // Reply false if the log doesn't contain an entry at r.prev_idx
@@ -632,6 +1165,7 @@ namespace raft
         last_idx = i;
         is_first_entry = false;
         auto ret = ledger->record_entry(data, size);
+        record_entry_size(i, ret.first.size());
 
         if (!ret.second)
         {
@@ -644,35 +1178,21 @@ namespace raft
             r.from_node);
 
           last_idx = r.prev_idx;
-          ledger->truncate(r.prev_idx);
+          truncate_ledger(r.prev_idx);
           send_append_entries_response(r.from_node, false);
           return;
         }
 
-        Term sig_term = 0;
-        auto deserialise_success =
-          store->deserialise(ret.first, public_only, &sig_term);
+        if (schedule_apply)
+          pending_apply.emplace_back(i, std::move(ret.first));
+        else
+          apply_entry(i, ret.first);
+      }
 
-        switch (deserialise_success)
-        {
-          case kv::DeserialiseSuccess::FAILED:
-            throw std::logic_error(
-              "Follower failed to apply log entry " + std::to_string(i));
-            break;
-
-          case kv::DeserialiseSuccess::PASS_SIGNATURE:
-            LOG_DEBUG_FMT("Deserialising signature at {}", i);
-            committable_indices.push_back(i);
-            if (sig_term)
-              term_history.update(commit_idx + 1, sig_term);
-            break;
-
-          case kv::DeserialiseSuccess::PASS:
-            break;
-
-          default:
-            throw std::logic_error("Unknown DeserialiseSuccess value");
-        }
+      if (!pending_apply.empty() && !apply_scheduled)
+      {
+        apply_scheduled = true;
+        schedule_apply();
       }
 
       // Update the current leader because we accepted entries.
@@ -683,22 +1203,69 @@ namespace raft
       }
 
       send_append_entries_response(r.from_node, true);
-      commit_if_possible(r.leader_commit_idx);
+
+      // Only durable entries are committed
+      leader_commit_idx = r.leader_commit_idx;
+      commit_if_possible(std::min(leader_commit_idx, get_durable_idx()));
 
       term_history.update(commit_idx + 1, r.term_of_idx);
     }
 
+    void apply_entry(Index idx, const std::vector<uint8_t>& entry)
+    {
+      Term sig_term = 0;
+      auto deserialise_success =
+        store->deserialise(entry, public_only, &sig_term);
+
+      switch (deserialise_success)
+      {
+        case kv::DeserialiseSuccess::FAILED:
+          throw std::logic_error(
+            "Follower failed to apply log entry " + std::to_string(idx));
+          break;
+
+        case kv::DeserialiseSuccess::PASS_SIGNATURE:
+          LOG_DEBUG_FMT("Deserialising signature at {}", idx);
+          committable_indices.push_back(idx);
+          if (sig_term)
+            term_history.update(commit_idx + 1, sig_term);
+          break;
+
+        case kv::DeserialiseSuccess::PASS:
+          break;
+
+        default:
+          throw std::logic_error("Unknown DeserialiseSuccess value");
+      }
+    }
+
+    void update_contact(NodeState& node, uint64_t echoed_clock)
+    {
+      // The node has received every message we sent up to the one it echoes
+      // the clock of
+      auto echoed = std::chrono::milliseconds(echoed_clock);
+      if (!node.contact_at.has_value() || node.contact_at.value() < echoed)
+        node.contact_at = echoed;
+    }
+
     void send_append_entries_response(NodeId to, bool answer)
     {
+      // Entries are only acknowledged once durable
+      auto response_idx = get_durable_idx();
+
       LOG_DEBUG_FMT(
         "Send append entries response from {} to {} for index {}: {}",
         local_id,
         to,
-        last_idx,
+        response_idx,
         answer);
 
-      AppendEntriesResponse response = {
-        raft_append_entries_response, local_id, current_term, last_idx, answer};
+      AppendEntriesResponse response = {raft_append_entries_response,
+                                        local_id,
+                                        current_term,
+                                        response_idx,
+                                        answer,
+                                        (uint64_t)leader_clock.count()};
 
       channels->send_authenticated(
         ccf::NodeMsgType::consensus_msg, to, response);
@@ -733,7 +1300,11 @@ namespace raft
           r.from_node);
         return;
       }
-      else if (current_term < r.term)
+
+      if (current_term == r.term)
+        update_contact(node->second, r.leader_clock);
+
+      if (current_term < r.term)
       {
         // We are behind, convert to a follower.
         LOG_DEBUG_FMT(
@@ -767,16 +1338,35 @@ namespace raft
       }
 
       // Update next and match for the responding node.
-      node->second.match_idx = std::min(r.last_log_idx, last_idx);
+      auto& ns = node->second;
+      ns.match_idx = std::min(r.last_log_idx, last_idx);
 
       if (!r.success)
       {
-        // Failed due to log inconsistency. Reset sent_idx and try again.
+        // Every batch in flight after the inconsistency is rejected too, with
+        // the same last index. Only the first of these rejections causes a
+        // retransmission.
+        if (ns.retransmit_idx == ns.match_idx + 1)
+        {
+          LOG_DEBUG_FMT(
+            "Recv append entries response to {} from {}: failed, already "
+            "retransmitting from {}",
+            local_id,
+            r.from_node,
+            ns.retransmit_idx);
+          return;
+        }
+
+        // Failed due to log inconsistency. Reset sent_idx and retransmit
+        // immediately, as nothing in flight will be accepted.
         LOG_DEBUG_FMT(
           "Recv append entries response to {} from {}: failed",
           local_id,
           r.from_node);
-        send_append_entries(r.from_node, node->second.match_idx + 1);
+        ns.in_flight.clear();
+        ns.in_flight_bytes = 0;
+        ns.retransmit_idx = ns.match_idx + 1;
+        send_append_entries(r.from_node, ns.match_idx + 1);
         return;
       }
 
@@ -785,6 +1375,238 @@ namespace raft
         local_id,
         r.from_node,
         r.last_log_idx);
+
+      while (!ns.in_flight.empty() &&
+             ns.in_flight.front().end_idx <= r.last_log_idx)
+      {
+        ns.in_flight_bytes -= ns.in_flight.front().bytes;
+        ns.in_flight.pop_front();
+      }
+
+      // Acknowledged batches make room in the window, so entries that were
+      // held back by the window are sent straight away.
+      if (ns.sent_idx < flushed_idx && can_send_batch(ns))
+        send_append_entries(r.from_node, ns.sent_idx + 1);
+
+      update_commit();
+    }
+
+    void recv_install_snapshot(const uint8_t* data, size_t size)
+    {
+      std::pair<InstallSnapshot, std::vector<uint8_t>> r;
+
+      try
+      {
+        r = channels->template recv_encrypted<InstallSnapshot>(data, size);
+      }
+      catch (const std::logic_error& err)
+      {
+        LOG_FAIL_FMT(err.what());
+        return;
+      }
+
+      const auto& is = r.first;
+      const auto& chunk = r.second;
+
+      LOG_DEBUG_FMT(
+        "Recv install snapshot to {} from {}: {} ({} to {} of {})",
+        local_id,
+        is.from_node,
+        is.idx,
+        is.offset,
+        is.offset + chunk.size(),
+        is.size);
+
+      if (current_term == is.term && state == Candidate)
+      {
+        become_follower(is.term);
+      }
+      else if (current_term < is.term)
+      {
+        become_follower(is.term);
+      }
+      else if (current_term > is.term)
+      {
+        LOG_DEBUG_FMT(
+          "Recv install snapshot to {} from {} but our term is later",
+          local_id,
+          is.from_node);
+        send_install_snapshot_response(is.from_node, is.idx, 0);
+        return;
+      }
+
+      restart_election_timeout();
+      leader_clock =
+        std::max(leader_clock, std::chrono::milliseconds(is.leader_clock));
+      leader_contact_at = clock;
+
+      if (leader_id != is.from_node)
+      {
+        leader_id = is.from_node;
+        LOG_DEBUG_FMT("Node {} thinks leader is {}", local_id, leader_id);
+      }
+
+      if (is.idx <= commit_idx)
+      {
+        // We already have the state at the snapshot index
+        send_install_snapshot_response(is.from_node, is.idx, is.size);
+        return;
+      }
+
+      if (
+        !partial_snapshot.has_value() || partial_snapshot->idx != is.idx ||
+        partial_snapshot->term != is.term_of_idx ||
+        partial_snapshot->size != is.size)
+      {
+        partial_snapshot = Snapshot{is.idx, is.term_of_idx, is.size, {}};
+      }
+
+      // Chunks that do not follow the ones received so far are discarded, and
+      // the leader resumes from the end of the latter
+      auto& s = partial_snapshot.value();
+      if (is.offset == s.data.size() && s.data.size() + chunk.size() <= s.size)
+        s.data.insert(s.data.end(), chunk.begin(), chunk.end());
+
+      auto received = s.data.size();
+      if (received == s.size)
+      {
+        install_snapshot(s.idx, s.term, s.data);
+        partial_snapshot.reset();
+      }
+
+      send_install_snapshot_response(is.from_node, is.idx, received);
+    }
+
+    void install_snapshot(
+      Index idx, Term term, const std::vector<uint8_t>& data)
+    {
+      LOG_INFO_FMT("Installing snapshot on {} at {}", local_id, idx);
+
+      // Entries after the commit index may conflict with the snapshot, and
+      // the ones up to the snapshot index are superseded by it
+      rollback(commit_idx);
+      pending_apply.clear();
+      committable_indices.clear();
+
+      // The configurations in the snapshot are added back by the local hooks
+      // that run as it is installed
+      if (store->deserialise_snapshot(data) == kv::DeserialiseSuccess::FAILED)
+      {
+        throw std::logic_error(
+          "Follower failed to install snapshot at " + std::to_string(idx));
+      }
+
+      ledger->reset(idx);
+      pending_truncations++;
+      durable_idx = idx;
+      entry_sizes.clear();
+      entry_sizes_total = 0;
+
+      last_idx = idx;
+      installed_snapshot_idx = idx;
+      term_history.update(idx, term);
+      commit(idx);
+    }
+
+    void send_install_snapshot_response(
+      NodeId to, Index idx, size_t received)
+    {
+      LOG_DEBUG_FMT(
+        "Send install snapshot response from {} to {} for index {}: {}",
+        local_id,
+        to,
+        idx,
+        received);
+
+      InstallSnapshotResponse response = {raft_install_snapshot_response,
+                                          local_id,
+                                          current_term,
+                                          idx,
+                                          received,
+                                          (uint64_t)leader_clock.count()};
+
+      channels->send_authenticated(
+        ccf::NodeMsgType::consensus_msg, to, response);
+    }
+
+    void recv_install_snapshot_response(const uint8_t* data, size_t size)
+    {
+      // Ignore if we're not the leader.
+      if (state != Leader)
+        return;
+
+      InstallSnapshotResponse r;
+
+      try
+      {
+        r = channels->template recv_authenticated<InstallSnapshotResponse>(
+          data, size);
+      }
+      catch (const std::logic_error& err)
+      {
+        LOG_FAIL_FMT(err.what());
+        return;
+      }
+
+      auto node = nodes.find(r.from_node);
+      if (node == nodes.end())
+      {
+        LOG_FAIL_FMT(
+          "Recv install snapshot response to {} from {}: unknown node",
+          local_id,
+          r.from_node);
+        return;
+      }
+
+      if (current_term < r.term)
+      {
+        LOG_DEBUG_FMT(
+          "Recv install snapshot response to {} from {}: more recent term",
+          local_id,
+          r.from_node);
+        become_follower(r.term);
+        return;
+      }
+
+      auto& ns = node->second;
+      if (current_term != r.term || r.idx != ns.snapshot_idx)
+      {
+        LOG_DEBUG_FMT(
+          "Recv install snapshot response to {} from {}: stale",
+          local_id,
+          r.from_node);
+        return;
+      }
+
+      update_contact(ns, r.leader_clock);
+
+      // The node may have discarded the last chunk sent, in which case it is
+      // sent again
+      ns.snapshot_acked = r.received;
+      ns.snapshot_sent = r.received;
+
+      if (
+        !snapshot.has_value() || snapshot->idx != ns.snapshot_idx ||
+        r.received < snapshot->size)
+      {
+        send_snapshot(r.from_node);
+        return;
+      }
+
+      LOG_INFO_FMT(
+        "Recv install snapshot response to {} from {} for index {}: complete",
+        local_id,
+        r.from_node,
+        r.idx);
+
+      ns.snapshot_idx = 0;
+      ns.snapshot_sent = 0;
+      ns.snapshot_acked = 0;
+      ns.match_idx = std::max(ns.match_idx, r.idx);
+      ns.retransmit_idx = 0;
+      release_snapshot_if_unused();
+      send_append_entries(r.from_node, r.idx + 1);
+
       update_commit();
     }
 
@@ -826,6 +1648,20 @@ namespace raft
         return;
       }
 
+      if (
+        leader_lease && state == Follower && leader_contact_at.has_value() &&
+        clock - leader_contact_at.value() < election_timeout)
+      {
+        // Reply false, since the leader may hold a lease that relies on us not
+        // voting for anyone else until we stop hearing from it.
+        LOG_DEBUG_FMT(
+          "Recv request vote to {} from {}: leader is still active",
+          local_id,
+          r.from_node);
+        send_request_vote_response(r.from_node, false);
+        return;
+      }
+
       if (current_term > r.term)
       {
         // Reply false, since our term is later than the received term.
@@ -993,6 +1829,14 @@ namespace raft
 
     void become_leader()
     {
+      // Entries received as a follower are applied before any are discarded,
+      // as they would have been had they been applied on receipt
+      while (!pending_apply.empty())
+      {
+        apply_entry(pending_apply.front().first, pending_apply.front().second);
+        pending_apply.pop_front();
+      }
+
       // Discard any un-committed updates we may hold,
       // since we have no signature for them. Except at startup,
       // where we do not want to roll back the genesis transaction.
@@ -1000,6 +1844,7 @@ namespace raft
         rollback(commit_idx);
 
       committable_indices.clear();
+      replicating.clear();
       state = Leader;
       leader_id = local_id;
 
@@ -1022,6 +1867,13 @@ namespace raft
       {
         it->second.match_idx = 0;
         it->second.sent_idx = next - 1;
+        it->second.in_flight.clear();
+        it->second.in_flight_bytes = 0;
+        it->second.retransmit_idx = 0;
+        it->second.contact_at.reset();
+        it->second.snapshot_idx = 0;
+        it->second.snapshot_sent = 0;
+        it->second.snapshot_acked = 0;
 
         // Send an empty append_entries to all nodes.
         send_append_entries(it->first, next);
@@ -1037,6 +1889,10 @@ namespace raft
       current_term = term;
       voted_for = NoNode;
       votes_for_me.clear();
+      leader_clock = std::chrono::milliseconds(0);
+      leader_contact_at.reset();
+      snapshot.reset();
+      pending_snapshot.reset();
 
       // Rollback unreplicated commits.
       rollback(commit_idx);
@@ -1071,7 +1927,7 @@ namespace raft
         for (auto node : c.nodes)
         {
           if (node == local_id)
-            match.push_back(last_idx);
+            match.push_back(get_durable_idx());
           else
             match.push_back(nodes.at(node).match_idx);
         }
@@ -1094,6 +1950,15 @@ namespace raft
           "Followers appear to have later match indices than leader");
       }
 
+      // Only the majority affects commit latency, so slower followers do not
+      // hold back batching
+      while (!replicating.empty() &&
+             replicating.front().first <= new_commit_idx)
+      {
+        batching.add_replication_latency(clock - replicating.front().second);
+        replicating.pop_front();
+      }
+
       commit_if_possible(new_commit_idx);
     }
 
@@ -1132,6 +1997,16 @@ namespace raft
 
       commit_idx = idx;
 
+      if (!entry_sizes.empty())
+        committed_entry_size = entry_sizes_total / entry_sizes.size();
+
+      while (!entry_sizes.empty() && entry_sizes_start <= idx)
+      {
+        entry_sizes_total -= entry_sizes.front();
+        entry_sizes.pop_front();
+        entry_sizes_start++;
+      }
+
       LOG_DEBUG_FMT("Compacting...");
       store->compact(idx);
       LOG_DEBUG_FMT("Commit on {}: {}", local_id, idx);
@@ -1164,10 +2039,21 @@ namespace raft
     void rollback(Index idx)
     {
       store->rollback(idx);
-      ledger->truncate(idx);
+      truncate_ledger(idx);
       last_idx = idx;
+      flushed_idx = std::min(flushed_idx, idx);
       LOG_DEBUG_FMT("Rolled back at {}", idx);
 
+      while (!pending_apply.empty() && (pending_apply.back().first > idx))
+      {
+        pending_apply.pop_back();
+      }
+
+      while (!replicating.empty() && (replicating.back().first > idx))
+      {
+        replicating.pop_back();
+      }
+
       while (!committable_indices.empty() && (committable_indices.back() > idx))
       {
         committable_indices.pop_back();
@@ -1213,6 +2099,9 @@ namespace raft
         LOG_INFO_FMT("Removed node {}", node_id);
       }
 
+      if (!to_remove.empty())
+        release_snapshot_if_unused();
+
       for (auto node_id : active_nodes)
       {
         if (node_id == local_id)
@@ -0,0 +1,221 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the Apache 2.0 License.
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+namespace raft
+{
+  // Chooses when the leader sends newly replicated entries to its followers.
+  //
+  // Commit latency is the time an entry waits to be sent, plus the time a
+  // majority of nodes takes to replicate it once sent. Entries are held back
+  // for as long as the p99 replication latency leaves room within the target,
+  // and are sent once as many entries have arrived as are expected within that
+  // delay at the current arrival rate. Until replication latencies have been
+  // observed, if there is no target, or if replication alone takes up the
+  // target, entries are only sent once they exceed the size limit, or on
+  // request timeout.
+  class BatchController
+  {
+  public:
+    enum FlushReason
+    {
+      NoFlush,
+      SizeLimit,
+      BatchFull,
+      DelayElapsed,
+      RequestTimeout
+    };
+
+    static const char* flush_reason_name(FlushReason reason)
+    {
+      switch (reason)
+      {
+        case SizeLimit:
+          return "size_limit";
+        case BatchFull:
+          return "batch_full";
+        case DelayElapsed:
+          return "delay_elapsed";
+        case RequestTimeout:
+          return "request_timeout";
+        default:
+          return "none";
+      }
+    }
+
+  private:
+    using ms = std::chrono::milliseconds;
+
+    static constexpr size_t latency_samples = 128;
+    // Weight of the latest tick in the average arrival rate
+    static constexpr double arrival_rate_weight = 0.2;
+
+    size_t size_limit;
+    ms target_latency;
+    ms max_delay;
+
+    // Most recent replication latencies, overwritten oldest first. Their p99
+    // is computed once per tick, in a buffer kept across ticks.
+    std::vector<ms> replication_latencies;
+    std::vector<ms> sorted_latencies;
+    size_t next_replication_latency = 0;
+    bool latencies_changed = false;
+    ms replication_latency_p99 = ms(0);
+
+    // Entries per millisecond
+    double arrival_rate = 0.0;
+    size_t arrivals = 0;
+
+    size_t pending_entries = 0;
+    size_t pending_bytes = 0;
+    ms pending_for = ms(0);
+
+    size_t batch_size = std::numeric_limits<size_t>::max();
+    ms flush_delay = ms::max();
+    FlushReason last_flush_reason = NoFlush;
+
+    bool adaptive() const
+    {
+      // Until the p99 is first computed, there is no latency to go by
+      return target_latency.count() > 0 && !sorted_latencies.empty() &&
+        replication_latency_p99 < target_latency;
+    }
+
+    void update_replication_latency_p99()
+    {
+      sorted_latencies.assign(
+        replication_latencies.begin(), replication_latencies.end());
+      auto p99 =
+        sorted_latencies.begin() + (sorted_latencies.size() * 99) / 100;
+      std::nth_element(sorted_latencies.begin(), p99, sorted_latencies.end());
+      replication_latency_p99 = *p99;
+      latencies_changed = false;
+    }
+
+    void update()
+    {
+      if (!adaptive())
+        return;
+
+      flush_delay =
+        std::min(target_latency - replication_latency_p99, max_delay);
+      batch_size = std::max<size_t>(
+        1, (size_t)std::ceil(arrival_rate * flush_delay.count()));
+    }
+
+  public:
+    BatchController(size_t size_limit_, ms target_latency_, ms max_delay_) :
+      size_limit(size_limit_),
+      target_latency(target_latency_),
+      max_delay(max_delay_)
+    {
+      replication_latencies.reserve(latency_samples);
+      sorted_latencies.reserve(latency_samples);
+    }
+
+    FlushReason add_entry(size_t size)
+    {
+      pending_entries++;
+      pending_bytes += size;
+      arrivals++;
+
+      if (pending_bytes >= size_limit)
+        return SizeLimit;
+
+      if (adaptive() && pending_entries >= batch_size)
+        return BatchFull;
+
+      return NoFlush;
+    }
+
+    FlushReason tick(ms elapsed, bool timed_out)
+    {
+      if (elapsed.count() > 0)
+      {
+        auto rate = (double)arrivals / elapsed.count();
+        arrival_rate = arrival_rate_weight * rate +
+          (1.0 - arrival_rate_weight) * arrival_rate;
+        arrivals = 0;
+      }
+
+      if (latencies_changed)
+        update_replication_latency_p99();
+      update();
+
+      if (pending_entries > 0)
+        pending_for += elapsed;
+
+      if (timed_out)
+        return RequestTimeout;
+
+      if (adaptive() && pending_entries > 0 && pending_for >= flush_delay)
+        return DelayElapsed;
+
+      return NoFlush;
+    }
+
+    // Record the time a majority of nodes took to replicate entries once they
+    // were sent. Takes effect on the next tick.
+    void add_replication_latency(ms latency)
+    {
+      if (replication_latencies.size() < latency_samples)
+        replication_latencies.push_back(latency);
+      else
+        replication_latencies[next_replication_latency] = latency;
+      next_replication_latency =
+        (next_replication_latency + 1) % latency_samples;
+      latencies_changed = true;
+    }
+
+    void flushed(FlushReason reason)
+    {
+      pending_entries = 0;
+      pending_bytes = 0;
+      pending_for = ms(0);
+      last_flush_reason = reason;
+    }
+
+    size_t get_pending_entries() const
+    {
+      return pending_entries;
+    }
+
+    size_t get_pending_bytes() const
+    {
+      return pending_bytes;
+    }
+
+    // The batch size and flush delay are 0 while entries are not batched
+    // adaptively
+    size_t get_batch_size() const
+    {
+      return adaptive() ? batch_size : 0;
+    }
+
+    ms get_flush_delay() const
+    {
+      return adaptive() ? flush_delay : ms(0);
+    }
+
+    ms get_replication_latency_p99() const
+    {
+      return replication_latency_p99;
+    }
+
+    double get_arrival_rate() const
+    {
+      return arrival_rate;
+    }
+
+    FlushReason get_last_flush_reason() const
+    {
+      return last_flush_reason;
+    }
+  };
+}
@@ -92,6 +92,11 @@ namespace raft
       raft->periodic(elapsed);
     }
 
+    void ledger_durable(SeqNo seqno, size_t truncations) override
+    {
+      raft->ledger_durable(seqno, truncations);
+    }
+
     void enable_all_domains() override
     {
       raft->enable_all_domains();
@@ -107,6 +112,21 @@ namespace raft
       raft->suspend_replication(version);
     }
 
+    std::optional<ReplicationMetrics> get_replication_metrics() override
+    {
+      return raft->get_replication_metrics();
+    }
+
+    bool uses_leader_lease() override
+    {
+      return raft->uses_leader_lease();
+    }
+
+    bool lease_lapsed() override
+    {
+      return raft->uses_leader_lease() && !raft->has_lease();
+    }
+
     void set_f(ccf::NodeId) override
     {
       return;
@@ -7,8 +7,11 @@
 
 #include <chrono>
 #include <cstdint>
+#include <functional>
 #include <limits>
+#include <memory>
 #include <msgpack.hpp>
+#include <vector>
 
 namespace raft
 {
@@ -23,9 +26,41 @@ namespace raft
   {
     size_t request_timeout;
     size_t election_timeout;
-    MSGPACK_DEFINE(request_timeout, election_timeout);
+    // Maximum number of batches of entries, and of bytes of entries, sent to
+    // a follower but not yet acknowledged
+    size_t max_inflight_batches;
+    size_t max_inflight_bytes;
+    // Target p99 latency, in milliseconds, from replicating an entry to
+    // replication on a majority, which the leader batches entries within
+    size_t commit_latency_target;
+    // Followers acknowledge entries once written to the ledger, and apply
+    // them on a worker thread
+    bool async_apply;
+    // The leader answers reads locally while it holds a lease, which lasts
+    // for the election timeout less the maximum clock drift, in milliseconds,
+    // between nodes over that period
+    bool leader_lease;
+    size_t lease_clock_drift;
+    // Followers lagging behind the commit index by at least this many entries
+    // are sent a snapshot of the committed state instead. 0 never sends
+    // snapshots.
+    size_t snapshot_min_lag;
+    MSGPACK_DEFINE(
+      request_timeout,
+      election_timeout,
+      max_inflight_batches,
+      max_inflight_bytes,
+      commit_latency_target,
+      async_apply,
+      leader_lease,
+      lease_clock_drift,
+      snapshot_min_lag);
   };
 
+  // Serialises a snapshot of the store captured at some index. It holds no
+  // lock on the store, so may run on any thread.
+  using SnapshotSerialiser = std::function<std::vector<uint8_t>()>;
+
   template <typename S>
   class Store
   {
@@ -37,6 +72,8 @@ namespace raft
       Term* term = nullptr) = 0;
     virtual void compact(Index v) = 0;
     virtual void rollback(Index v) = 0;
+    virtual SnapshotSerialiser snapshot(Index v) = 0;
+    virtual S deserialise_snapshot(const std::vector<uint8_t>& data) = 0;
   };
 
   template <typename T, typename S>
@@ -73,6 +110,25 @@ namespace raft
       if (p)
         p->rollback(v);
     }
+
+    SnapshotSerialiser snapshot(Index v)
+    {
+      auto p = x.lock();
+      if (!p)
+        return []() { return std::vector<uint8_t>(); };
+
+      std::shared_ptr<typename T::Snapshot> s = p->snapshot(v);
+      return [s]() { return s->serialise(); };
+    }
+
+    S deserialise_snapshot(const std::vector<uint8_t>& data)
+    {
+      auto p = x.lock();
+      if (p)
+        return p->deserialise_snapshot(data);
+
+      return S::FAILED;
+    }
   };
 
   enum RaftMsgType : Node2NodeMsg
@@ -81,6 +137,8 @@ namespace raft
     raft_append_entries_response,
     raft_request_vote,
     raft_request_vote_response,
+    raft_install_snapshot,
+    raft_install_snapshot_response,
   };
 
 #pragma pack(push, 1)
@@ -97,6 +155,8 @@ namespace raft
     Term prev_term;
     Index leader_commit_idx;
     Term term_of_idx;
+    // Leader's clock when sent, in milliseconds
+    uint64_t leader_clock;
   };
 
   struct AppendEntriesResponse : RaftHeader
@@ -104,6 +164,8 @@ namespace raft
     Term term;
     Index last_log_idx;
     bool success;
+    // leader_clock of the latest append entries received in this term
+    uint64_t leader_clock;
   };
 
   struct RequestVote : RaftHeader
@@ -122,5 +184,28 @@ namespace raft
     Term term;
     bool vote_granted;
   };
+
+  // Followed by a chunk of the serialised snapshot, encrypted
+  struct InstallSnapshot : RaftHeader
+  {
+    Term term;
+    // The snapshot is of the committed state at this signature index
+    Index idx;
+    Term term_of_idx;
+    // Offset of the chunk in the serialised snapshot, and size of the whole
+    // serialised snapshot
+    size_t offset;
+    size_t size;
+    uint64_t leader_clock;
+  };
+
+  struct InstallSnapshotResponse : RaftHeader
+  {
+    Term term;
+    Index idx;
+    // Bytes of the snapshot received so far, from which the leader continues
+    size_t received;
+    uint64_t leader_clock;
+  };
 #pragma pack(pop)
 }
\ No newline at end of file
@@ -6,6 +6,7 @@
 #include "consensus/raft/rafttypes.h"
 
 #include <map>
+#include <optional>
 #include <vector>
 
 namespace raft
@@ -64,6 +65,16 @@ namespace raft
 #endif
     }
 
+    void reset(Index idx)
+    {
+      ledger.clear();
+      ledger.resize(idx);
+#ifdef STUB_LOG
+      std::cout << "  KV" << _id << "->>Node" << _id << ": reset i: " << idx
+                << std::endl;
+#endif
+    }
+
     void reset_skip_count()
     {
       skip_count = 0;
@@ -80,6 +91,10 @@ namespace raft
       sent_request_vote_response;
     std::list<std::pair<NodeId, AppendEntriesResponse>>
       sent_append_entries_response;
+    // Install snapshot messages are followed by the chunk of the snapshot
+    std::list<std::pair<NodeId, std::vector<uint8_t>>> sent_install_snapshot;
+    std::list<std::pair<NodeId, InstallSnapshotResponse>>
+      sent_install_snapshot_response;
 
     ChannelStubProxy() {}
 
@@ -111,10 +126,34 @@ namespace raft
       sent_append_entries_response.push_back(std::make_pair(to, data));
     }
 
+    void send_authenticated(
+      const ccf::NodeMsgType& msg_type,
+      NodeId to,
+      const InstallSnapshotResponse& data)
+    {
+      sent_install_snapshot_response.push_back(std::make_pair(to, data));
+    }
+
+    bool send_encrypted(
+      const ccf::NodeMsgType& msg_type,
+      NodeId to,
+      const std::vector<uint8_t>& data,
+      const InstallSnapshot& msg)
+    {
+      std::vector<uint8_t> contents(sizeof(msg) + data.size());
+      auto ptr = contents.data();
+      auto size = contents.size();
+      serialized::write(ptr, size, msg);
+      serialized::write(ptr, size, data.data(), data.size());
+      sent_install_snapshot.push_back(std::make_pair(to, contents));
+      return true;
+    }
+
     size_t sent_msg_count() const
     {
       return sent_request_vote.size() + sent_request_vote_response.size() +
-        sent_append_entries.size() + sent_append_entries_response.size();
+        sent_append_entries.size() + sent_append_entries_response.size() +
+        sent_install_snapshot.size() + sent_install_snapshot_response.size();
     }
 
     template <class T>
@@ -122,6 +161,14 @@ namespace raft
     {
       return serialized::overlay<T>(data, size);
     }
+
+    template <class T>
+    std::pair<T, std::vector<uint8_t>> recv_encrypted(
+      const uint8_t* data, size_t size)
+    {
+      auto t = serialized::read<T>(data, size);
+      return std::make_pair(t, std::vector<uint8_t>(data, data + size));
+    }
   };
 
   class LoggingStubStore
@@ -130,6 +177,24 @@ namespace raft
     raft::NodeId _id;
 
   public:
+    // Contents of the snapshots taken, and the latest snapshot installed
+    std::vector<uint8_t> snapshot_data;
+    std::optional<std::vector<uint8_t>> installed_snapshot = std::nullopt;
+
+    class Snapshot
+    {
+    private:
+      std::vector<uint8_t> data;
+
+    public:
+      Snapshot(const std::vector<uint8_t>& data_) : data(data_) {}
+
+      std::vector<uint8_t> serialise()
+      {
+        return data;
+      }
+    };
+
     LoggingStubStore(raft::NodeId id) : _id(id) {}
 
     virtual void compact(Index i)
@@ -155,6 +220,22 @@ namespace raft
     {
       return kv::DeserialiseSuccess::PASS;
     }
+
+    std::unique_ptr<Snapshot> snapshot(Index i)
+    {
+#ifdef STUB_LOG
+      std::cout << "  Node" << _id << "->>KV" << _id << ": snapshot i: " << i
+                << std::endl;
+#endif
+      return std::make_unique<Snapshot>(snapshot_data);
+    }
+
+    kv::DeserialiseSuccess deserialise_snapshot(
+      const std::vector<uint8_t>& data)
+    {
+      installed_snapshot = data;
+      return kv::DeserialiseSuccess::PASS;
+    }
   };
 
   class LoggingStubStoreSig : public LoggingStubStore
@@ -86,6 +86,48 @@ DOCTEST_TEST_CASE("Single node commit" * doctest::test_suite("single"))
   }
 }
 
+DOCTEST_TEST_CASE(
+  "Single node commit with durable ledger" * doctest::test_suite("single"))
+{
+  auto kv_store = std::make_shared<Store>(0);
+  raft::NodeId node_id(0);
+  ms election_timeout(150);
+
+  TRaft r0(
+    std::make_unique<Adaptor>(kv_store),
+    std::make_unique<raft::LedgerStubProxy>(node_id),
+    std::make_shared<raft::ChannelStubProxy>(),
+    node_id,
+    ms(10),
+    election_timeout,
+    false,
+    true);
+
+  std::unordered_set<raft::NodeId> config = {node_id};
+  r0.add_configuration(0, config);
+
+  r0.periodic(election_timeout * 2);
+  DOCTEST_REQUIRE(r0.is_leader());
+
+  DOCTEST_INFO("Entries are not committed until the ledger reports them");
+  for (size_t i = 1; i <= 3; ++i)
+  {
+    r0.replicate(kv::BatchVector{{i, {1, 2, 3}, true}});
+    DOCTEST_REQUIRE(r0.get_last_idx() == i);
+    DOCTEST_REQUIRE(r0.get_commit_idx() == 0);
+  }
+
+  r0.ledger_durable(2, 0);
+  DOCTEST_REQUIRE(r0.get_commit_idx() == 2);
+
+  DOCTEST_INFO("Stale reports are ignored");
+  r0.ledger_durable(1, 0);
+  DOCTEST_REQUIRE(r0.get_commit_idx() == 2);
+
+  r0.ledger_durable(3, 0);
+  DOCTEST_REQUIRE(r0.get_commit_idx() == 3);
+}
+
 DOCTEST_TEST_CASE(
   "Multiple nodes startup and election" * doctest::test_suite("multiple"))
 {
@@ -231,6 +273,23 @@ static size_t dispatch_all(NodeMap& nodes, Messages& messages)
   return count;
 }
 
+// Install snapshot messages are serialised with the chunk that follows them
+template <class NodeMap>
+static size_t dispatch_all(
+  NodeMap& nodes,
+  std::list<std::pair<raft::NodeId, std::vector<uint8_t>>>& messages)
+{
+  size_t count = 0;
+  while (messages.size())
+  {
+    auto [tgt_node_id, contents] = messages.front();
+    messages.pop_front();
+    nodes[tgt_node_id]->recv_message(contents.data(), contents.size());
+    count++;
+  }
+  return count;
+}
+
 template <class NodeMap, class Messages, class Assertion>
 static size_t dispatch_all_and_DOCTEST_CHECK(
   NodeMap& nodes, Messages& messages, const Assertion& assertion)
@@ -983,4 +1042,818 @@ DOCTEST_TEST_CASE(
     DOCTEST_CHECK(r2.get_commit_idx() == 2);
     DOCTEST_CHECK(r2.get_last_idx() == 3);
   }
-}
\ No newline at end of file
+}
+
+DOCTEST_TEST_CASE(
+  "Append entries acknowledged once durable" *
+  doctest::test_suite("multiple"))
+{
+  auto kv_store0 = std::make_shared<Store>(0);
+  auto kv_store1 = std::make_shared<StoreSig>(1);
+
+  raft::NodeId node_id0(0);
+  raft::NodeId node_id1(1);
+
+  ms request_timeout(10);
+
+  TRaft r0(
+    std::make_unique<Adaptor>(kv_store0),
+    std::make_unique<raft::LedgerStubProxy>(node_id0),
+    std::make_shared<raft::ChannelStubProxy>(),
+    node_id0,
+    request_timeout,
+    ms(20),
+    false,
+    true);
+  TRaft r1(
+    std::make_unique<Adaptor>(kv_store1),
+    std::make_unique<raft::LedgerStubProxy>(node_id1),
+    std::make_shared<raft::ChannelStubProxy>(),
+    node_id1,
+    request_timeout,
+    ms(100),
+    false,
+    true);
+
+  std::unordered_set<raft::NodeId> config = {node_id0, node_id1};
+  r0.add_configuration(0, config);
+  r1.add_configuration(0, config);
+
+  map<raft::NodeId, TRaft*> nodes;
+  nodes[node_id0] = &r0;
+  nodes[node_id1] = &r1;
+
+  r0.periodic(std::chrono::milliseconds(200));
+  DOCTEST_REQUIRE(1 == dispatch_all(nodes, r0.channels->sent_request_vote));
+  DOCTEST_REQUIRE(
+    1 == dispatch_all(nodes, r1.channels->sent_request_vote_response));
+  DOCTEST_REQUIRE(r0.is_leader());
+  DOCTEST_REQUIRE(1 == dispatch_all(nodes, r0.channels->sent_append_entries));
+  DOCTEST_REQUIRE(
+    1 == dispatch_all(nodes, r1.channels->sent_append_entries_response));
+
+  DOCTEST_INFO("A failed replicate on the follower truncates its ledger");
+  std::vector<uint8_t> entry = {1, 2, 3};
+  DOCTEST_REQUIRE_FALSE(r1.replicate(kv::BatchVector{{1, entry, true}}));
+
+  DOCTEST_REQUIRE(r0.replicate(kv::BatchVector{{1, entry, true}}));
+  r0.periodic(request_timeout);
+  DOCTEST_REQUIRE(1 == dispatch_all(nodes, r0.channels->sent_append_entries));
+
+  DOCTEST_INFO("The follower does not acknowledge entries before they are "
+               "durable");
+  DOCTEST_REQUIRE(
+    1 ==
+    dispatch_all_and_DOCTEST_CHECK(
+      nodes, r1.channels->sent_append_entries_response, [](const auto& msg) {
+        DOCTEST_REQUIRE(msg.last_log_idx == 0);
+        DOCTEST_REQUIRE(msg.success);
+      }));
+
+  DOCTEST_INFO("Reports sent before all truncations were applied are stale");
+  // The follower truncated its ledger when it voted, and when it failed to
+  // replicate
+  r1.ledger_durable(1, 0);
+  r1.ledger_durable(1, 1);
+  DOCTEST_REQUIRE(r1.channels->sent_append_entries_response.empty());
+
+  r1.ledger_durable(1, 1);
+  DOCTEST_REQUIRE(
+    1 ==
+    dispatch_all_and_DOCTEST_CHECK(
+      nodes, r1.channels->sent_append_entries_response, [](const auto& msg) {
+        DOCTEST_REQUIRE(msg.last_log_idx == 1);
+        DOCTEST_REQUIRE(msg.success);
+      }));
+
+  DOCTEST_INFO("The leader commits once the entry is durable locally too");
+  DOCTEST_REQUIRE(r0.get_commit_idx() == 0);
+  r0.ledger_durable(1, 0);
+  DOCTEST_REQUIRE(r0.get_commit_idx() == 1);
+
+  DOCTEST_INFO("The follower commits once told by the leader");
+  r0.periodic(request_timeout);
+  DOCTEST_REQUIRE(1 == dispatch_all(nodes, r0.channels->sent_append_entries));
+  DOCTEST_REQUIRE(r1.get_commit_idx() == 1);
+}
+
+DOCTEST_TEST_CASE(
+  "Append entries applied asynchronously" * doctest::test_suite("multiple"))
+{
+  auto kv_store0 = std::make_shared<Store>(0);
+  auto kv_store1 = std::make_shared<StoreSig>(1);
+
+  raft::NodeId node_id0(0);
+  raft::NodeId node_id1(1);
+
+  ms request_timeout(10);
+
+  TRaft r0(
+    std::make_unique<Adaptor>(kv_store0),
+    std::make_unique<raft::LedgerStubProxy>(node_id0),
+    std::make_shared<raft::ChannelStubProxy>(),
+    node_id0,
+    request_timeout,
+    ms(20));
+  TRaft r1(
+    std::make_unique<Adaptor>(kv_store1),
+    std::make_unique<raft::LedgerStubProxy>(node_id1),
+    std::make_shared<raft::ChannelStubProxy>(),
+    node_id1,
+    request_timeout,
+    ms(100));
+
+  size_t scheduled = 0;
+  r1.set_apply_scheduler([&scheduled]() { scheduled++; });
+
+  std::unordered_set<raft::NodeId> config = {node_id0, node_id1};
+  r0.add_configuration(0, config);
+  r1.add_configuration(0, config);
+
+  map<raft::NodeId, TRaft*> nodes;
+  nodes[node_id0] = &r0;
+  nodes[node_id1] = &r1;
+
+  r0.periodic(std::chrono::milliseconds(200));
+  DOCTEST_REQUIRE(1 == dispatch_all(nodes, r0.channels->sent_request_vote));
+  DOCTEST_REQUIRE(
+    1 == dispatch_all(nodes, r1.channels->sent_request_vote_response));
+  DOCTEST_REQUIRE(r0.is_leader());
+  DOCTEST_REQUIRE(1 == dispatch_all(nodes, r0.channels->sent_append_entries));
+  DOCTEST_REQUIRE(
+    1 == dispatch_all(nodes, r1.channels->sent_append_entries_response));
+  DOCTEST_REQUIRE(scheduled == 0);
+
+  DOCTEST_INFO("The follower acknowledges entries before applying them");
+  std::vector<uint8_t> entry = {1, 2, 3};
+  DOCTEST_REQUIRE(
+    r0.replicate(kv::BatchVector{{1, entry, true}, {2, entry, true}}));
+  r0.periodic(request_timeout);
+  DOCTEST_REQUIRE(1 == dispatch_all(nodes, r0.channels->sent_append_entries));
+  DOCTEST_REQUIRE(scheduled == 1);
+  DOCTEST_REQUIRE(
+    1 ==
+    dispatch_all_and_DOCTEST_CHECK(
+      nodes, r1.channels->sent_append_entries_response, [](const auto& msg) {
+        DOCTEST_REQUIRE(msg.last_log_idx == 2);
+        DOCTEST_REQUIRE(msg.success);
+      }));
+  DOCTEST_REQUIRE(r0.get_commit_idx() == 2);
+
+  DOCTEST_INFO("The follower only commits entries once applied");
+  r0.periodic(request_timeout);
+  DOCTEST_REQUIRE(1 == dispatch_all(nodes, r0.channels->sent_append_entries));
+  DOCTEST_REQUIRE(scheduled == 1);
+  DOCTEST_REQUIRE(r1.get_commit_idx() == 0);
+
+  r1.apply_entries();
+  DOCTEST_REQUIRE(r1.get_commit_idx() == 2);
+
+  DOCTEST_INFO("Applying is scheduled again for later entries");
+  DOCTEST_REQUIRE(r0.replicate(kv::BatchVector{{3, entry, true}}));
+  r0.periodic(request_timeout);
+  DOCTEST_REQUIRE(1 == dispatch_all(nodes, r0.channels->sent_append_entries));
+  DOCTEST_REQUIRE(scheduled == 2);
+}
+
+DOCTEST_TEST_CASE(
+  "Append entries pipelined within window" * doctest::test_suite("multiple"))
+{
+  auto kv_store0 = std::make_shared<Store>(0);
+  auto kv_store1 = std::make_shared<Store>(1);
+
+  raft::NodeId node_id0(0);
+  raft::NodeId node_id1(1);
+
+  ms request_timeout(10);
+  size_t max_inflight_batches = 3;
+
+  TRaft r0(
+    std::make_unique<Adaptor>(kv_store0),
+    std::make_unique<raft::LedgerStubProxy>(node_id0),
+    std::make_shared<raft::ChannelStubProxy>(),
+    node_id0,
+    request_timeout,
+    ms(20),
+    false,
+    false,
+    max_inflight_batches);
+  TRaft r1(
+    std::make_unique<Adaptor>(kv_store1),
+    std::make_unique<raft::LedgerStubProxy>(node_id1),
+    std::make_shared<raft::ChannelStubProxy>(),
+    node_id1,
+    request_timeout,
+    ms(100));
+
+  std::unordered_set<raft::NodeId> config = {node_id0, node_id1};
+  r0.add_configuration(0, config);
+  r1.add_configuration(0, config);
+
+  map<raft::NodeId, TRaft*> nodes;
+  nodes[node_id0] = &r0;
+  nodes[node_id1] = &r1;
+
+  r0.periodic(std::chrono::milliseconds(200));
+  DOCTEST_REQUIRE(1 == dispatch_all(nodes, r0.channels->sent_request_vote));
+  DOCTEST_REQUIRE(
+    1 == dispatch_all(nodes, r1.channels->sent_request_vote_response));
+  DOCTEST_REQUIRE(r0.is_leader());
+  DOCTEST_REQUIRE(1 == dispatch_all(nodes, r0.channels->sent_append_entries));
+  DOCTEST_REQUIRE(
+    1 == dispatch_all(nodes, r1.channels->sent_append_entries_response));
+
+  std::vector<uint8_t> entry = {1, 2, 3};
+  raft::Index last_idx = 0;
+  auto replicate = [&](size_t count) {
+    for (size_t i = 0; i < count; ++i)
+    {
+      ++last_idx;
+      DOCTEST_REQUIRE(r0.replicate(kv::BatchVector{{last_idx, entry, true}}));
+    }
+  };
+
+  DOCTEST_INFO("The leader only sends a window of batches at once");
+  replicate(1000);
+  r0.periodic(request_timeout);
+  DOCTEST_REQUIRE(
+    r0.channels->sent_append_entries.size() == max_inflight_batches);
+  DOCTEST_REQUIRE(r0.channels->sent_append_entries.back().second.idx < 1000);
+
+  DOCTEST_INFO("Acknowledgements are answered with the next batches");
+  while (r1.get_last_idx() < last_idx)
+  {
+    DOCTEST_REQUIRE(!r0.channels->sent_append_entries.empty());
+    DOCTEST_REQUIRE(
+      r0.channels->sent_append_entries.size() <= max_inflight_batches);
+    dispatch_all(nodes, r0.channels->sent_append_entries);
+    dispatch_all(nodes, r1.channels->sent_append_entries_response);
+  }
+  DOCTEST_REQUIRE(r0.get_commit_idx() == last_idx);
+  DOCTEST_REQUIRE(r0.channels->sent_append_entries.empty());
+
+  DOCTEST_INFO("When the window is full, only a heartbeat is sent");
+  replicate(1000);
+  r0.periodic(request_timeout);
+  DOCTEST_REQUIRE(
+    r0.channels->sent_append_entries.size() == max_inflight_batches);
+  auto sent_idx = r0.channels->sent_append_entries.back().second.idx;
+  auto in_flight = r0.channels->sent_append_entries;
+  r0.channels->sent_append_entries.clear();
+
+  r0.periodic(request_timeout);
+  DOCTEST_REQUIRE(r0.channels->sent_append_entries.size() == 1);
+  auto heartbeat = r0.channels->sent_append_entries.front().second;
+  DOCTEST_REQUIRE(heartbeat.idx == sent_idx);
+  DOCTEST_REQUIRE(heartbeat.prev_idx == sent_idx);
+  r0.channels->sent_append_entries.clear();
+
+  DOCTEST_INFO("Batches rejected after a lost batch are retransmitted once");
+  in_flight.pop_front();
+  r0.channels->sent_append_entries = in_flight;
+  DOCTEST_REQUIRE(2 == dispatch_all(nodes, r0.channels->sent_append_entries));
+  DOCTEST_REQUIRE(
+    2 ==
+    dispatch_all_and_DOCTEST_CHECK(
+      nodes, r1.channels->sent_append_entries_response, [](const auto& msg) {
+        DOCTEST_REQUIRE(msg.last_log_idx == 1000);
+        DOCTEST_REQUIRE(!msg.success);
+      }));
+  DOCTEST_REQUIRE(
+    r0.channels->sent_append_entries.size() == max_inflight_batches);
+  DOCTEST_REQUIRE(
+    r0.channels->sent_append_entries.front().second.prev_idx == 1000);
+
+  while (r1.get_last_idx() < last_idx)
+  {
+    dispatch_all(nodes, r0.channels->sent_append_entries);
+    dispatch_all(nodes, r1.channels->sent_append_entries_response);
+  }
+  DOCTEST_REQUIRE(r0.get_commit_idx() == last_idx);
+}
+
+DOCTEST_TEST_CASE("Adaptive batching")
+{
+  using BC = raft::BatchController;
+  BC batching(1000, ms(50), ms(100));
+
+  DOCTEST_INFO("Until replication is observed, only size limits");
+  for (size_t i = 0; i < 9; ++i)
+  {
+    DOCTEST_REQUIRE(batching.add_entry(100) == BC::NoFlush);
+  }
+  DOCTEST_REQUIRE(batching.tick(ms(10), false) == BC::NoFlush);
+  DOCTEST_REQUIRE(batching.add_entry(100) == BC::SizeLimit);
+  batching.flushed(BC::SizeLimit);
+  DOCTEST_REQUIRE(batching.get_batch_size() == 0);
+  DOCTEST_REQUIRE(batching.tick(ms(100), true) == BC::RequestTimeout);
+  batching.flushed(BC::RequestTimeout);
+
+  DOCTEST_INFO("Entries are held back for the latency left within target");
+  batching.add_replication_latency(ms(10));
+  DOCTEST_REQUIRE(batching.get_batch_size() == 0);
+  DOCTEST_REQUIRE(batching.tick(ms(0), false) == BC::NoFlush);
+  DOCTEST_REQUIRE(batching.get_replication_latency_p99() == ms(10));
+  DOCTEST_REQUIRE(batching.get_flush_delay() == ms(40));
+
+  DOCTEST_INFO("Batches hold the entries expected within that delay");
+  // Settle the arrival rate on 1 entry per millisecond
+  for (size_t t = 0; t < 100; ++t)
+  {
+    batching.add_entry(1);
+    batching.tick(ms(1), false);
+    batching.flushed(BC::NoFlush);
+  }
+  DOCTEST_REQUIRE(batching.get_batch_size() == 40);
+
+  for (size_t i = 1; i < 40; ++i)
+  {
+    DOCTEST_REQUIRE(batching.add_entry(1) == BC::NoFlush);
+  }
+  DOCTEST_REQUIRE(batching.add_entry(1) == BC::BatchFull);
+  batching.flushed(BC::BatchFull);
+
+  DOCTEST_INFO("Entries are sent once the delay elapses, however few");
+  batching.add_entry(1);
+  DOCTEST_REQUIRE(batching.tick(ms(20), false) == BC::NoFlush);
+  DOCTEST_REQUIRE(batching.tick(ms(20), false) == BC::DelayElapsed);
+  batching.flushed(BC::DelayElapsed);
+  DOCTEST_REQUIRE(batching.get_last_flush_reason() == BC::DelayElapsed);
+
+  DOCTEST_INFO("Slow replication falls back to size limits");
+  for (size_t i = 0; i < 10; ++i)
+  {
+    batching.add_replication_latency(ms(80));
+  }
+  DOCTEST_REQUIRE(batching.tick(ms(1), false) == BC::NoFlush);
+  DOCTEST_REQUIRE(batching.get_replication_latency_p99() == ms(80));
+  DOCTEST_REQUIRE(batching.get_flush_delay() == ms(0));
+  DOCTEST_REQUIRE(batching.get_batch_size() == 0);
+  for (size_t i = 0; i < 9; ++i)
+  {
+    DOCTEST_REQUIRE(batching.add_entry(100) == BC::NoFlush);
+  }
+  DOCTEST_REQUIRE(batching.tick(ms(100), false) == BC::NoFlush);
+  DOCTEST_REQUIRE(batching.add_entry(100) == BC::SizeLimit);
+  batching.flushed(BC::SizeLimit);
+}
+
+DOCTEST_TEST_CASE(
+  "Adaptive batching with a slow follower" * doctest::test_suite("multiple"))
+{
+  auto kv_store0 = std::make_shared<Store>(0);
+  auto kv_store1 = std::make_shared<Store>(1);
+  auto kv_store2 = std::make_shared<Store>(2);
+
+  raft::NodeId node_id0(0);
+  raft::NodeId node_id1(1);
+  raft::NodeId node_id2(2);
+
+  ms request_timeout(10);
+  ms target_latency(50);
+
+  TRaft r0(
+    std::make_unique<Adaptor>(kv_store0),
+    std::make_unique<raft::LedgerStubProxy>(node_id0),
+    std::make_shared<raft::ChannelStubProxy>(),
+    node_id0,
+    request_timeout,
+    ms(20),
+    false,
+    false,
+    std::numeric_limits<size_t>::max(),
+    std::numeric_limits<size_t>::max(),
+    target_latency);
+  TRaft r1(
+    std::make_unique<Adaptor>(kv_store1),
+    std::make_unique<raft::LedgerStubProxy>(node_id1),
+    std::make_shared<raft::ChannelStubProxy>(),
+    node_id1,
+    request_timeout,
+    ms(100));
+  TRaft r2(
+    std::make_unique<Adaptor>(kv_store2),
+    std::make_unique<raft::LedgerStubProxy>(node_id2),
+    std::make_shared<raft::ChannelStubProxy>(),
+    node_id2,
+    request_timeout,
+    ms(100));
+
+  std::unordered_set<raft::NodeId> config = {node_id0, node_id1, node_id2};
+  r0.add_configuration(0, config);
+  r1.add_configuration(0, config);
+  r2.add_configuration(0, config);
+
+  map<raft::NodeId, TRaft*> nodes;
+  nodes[node_id0] = &r0;
+  nodes[node_id1] = &r1;
+  nodes[node_id2] = &r2;
+
+  r0.periodic(std::chrono::milliseconds(200));
+  DOCTEST_REQUIRE(2 == dispatch_all(nodes, r0.channels->sent_request_vote));
+  dispatch_all(nodes, r1.channels->sent_request_vote_response);
+  dispatch_all(nodes, r2.channels->sent_request_vote_response);
+  DOCTEST_REQUIRE(r0.is_leader());
+  DOCTEST_REQUIRE(2 == dispatch_all(nodes, r0.channels->sent_append_entries));
+  dispatch_all(nodes, r1.channels->sent_append_entries_response);
+  dispatch_all(nodes, r2.channels->sent_append_entries_response);
+
+  std::vector<uint8_t> entry = {1, 2, 3};
+  raft::Index last_idx = 0;
+  auto replicate = [&](size_t count) {
+    for (size_t i = 0; i < count; ++i)
+    {
+      ++last_idx;
+      DOCTEST_REQUIRE(r0.replicate(kv::BatchVector{{last_idx, entry, true}}));
+    }
+  };
+
+  // Append entries to the slow follower are held back, and only delivered
+  // long after the target latency
+  std::list<std::pair<raft::NodeId, raft::AppendEntries>> slow_append_entries;
+  auto hold_slow = [&]() {
+    auto& sent = r0.channels->sent_append_entries;
+    for (auto it = sent.begin(); it != sent.end();)
+    {
+      if (it->first == node_id2)
+      {
+        slow_append_entries.push_back(*it);
+        it = sent.erase(it);
+      }
+      else
+      {
+        ++it;
+      }
+    }
+  };
+
+  DOCTEST_INFO("The majority is replicated to within the target");
+  for (size_t round = 0; round < 20; ++round)
+  {
+    replicate(10);
+    r0.periodic(request_timeout);
+    hold_slow();
+    dispatch_all(nodes, r0.channels->sent_append_entries);
+    dispatch_all(nodes, r1.channels->sent_append_entries_response);
+  }
+  DOCTEST_REQUIRE(r0.get_commit_idx() == last_idx);
+
+  r0.periodic(target_latency * 2);
+  hold_slow();
+  dispatch_all(nodes, r0.channels->sent_append_entries);
+  dispatch_all(nodes, r1.channels->sent_append_entries_response);
+  dispatch_all(nodes, slow_append_entries);
+  dispatch_all(nodes, r2.channels->sent_append_entries_response);
+  DOCTEST_REQUIRE(r2.get_last_idx() == last_idx);
+
+  DOCTEST_INFO("Acknowledgements from the slow follower do not stop batching");
+  r0.periodic(request_timeout);
+  auto metrics = r0.get_replication_metrics();
+  DOCTEST_REQUIRE(metrics.replication_latency_p99_ms < target_latency.count());
+  DOCTEST_REQUIRE(metrics.batch_size > 1);
+  r0.channels->sent_append_entries.clear();
+  replicate(metrics.batch_size - 1);
+  DOCTEST_REQUIRE(r0.channels->sent_append_entries.empty());
+  replicate(1);
+  DOCTEST_REQUIRE(r0.channels->sent_append_entries.size() == 2);
+}
+
+DOCTEST_TEST_CASE("Leader lease" * doctest::test_suite("multiple"))
+{
+  auto kv_store0 = std::make_shared<Store>(0);
+  auto kv_store1 = std::make_shared<Store>(1);
+
+  raft::NodeId node_id0(0);
+  raft::NodeId node_id1(1);
+
+  ms request_timeout(10);
+  ms clock_drift(5);
+
+  TRaft r0(
+    std::make_unique<Adaptor>(kv_store0),
+    std::make_unique<raft::LedgerStubProxy>(node_id0),
+    std::make_shared<raft::ChannelStubProxy>(),
+    node_id0,
+    request_timeout,
+    ms(20),
+    false,
+    false,
+    std::numeric_limits<size_t>::max(),
+    std::numeric_limits<size_t>::max(),
+    ms(0),
+    true,
+    clock_drift);
+  TRaft r1(
+    std::make_unique<Adaptor>(kv_store1),
+    std::make_unique<raft::LedgerStubProxy>(node_id1),
+    std::make_shared<raft::ChannelStubProxy>(),
+    node_id1,
+    request_timeout,
+    ms(100),
+    false,
+    false,
+    std::numeric_limits<size_t>::max(),
+    std::numeric_limits<size_t>::max(),
+    ms(0),
+    true,
+    clock_drift);
+
+  std::unordered_set<raft::NodeId> config = {node_id0, node_id1};
+  r0.add_configuration(0, config);
+  r1.add_configuration(0, config);
+
+  map<raft::NodeId, TRaft*> nodes;
+  nodes[node_id0] = &r0;
+  nodes[node_id1] = &r1;
+
+  r0.periodic(std::chrono::milliseconds(200));
+  DOCTEST_REQUIRE(1 == dispatch_all(nodes, r0.channels->sent_request_vote));
+  DOCTEST_REQUIRE(
+    1 == dispatch_all(nodes, r1.channels->sent_request_vote_response));
+  DOCTEST_REQUIRE(r0.is_leader());
+  DOCTEST_REQUIRE(1 == dispatch_all(nodes, r0.channels->sent_append_entries));
+  DOCTEST_REQUIRE(
+    1 == dispatch_all(nodes, r1.channels->sent_append_entries_response));
+
+  DOCTEST_INFO("A new leader holds no lease until it commits in its term");
+  DOCTEST_REQUIRE_FALSE(r0.has_lease());
+
+  std::vector<uint8_t> entry = {1, 2, 3};
+  DOCTEST_REQUIRE(r0.replicate(kv::BatchVector{{1, entry, true}}));
+  r0.periodic(request_timeout);
+  DOCTEST_REQUIRE(1 == dispatch_all(nodes, r0.channels->sent_append_entries));
+  DOCTEST_REQUIRE(
+    1 == dispatch_all(nodes, r1.channels->sent_append_entries_response));
+  DOCTEST_REQUIRE(r0.get_commit_idx() == 1);
+  DOCTEST_REQUIRE(r0.has_lease());
+
+  DOCTEST_INFO("The lease lapses unless a majority acknowledges the leader");
+  // The lease lasts for the election timeout less the clock drift, from when
+  // the acknowledged append entries was sent
+  r0.periodic(request_timeout);
+  DOCTEST_REQUIRE(r0.has_lease());
+  r0.periodic(ms(20) - request_timeout - clock_drift);
+  DOCTEST_REQUIRE_FALSE(r0.has_lease());
+
+  DOCTEST_INFO("The lease is renewed by acknowledged heartbeats");
+  DOCTEST_REQUIRE(1 == dispatch_all(nodes, r0.channels->sent_append_entries));
+  DOCTEST_REQUIRE(
+    1 == dispatch_all(nodes, r1.channels->sent_append_entries_response));
+  DOCTEST_REQUIRE(r0.has_lease());
+
+  DOCTEST_INFO("Followers do not vote while they hear from the leader");
+  raft::RequestVote rv = {
+    raft::raft_request_vote, node_id0, r1.get_term() + 1, 1, r1.get_term()};
+  r1.recv_message(reinterpret_cast<uint8_t*>(&rv), sizeof(rv));
+  DOCTEST_REQUIRE(r1.channels->sent_request_vote_response.size() == 1);
+  DOCTEST_REQUIRE_FALSE(
+    r1.channels->sent_request_vote_response.front().second.vote_granted);
+  DOCTEST_REQUIRE(r1.get_term() == rv.term - 1);
+}
+
+DOCTEST_TEST_CASE("Install snapshot" * doctest::test_suite("multiple"))
+{
+  auto kv_store0 = std::make_shared<Store>(0);
+  auto kv_store1 = std::make_shared<Store>(1);
+  auto kv_store2 = std::make_shared<Store>(2);
+
+  raft::NodeId node_id0(0);
+  raft::NodeId node_id1(1);
+  raft::NodeId node_id2(2);
+
+  ms request_timeout(10);
+  raft::Index snapshot_min_lag(3);
+
+  auto make_raft = [&](
+                     std::shared_ptr<Store> kv_store,
+                     raft::NodeId node_id,
+                     ms election_timeout) {
+    return std::make_unique<TRaft>(
+      std::make_unique<Adaptor>(kv_store),
+      std::make_unique<raft::LedgerStubProxy>(node_id),
+      std::make_shared<raft::ChannelStubProxy>(),
+      node_id,
+      request_timeout,
+      election_timeout,
+      false,
+      false,
+      std::numeric_limits<size_t>::max(),
+      std::numeric_limits<size_t>::max(),
+      ms(0),
+      false,
+      ms(0),
+      snapshot_min_lag);
+  };
+
+  auto r0 = make_raft(kv_store0, node_id0, ms(20));
+  auto r1 = make_raft(kv_store1, node_id1, ms(100));
+  auto r2 = make_raft(kv_store2, node_id2, ms(100));
+
+  std::unordered_set<raft::NodeId> config0 = {node_id0, node_id1};
+  r0->add_configuration(0, config0);
+  r1->add_configuration(0, config0);
+
+  map<raft::NodeId, TRaft*> nodes;
+  nodes[node_id0] = r0.get();
+  nodes[node_id1] = r1.get();
+  nodes[node_id2] = r2.get();
+
+  r0->periodic(std::chrono::milliseconds(200));
+  DOCTEST_REQUIRE(1 == dispatch_all(nodes, r0->channels->sent_request_vote));
+  DOCTEST_REQUIRE(
+    1 == dispatch_all(nodes, r1->channels->sent_request_vote_response));
+  DOCTEST_REQUIRE(r0->is_leader());
+  DOCTEST_REQUIRE(1 == dispatch_all(nodes, r0->channels->sent_append_entries));
+  DOCTEST_REQUIRE(
+    1 == dispatch_all(nodes, r1->channels->sent_append_entries_response));
+
+  std::vector<uint8_t> entry = {1, 2, 3};
+  DOCTEST_REQUIRE(r0->replicate(kv::BatchVector{
+    {1, entry, true}, {2, entry, true}, {3, entry, true}, {4, entry, true}}));
+  r0->periodic(request_timeout);
+  DOCTEST_REQUIRE(1 == dispatch_all(nodes, r0->channels->sent_append_entries));
+  DOCTEST_REQUIRE(
+    1 == dispatch_all(nodes, r1->channels->sent_append_entries_response));
+  DOCTEST_REQUIRE(r0->get_commit_idx() == 4);
+
+  DOCTEST_INFO("A node added far behind the commit index is sent a snapshot");
+  const auto chunk_size = TRaft::install_snapshot_chunk_size;
+  kv_store0->snapshot_data = std::vector<uint8_t>(2 * chunk_size + 10, 42);
+
+  std::unordered_set<raft::NodeId> config1 = {node_id0, node_id1, node_id2};
+  r0->add_configuration(4, config1);
+  r2->add_configuration(0, config1);
+  DOCTEST_REQUIRE(1 == dispatch_all(nodes, r0->channels->sent_append_entries));
+  DOCTEST_REQUIRE(
+    1 ==
+    dispatch_all_and_DOCTEST_CHECK(
+      nodes, r2->channels->sent_append_entries_response, [](const auto& msg) {
+        DOCTEST_REQUIRE(msg.last_log_idx == 0);
+        DOCTEST_REQUIRE(!msg.success);
+      }));
+  DOCTEST_REQUIRE(r0->channels->sent_append_entries.empty());
+
+  DOCTEST_INFO("Chunks are sent one at a time");
+  DOCTEST_REQUIRE(
+    1 == dispatch_all(nodes, r0->channels->sent_install_snapshot));
+  DOCTEST_REQUIRE(r2->channels->sent_install_snapshot_response.size() == 1);
+  auto isr = r2->channels->sent_install_snapshot_response.front().second;
+  DOCTEST_REQUIRE(isr.idx == 4);
+  DOCTEST_REQUIRE(isr.received == chunk_size);
+  DOCTEST_REQUIRE(
+    1 == dispatch_all(nodes, r2->channels->sent_install_snapshot_response));
+  DOCTEST_REQUIRE(r0->channels->sent_install_snapshot.size() == 1);
+  DOCTEST_REQUIRE(!kv_store2->installed_snapshot.has_value());
+
+  DOCTEST_INFO("A lost chunk is sent again on request timeout");
+  r0->channels->sent_install_snapshot.clear();
+  r0->periodic(request_timeout);
+  DOCTEST_REQUIRE(r0->channels->sent_install_snapshot.size() == 1);
+  DOCTEST_REQUIRE(1 == dispatch_all(nodes, r0->channels->sent_append_entries));
+  DOCTEST_REQUIRE(
+    1 == dispatch_all(nodes, r1->channels->sent_append_entries_response));
+  DOCTEST_REQUIRE(
+    1 == dispatch_all(nodes, r0->channels->sent_install_snapshot));
+  DOCTEST_REQUIRE(
+    r2->channels->sent_install_snapshot_response.front().second.received ==
+    2 * chunk_size);
+  DOCTEST_REQUIRE(
+    1 == dispatch_all(nodes, r2->channels->sent_install_snapshot_response));
+
+  DOCTEST_INFO("The snapshot is installed once the last chunk is received");
+  DOCTEST_REQUIRE(
+    1 == dispatch_all(nodes, r0->channels->sent_install_snapshot));
+  DOCTEST_REQUIRE(kv_store2->installed_snapshot == kv_store0->snapshot_data);
+  DOCTEST_REQUIRE(r2->get_commit_idx() == 4);
+  DOCTEST_REQUIRE(r2->get_last_idx() == 4);
+  DOCTEST_REQUIRE(r2->get_term(4) == r0->get_term(4));
+
+  DOCTEST_INFO("The node is then sent the entries after the snapshot");
+  DOCTEST_REQUIRE(
+    1 == dispatch_all(nodes, r2->channels->sent_install_snapshot_response));
+  DOCTEST_REQUIRE(r0->channels->sent_install_snapshot.empty());
+  DOCTEST_REQUIRE(r0->replicate(kv::BatchVector{{5, entry, true}}));
+  r0->periodic(request_timeout);
+  DOCTEST_REQUIRE(3 == dispatch_all(nodes, r0->channels->sent_append_entries));
+  DOCTEST_REQUIRE(
+    1 == dispatch_all(nodes, r1->channels->sent_append_entries_response));
+  DOCTEST_REQUIRE(
+    2 ==
+    dispatch_all_and_DOCTEST_CHECK(
+      nodes, r2->channels->sent_append_entries_response, [](const auto& msg) {
+        DOCTEST_REQUIRE(msg.success);
+      }));
+  DOCTEST_REQUIRE(r2->get_last_idx() == 5);
+  DOCTEST_REQUIRE(r2->ledger->ledger.size() == 5);
+  DOCTEST_REQUIRE(r0->get_commit_idx() == 5);
+  DOCTEST_REQUIRE(r0->channels->sent_install_snapshot.empty());
+}
+
+DOCTEST_TEST_CASE(
+  "Install snapshot serialised asynchronously" *
+  doctest::test_suite("multiple"))
+{
+  auto kv_store0 = std::make_shared<Store>(0);
+  auto kv_store1 = std::make_shared<Store>(1);
+  auto kv_store2 = std::make_shared<Store>(2);
+
+  raft::NodeId node_id0(0);
+  raft::NodeId node_id1(1);
+  raft::NodeId node_id2(2);
+
+  ms request_timeout(10);
+  raft::Index snapshot_min_lag(3);
+
+  auto make_raft = [&](
+                     std::shared_ptr<Store> kv_store,
+                     raft::NodeId node_id,
+                     ms election_timeout) {
+    return std::make_unique<TRaft>(
+      std::make_unique<Adaptor>(kv_store),
+      std::make_unique<raft::LedgerStubProxy>(node_id),
+      std::make_shared<raft::ChannelStubProxy>(),
+      node_id,
+      request_timeout,
+      election_timeout,
+      false,
+      false,
+      std::numeric_limits<size_t>::max(),
+      std::numeric_limits<size_t>::max(),
+      ms(0),
+      false,
+      ms(0),
+      snapshot_min_lag);
+  };
+
+  auto r0 = make_raft(kv_store0, node_id0, ms(20));
+  auto r1 = make_raft(kv_store1, node_id1, ms(100));
+  auto r2 = make_raft(kv_store2, node_id2, ms(100));
+
+  std::unordered_set<raft::NodeId> config0 = {node_id0, node_id1};
+  r0->add_configuration(0, config0);
+  r1->add_configuration(0, config0);
+
+  map<raft::NodeId, TRaft*> nodes;
+  nodes[node_id0] = r0.get();
+  nodes[node_id1] = r1.get();
+  nodes[node_id2] = r2.get();
+
+  r0->periodic(std::chrono::milliseconds(200));
+  DOCTEST_REQUIRE(1 == dispatch_all(nodes, r0->channels->sent_request_vote));
+  DOCTEST_REQUIRE(
+    1 == dispatch_all(nodes, r1->channels->sent_request_vote_response));
+  DOCTEST_REQUIRE(r0->is_leader());
+  DOCTEST_REQUIRE(1 == dispatch_all(nodes, r0->channels->sent_append_entries));
+  DOCTEST_REQUIRE(
+    1 == dispatch_all(nodes, r1->channels->sent_append_entries_response));
+
+  std::vector<uint8_t> entry = {1, 2, 3};
+  DOCTEST_REQUIRE(r0->replicate(kv::BatchVector{
+    {1, entry, true}, {2, entry, true}, {3, entry, true}, {4, entry, true}}));
+  r0->periodic(request_timeout);
+  DOCTEST_REQUIRE(1 == dispatch_all(nodes, r0->channels->sent_append_entries));
+  DOCTEST_REQUIRE(
+    1 == dispatch_all(nodes, r1->channels->sent_append_entries_response));
+  DOCTEST_REQUIRE(r0->get_commit_idx() == 4);
+
+  size_t scheduled = 0;
+  r0->set_snapshot_scheduler([&scheduled]() { scheduled++; });
+
+  DOCTEST_INFO("Only the state is captured when a node needs a snapshot");
+  const auto captured = std::vector<uint8_t>(10, 42);
+  kv_store0->snapshot_data = captured;
+
+  std::unordered_set<raft::NodeId> config1 = {node_id0, node_id1, node_id2};
+  r0->add_configuration(4, config1);
+  r2->add_configuration(0, config1);
+  DOCTEST_REQUIRE(1 == dispatch_all(nodes, r0->channels->sent_append_entries));
+  DOCTEST_REQUIRE(
+    1 == dispatch_all(nodes, r2->channels->sent_append_entries_response));
+  DOCTEST_REQUIRE(scheduled == 1);
+  DOCTEST_REQUIRE(r0->channels->sent_install_snapshot.empty());
+
+  DOCTEST_INFO("The node is sent heartbeats until the snapshot is serialised");
+  DOCTEST_REQUIRE(r0->channels->sent_append_entries.size() == 1);
+  r0->channels->sent_append_entries.clear();
+  r0->periodic(request_timeout);
+  DOCTEST_REQUIRE(scheduled == 1);
+  DOCTEST_REQUIRE(r0->channels->sent_install_snapshot.empty());
+  DOCTEST_REQUIRE(2 == dispatch_all(nodes, r0->channels->sent_append_entries));
+  r1->channels->sent_append_entries_response.clear();
+  r2->channels->sent_append_entries_response.clear();
+
+  DOCTEST_INFO("The snapshot is sent once serialised, as it was captured");
+  kv_store0->snapshot_data = {};
+  r0->serialise_snapshot();
+  DOCTEST_REQUIRE(
+    1 == dispatch_all(nodes, r0->channels->sent_install_snapshot));
+  DOCTEST_REQUIRE(kv_store2->installed_snapshot == captured);
+  DOCTEST_REQUIRE(r2->get_commit_idx() == 4);
+  DOCTEST_REQUIRE(
+    1 == dispatch_all(nodes, r2->channels->sent_install_snapshot_response));
+  DOCTEST_REQUIRE(r0->channels->sent_install_snapshot.empty());
+
+  DOCTEST_INFO("Nothing is serialised once no snapshot is pending");
+  r0->serialise_snapshot();
+  DOCTEST_REQUIRE(r0->channels->sent_install_snapshot.empty());
+}
@@ -0,0 +1,153 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the Apache 2.0 License.
+#define PICOBENCH_IMPLEMENT_WITH_MAIN
+#include "consensus/raft/raft.h"
+#include "ds/logger.h"
+#include "logging_stub.h"
+
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <map>
+#include <picobench/picobench.hpp>
+
+using ms = std::chrono::milliseconds;
+using TRaft = raft::Raft<raft::LedgerStubProxy, raft::ChannelStubProxy>;
+using Store = raft::LoggingStubStore;
+using Adaptor = raft::Adaptor<Store, kv::DeserialiseSuccess>;
+
+// Delivers the messages sent by the stub channels of each node after a fixed
+// simulated one-way latency, in the order they were sent
+class SimulatedNetwork
+{
+private:
+  struct Delivery
+  {
+    size_t due;
+    std::function<void()> deliver;
+  };
+
+  std::map<raft::NodeId, std::shared_ptr<TRaft>>& nodes;
+  std::deque<Delivery> in_flight;
+  size_t latency;
+
+  template <class Messages>
+  void collect(Messages& messages, size_t now)
+  {
+    while (!messages.empty())
+    {
+      auto [to, contents] = messages.front();
+      messages.pop_front();
+
+      auto target = nodes.at(to);
+      in_flight.push_back({now + latency, [target, contents]() mutable {
+                             target->recv_message(
+                               reinterpret_cast<uint8_t*>(&contents),
+                               sizeof(contents));
+                           }});
+    }
+  }
+
+public:
+  SimulatedNetwork(
+    std::map<raft::NodeId, std::shared_ptr<TRaft>>& nodes_, size_t latency_) :
+    nodes(nodes_),
+    latency(latency_)
+  {}
+
+  void tick(size_t now)
+  {
+    for (auto& [id, node] : nodes)
+    {
+      collect(node->channels->sent_request_vote, now);
+      collect(node->channels->sent_request_vote_response, now);
+      collect(node->channels->sent_append_entries, now);
+      collect(node->channels->sent_append_entries_response, now);
+    }
+
+    while (!in_flight.empty() && in_flight.front().due <= now)
+    {
+      auto deliver = std::move(in_flight.front().deliver);
+      in_flight.pop_front();
+      deliver();
+    }
+  }
+};
+
+// Replicates s.iterations() entries, 10 per simulated millisecond, from a
+// leader to two followers. The result is the simulated time in milliseconds
+// until all entries are committed.
+template <size_t latency, size_t max_inflight_batches>
+static void benchmark_replicate(picobench::state& s)
+{
+  logger::config::level() = logger::FATAL;
+
+  const size_t entries_per_ms = 10;
+  const std::vector<uint8_t> entry(256, 42);
+
+  std::unordered_set<raft::NodeId> config;
+  std::vector<std::shared_ptr<Store>> stores;
+  std::map<raft::NodeId, std::shared_ptr<TRaft>> nodes;
+  for (raft::NodeId id = 0; id < 3; ++id)
+  {
+    stores.push_back(std::make_shared<Store>(id));
+    nodes[id] = std::make_shared<TRaft>(
+      std::make_unique<Adaptor>(stores.back()),
+      std::make_unique<raft::LedgerStubProxy>(id),
+      std::make_shared<raft::ChannelStubProxy>(),
+      id,
+      ms(10),
+      ms(1000 * 1000),
+      false,
+      false,
+      max_inflight_batches);
+    config.insert(id);
+  }
+
+  for (auto& [id, node] : nodes)
+    node->add_configuration(0, config);
+
+  auto& leader = nodes.at(0);
+  leader->force_become_leader();
+
+  SimulatedNetwork network(nodes, latency);
+  const raft::Index total = s.iterations();
+  raft::Index idx = 0;
+  size_t now = 0;
+
+  s.start_timer();
+  while (leader->get_commit_idx() < total)
+  {
+    for (size_t i = 0; i < entries_per_ms && idx < total; ++i)
+    {
+      ++idx;
+      leader->replicate(kv::BatchVector{{idx, entry, true}});
+    }
+
+    for (auto& [id, node] : nodes)
+      node->periodic(ms(1));
+
+    network.tick(++now);
+  }
+  s.stop_timer();
+
+  s.set_result(now);
+}
+
+const std::vector<int> iterations = {1 << 12, 1 << 15};
+
+PICOBENCH_SUITE("replicate 1ms latency");
+auto bench_1ms_window_1 = benchmark_replicate<1, 1>;
+PICOBENCH(bench_1ms_window_1).iterations(iterations).samples(1).baseline();
+auto bench_1ms_window_8 = benchmark_replicate<1, 8>;
+PICOBENCH(bench_1ms_window_8).iterations(iterations).samples(1);
+auto bench_1ms_window_64 = benchmark_replicate<1, 64>;
+PICOBENCH(bench_1ms_window_64).iterations(iterations).samples(1);
+
+PICOBENCH_SUITE("replicate 50ms latency");
+auto bench_50ms_window_1 = benchmark_replicate<50, 1>;
+PICOBENCH(bench_50ms_window_1).iterations(iterations).samples(1).baseline();
+auto bench_50ms_window_8 = benchmark_replicate<50, 8>;
+PICOBENCH(bench_50ms_window_8).iterations(iterations).samples(1);
+auto bench_50ms_window_64 = benchmark_replicate<50, 64>;
+PICOBENCH(bench_50ms_window_64).iterations(iterations).samples(1);
@@ -0,0 +1,175 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the Apache 2.0 License.
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+namespace ds
+{
+  /** Bump allocator for short-lived objects that are all released at once.
+   *
+   * Allocations are carved out of fixed-size blocks and are never freed
+   * individually. reset() makes all of the arena's memory available again,
+   * but keeps its blocks, so that an arena that is reused for similar work
+   * eventually stops allocating. Requests that do not fit in a block are
+   * served by dedicated allocations, which are freed on reset().
+   */
+  class Arena
+  {
+  public:
+    static constexpr size_t block_size = 16 * 1024;
+    // Blocks beyond this are freed on reset(), so that one large transaction
+    // does not pin memory for the lifetime of the arena
+    static constexpr size_t max_kept_blocks = 16;
+
+  private:
+    std::vector<std::unique_ptr<uint8_t[]>> blocks;
+    std::vector<std::unique_ptr<uint8_t[]>> large;
+    size_t current = 0;
+    size_t offset = 0;
+
+    static uintptr_t align_up(uintptr_t p, size_t align)
+    {
+      return (p + align - 1) & ~(uintptr_t(align) - 1);
+    }
+
+  public:
+    Arena() = default;
+    Arena(const Arena& that) = delete;
+
+    void* allocate(size_t size, size_t align)
+    {
+      if (size + align > block_size)
+      {
+        large.emplace_back(new uint8_t[size + align]);
+        return reinterpret_cast<void*>(
+          align_up(reinterpret_cast<uintptr_t>(large.back().get()), align));
+      }
+
+      while (true)
+      {
+        if (current == blocks.size())
+        {
+          blocks.emplace_back(new uint8_t[block_size]);
+          offset = 0;
+        }
+
+        auto base = reinterpret_cast<uintptr_t>(blocks[current].get());
+        auto start = align_up(base + offset, align);
+        if (start + size <= base + block_size)
+        {
+          offset = start + size - base;
+          return reinterpret_cast<void*>(start);
+        }
+
+        current++;
+        offset = 0;
+      }
+    }
+
+    void reset()
+    {
+      if (blocks.size() > max_kept_blocks)
+        blocks.resize(max_kept_blocks);
+
+      large.clear();
+      current = 0;
+      offset = 0;
+    }
+
+    size_t capacity() const
+    {
+      return blocks.size() * block_size;
+    }
+  };
+
+  /** Standard allocator over an Arena.
+   *
+   * Deallocation is a no-op, the memory is reclaimed when the arena is reset.
+   * A default-constructed ArenaAllocator has no arena, and allocates from the
+   * heap instead.
+   */
+  template <class T>
+  class ArenaAllocator
+  {
+  public:
+    using value_type = T;
+    using propagate_on_container_copy_assignment = std::true_type;
+    using propagate_on_container_move_assignment = std::true_type;
+    using propagate_on_container_swap = std::true_type;
+
+    Arena* arena = nullptr;
+
+    ArenaAllocator() = default;
+    ArenaAllocator(Arena* arena_) : arena(arena_) {}
+
+    template <class U>
+    ArenaAllocator(const ArenaAllocator<U>& that) : arena(that.arena)
+    {}
+
+    T* allocate(size_t n)
+    {
+      if (arena == nullptr)
+        return std::allocator<T>().allocate(n);
+
+      return static_cast<T*>(arena->allocate(n * sizeof(T), alignof(T)));
+    }
+
+    void deallocate(T* p, size_t n)
+    {
+      if (arena == nullptr)
+        std::allocator<T>().deallocate(p, n);
+    }
+
+    template <class U>
+    bool operator==(const ArenaAllocator<U>& that) const
+    {
+      return arena == that.arena;
+    }
+
+    template <class U>
+    bool operator!=(const ArenaAllocator<U>& that) const
+    {
+      return arena != that.arena;
+    }
+  };
+
+  /** Objects recycled by the thread that released them.
+   *
+   * acquire() hands out an object previously released on the same thread if
+   * there is one, so that the memory it owns is reused rather than
+   * reallocated. At most max_pooled objects are kept per thread.
+   */
+  template <class T, size_t max_pooled = 8>
+  class ThreadLocalPool
+  {
+  private:
+    static std::vector<std::unique_ptr<T>>& pool()
+    {
+      thread_local std::vector<std::unique_ptr<T>> objects;
+      return objects;
+    }
+
+  public:
+    static std::unique_ptr<T> acquire()
+    {
+      auto& objects = pool();
+      if (objects.empty())
+        return std::make_unique<T>();
+
+      auto object = std::move(objects.back());
+      objects.pop_back();
+      return object;
+    }
+
+    static void release(std::unique_ptr<T>&& object)
+    {
+      auto& objects = pool();
+      if (object != nullptr && objects.size() < max_pooled)
+        objects.push_back(std::move(object));
+    }
+  };
+}
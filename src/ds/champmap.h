@@ -3,8 +3,10 @@
 #pragma once
 
 #include <array>
+#include <atomic>
 #include <memory>
 #include <optional>
+#include <stdexcept>
 #include <vector>
 
 namespace champ
@@ -29,6 +31,12 @@ namespace champ
   static constexpr SmallIndex collision_depth = hash_bits / index_mask_bits;
   static constexpr size_t collision_bins = 1 << collision_node_bits;
 
+  // Nodes created by a transient map are tagged with its owner, and only that
+  // transient may update them in place. Persistent nodes have no owner.
+  using Owner = uint64_t;
+  static constexpr Owner no_owner = 0;
+  inline std::atomic<Owner> next_owner = 1;
+
   static constexpr SmallIndex mask(Hash hash, SmallIndex depth)
   {
     return (hash >> ((Hash)depth * index_mask_bits)) & index_mask;
@@ -96,6 +104,7 @@ namespace champ
   struct Collisions
   {
     std::array<std::vector<std::shared_ptr<Entry<K, V>>>, collision_bins> bins;
+    Owner owner = no_owner;
 
     const V* getp(Hash hash, const K& k) const
     {
@@ -126,6 +135,31 @@ namespace champ
       return true;
     }
 
+    bool remove_mut(Hash hash, const K& k)
+    {
+      const auto idx = mask(hash, collision_depth);
+      auto& bin = bins[idx];
+      for (size_t i = 0; i < bin.size(); ++i)
+      {
+        if (k == bin[i]->key)
+        {
+          bin.erase(bin.begin() + i);
+          return true;
+        }
+      }
+      return false;
+    }
+
+    bool empty() const
+    {
+      for (const auto& bin : bins)
+      {
+        if (!bin.empty())
+          return false;
+      }
+      return true;
+    }
+
     template <class F>
     bool foreach(F&& f) const
     {
@@ -145,6 +179,7 @@ namespace champ
     std::vector<Node<K, V, H>> nodes;
     Bitmap node_map;
     Bitmap data_map;
+    Owner owner = no_owner;
 
     SubNodes() {}
 
@@ -185,7 +220,12 @@ namespace champ
       return node_as<SubNodes<K, V, H>>(c_idx)->getp(depth + 1, hash, k);
     }
 
-    bool put_mut(SmallIndex depth, Hash hash, const K& k, const V& v)
+    bool put_mut(
+      SmallIndex depth,
+      Hash hash,
+      const K& k,
+      const V& v,
+      Owner owner_ = no_owner)
     {
       const auto idx = mask(hash, depth);
       auto c_idx = compressed_idx(idx);
@@ -201,20 +241,12 @@ namespace champ
 
       if (node_map.check(idx))
       {
-        bool insert;
         if (depth < (collision_depth - 1))
-        {
-          auto sn = *node_as<SubNodes<K, V, H>>(c_idx);
-          insert = sn.put_mut(depth + 1, hash, k, v);
-          nodes[c_idx] = std::make_shared<SubNodes<K, V, H>>(std::move(sn));
-        }
+          return edit_node<SubNodes<K, V, H>>(c_idx, owner_)->put_mut(
+            depth + 1, hash, k, v, owner_);
         else
-        {
-          auto sn = *node_as<Collisions<K, V, H>>(c_idx);
-          insert = sn.put_mut(hash, k, v);
-          nodes[c_idx] = std::make_shared<Collisions<K, V, H>>(std::move(sn));
-        }
-        return insert;
+          return edit_node<Collisions<K, V, H>>(c_idx, owner_)->put_mut(
+            hash, k, v);
       }
 
       const auto& entry0 = node_as<Entry<K, V>>(c_idx);
@@ -230,7 +262,8 @@ namespace champ
         const auto idx0 = mask(hash0, depth + 1);
         auto sub_node =
           SubNodes<K, V, H>({entry0}, Bitmap(0), Bitmap(0).set(idx0));
-        sub_node.put_mut(depth + 1, hash, k, v);
+        sub_node.owner = owner_;
+        sub_node.put_mut(depth + 1, hash, k, v, owner_);
 
         nodes.erase(nodes.begin() + c_idx);
         data_map = data_map.clear(idx);
@@ -243,6 +276,7 @@ namespace champ
       else
       {
         auto sub_node = Collisions<K, V, H>();
+        sub_node.owner = owner_;
         const auto hash0 = H()(entry0->key);
         const auto idx0 = mask(hash0, collision_depth);
         sub_node.bins[idx0].push_back(entry0);
@@ -264,11 +298,76 @@ namespace champ
       SmallIndex depth, Hash hash, const K& k, const V& v) const
     {
       auto node = *this;
+      node.owner = no_owner;
       auto r = node.put_mut(depth, hash, k, v);
       return std::make_pair(
         std::make_shared<SubNodes<K, V, H>>(std::move(node)), r);
     }
 
+    bool remove_mut(
+      SmallIndex depth, Hash hash, const K& k, Owner owner_ = no_owner)
+    {
+      const auto idx = mask(hash, depth);
+      const auto c_idx = compressed_idx(idx);
+
+      if (c_idx == (SmallIndex)-1)
+        return false;
+
+      if (data_map.check(idx))
+      {
+        if (!(k == node_as<Entry<K, V>>(c_idx)->key))
+          return false;
+
+        nodes.erase(nodes.begin() + c_idx);
+        data_map = data_map.clear(idx);
+        return true;
+      }
+
+      if (depth == (collision_depth - 1))
+      {
+        const auto& sub_node = edit_node<Collisions<K, V, H>>(c_idx, owner_);
+        if (!sub_node->remove_mut(hash, k))
+          return false;
+
+        if (sub_node->empty())
+        {
+          nodes.erase(nodes.begin() + c_idx);
+          node_map = node_map.clear(idx);
+        }
+        return true;
+      }
+
+      const auto& sub_node = edit_node<SubNodes<K, V, H>>(c_idx, owner_);
+      if (!sub_node->remove_mut(depth + 1, hash, k, owner_))
+        return false;
+
+      // A sub-node left empty is dropped, and one left with a single entry is
+      // replaced by that entry, so that the trie does not grow with history
+      if (sub_node->nodes.empty())
+      {
+        nodes.erase(nodes.begin() + c_idx);
+        node_map = node_map.clear(idx);
+      }
+      else if (sub_node->nodes.size() == 1 && sub_node->node_map.pop() == 0)
+      {
+        auto entry = sub_node->nodes.front();
+        nodes.erase(nodes.begin() + c_idx);
+        node_map = node_map.clear(idx);
+        data_map = data_map.set(idx);
+        nodes.insert(nodes.begin() + compressed_idx(idx), std::move(entry));
+      }
+      return true;
+    }
+
+    std::shared_ptr<SubNodes<K, V, H>> remove(
+      SmallIndex depth, Hash hash, const K& k) const
+    {
+      auto node = *this;
+      node.owner = no_owner;
+      node.remove_mut(depth, hash, k);
+      return std::make_shared<SubNodes<K, V, H>>(std::move(node));
+    }
+
     template <class F>
     bool foreach(SmallIndex depth, F&& f) const
     {
@@ -302,12 +401,31 @@ namespace champ
     {
       return reinterpret_cast<const std::shared_ptr<A>&>(nodes[c_idx]);
     }
+
+    // Returns the sub-node at c_idx, after replacing it with a copy owned by
+    // owner_ unless owner_ already owns it
+    template <class A>
+    const std::shared_ptr<A>& edit_node(SmallIndex c_idx, Owner owner_)
+    {
+      if (owner_ == no_owner || node_as<A>(c_idx)->owner != owner_)
+      {
+        auto node = std::make_shared<A>(*node_as<A>(c_idx));
+        node->owner = owner_;
+        nodes[c_idx] = std::move(node);
+      }
+      return node_as<A>(c_idx);
+    }
   };
 
+  template <class K, class V, class H>
+  class TransientMap;
+
   template <class K, class V, class H = std::hash<K>>
   class Map
   {
   private:
+    friend class TransientMap<K, V, H>;
+
     std::shared_ptr<SubNodes<K, V, H>> root;
     size_t _size = 0;
 
@@ -354,10 +472,104 @@ namespace champ
       return Map(std::move(r.first), size_);
     }
 
+    const Map<K, V, H> remove(const K& key) const
+    {
+      const auto hash = H()(key);
+      if (root->getp(0, hash, key) == nullptr)
+        return *this;
+
+      return Map(root->remove(0, hash, key), _size - 1);
+    }
+
+    TransientMap<K, V, H> transient() const
+    {
+      return TransientMap<K, V, H>(*this);
+    }
+
     template <class F>
     bool foreach(F&& f) const
     {
       return root->foreach(0, std::forward<F>(f));
     }
   };
+
+  /** Mutable view of a Map, for applying a batch of updates.
+   *
+   * The first update to a node copies it, as Map::put does, but the copy is
+   * owned by the transient and later updates modify it in place. persistent()
+   * returns the resulting Map and ends the batch. The source Map is never
+   * modified.
+   */
+  template <class K, class V, class H = std::hash<K>>
+  class TransientMap
+  {
+  private:
+    std::shared_ptr<SubNodes<K, V, H>> root;
+    size_t _size;
+    Owner owner;
+
+    void check_active() const
+    {
+      if (root == nullptr)
+        throw std::logic_error(
+          "Transient map has already been made persistent");
+    }
+
+  public:
+    explicit TransientMap(const Map<K, V, H>& map) :
+      root(map.root),
+      _size(map._size),
+      owner(next_owner++)
+    {}
+
+    // Copies would share the nodes owned by the transient
+    TransientMap(const TransientMap& that) = delete;
+    TransientMap(TransientMap&& that) = default;
+
+    size_t size() const
+    {
+      return _size;
+    }
+
+    bool empty() const
+    {
+      return _size == 0;
+    }
+
+    std::optional<V> get(const K& key) const
+    {
+      auto v = getp(key);
+
+      if (v)
+        return *v;
+      else
+        return {};
+    }
+
+    const V* getp(const K& key) const
+    {
+      check_active();
+      return root->getp(0, H()(key), key);
+    }
+
+    void put(const K& key, const V& value)
+    {
+      check_active();
+
+      if (root->owner != owner)
+      {
+        root = std::make_shared<SubNodes<K, V, H>>(*root);
+        root->owner = owner;
+      }
+
+      if (root->put_mut(0, H()(key), key, value, owner))
+        _size++;
+    }
+
+    Map<K, V, H> persistent()
+    {
+      check_active();
+      return Map<K, V, H>(std::move(root), _size);
+    }
+  };
 }
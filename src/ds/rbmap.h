@@ -56,6 +56,11 @@ public:
     return !_root;
   }
 
+  size_t size() const
+  {
+    return _size;
+  }
+
   std::optional<V> get(const K& key) const
   {
     auto v = getp(key);
@@ -83,23 +88,43 @@ public:
 
   RBMap put(const K& key, const V& value) const
   {
+    auto size = (getp(key) == nullptr) ? _size + 1 : _size;
     RBMap t = insert(key, value);
-    return RBMap(B, t.left(), t.rootKey(), t.rootValue(), t.right());
+    RBMap r(B, t.left(), t.rootKey(), t.rootValue(), t.right());
+    r._size = size;
+    return r;
   }
 
+  // Visits entries in key order, until f returns false
   template <class F>
-  void foreach(F&& f) const
+  bool foreach(F&& f) const
   {
-    if (!empty())
-    {
-      left().foreach(std::forward<F>(f));
-      f(rootKey(), rootValue());
-      right().foreach(std::forward<F>(f));
-    }
+    if (empty())
+      return true;
+
+    return left().foreach(f) && f(rootKey(), rootValue()) &&
+      right().foreach(f);
+  }
+
+  // Visits entries whose key is not less than from in key order, until f
+  // returns false
+  template <class F>
+  bool foreach_from(const K& from, F&& f) const
+  {
+    if (empty())
+      return true;
+
+    if (rootKey() < from)
+      return right().foreach_from(from, f);
+
+    return left().foreach_from(from, f) && f(rootKey(), rootValue()) &&
+      right().foreach(f);
   }
 
 private:
   std::shared_ptr<const Node> _root;
+  // Only maintained for the root of the tree
+  size_t _size = 0;
 
   Color rootColor() const
   {
@@ -0,0 +1,101 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the Apache 2.0 License.
+#include "../arena.h"
+
+#include <doctest/doctest.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+TEST_CASE("Arena allocations are aligned and reused after reset")
+{
+  ds::Arena arena;
+
+  std::vector<uintptr_t> first;
+  for (size_t i = 0; i < 1000; ++i)
+  {
+    auto p = reinterpret_cast<uintptr_t>(arena.allocate(24, 8));
+    REQUIRE(p % 8 == 0);
+    first.push_back(p);
+  }
+  auto capacity = arena.capacity();
+  REQUIRE(capacity >= 1000 * 24);
+
+  arena.reset();
+
+  for (size_t i = 0; i < 1000; ++i)
+  {
+    auto p = reinterpret_cast<uintptr_t>(arena.allocate(24, 8));
+    REQUIRE(p == first[i]);
+  }
+  REQUIRE(arena.capacity() == capacity);
+
+  INFO("Allocations larger than a block do not use the blocks");
+  {
+    auto p = arena.allocate(ds::Arena::block_size * 2, 16);
+    REQUIRE(reinterpret_cast<uintptr_t>(p) % 16 == 0);
+    REQUIRE(arena.capacity() == capacity);
+  }
+}
+
+TEST_CASE("Containers over an arena")
+{
+  ds::Arena arena;
+
+  using Map = std::unordered_map<
+    std::string,
+    size_t,
+    std::hash<std::string>,
+    std::equal_to<std::string>,
+    ds::ArenaAllocator<std::pair<const std::string, size_t>>>;
+
+  // Once the arena has grown to fit the map, rebuilding the map after a reset
+  // does not allocate any more blocks
+  size_t capacity = 0;
+  for (size_t round = 0; round < 3; ++round)
+  {
+    {
+      Map m{Map::allocator_type(&arena)};
+      for (size_t i = 0; i < 100; ++i)
+        m[std::to_string(i)] = i;
+
+      for (size_t i = 0; i < 100; ++i)
+        REQUIRE(m.at(std::to_string(i)) == i);
+    }
+
+    if (round == 0)
+      capacity = arena.capacity();
+    else
+      REQUIRE(arena.capacity() == capacity);
+
+    arena.reset();
+  }
+
+  INFO("Without an arena, containers allocate from the heap");
+  {
+    Map m;
+    m["key"] = 1;
+    REQUIRE(m.at("key") == 1);
+  }
+}
+
+TEST_CASE("Thread local pool recycles objects")
+{
+  using Pool = ds::ThreadLocalPool<ds::Arena, 2>;
+
+  auto a = Pool::acquire();
+  auto b = Pool::acquire();
+  auto c = Pool::acquire();
+  auto a_ptr = a.get();
+  auto b_ptr = b.get();
+
+  Pool::release(std::move(a));
+  Pool::release(std::move(b));
+  // Only 2 objects are kept
+  Pool::release(std::move(c));
+
+  auto d = Pool::acquire();
+  auto e = Pool::acquire();
+  REQUIRE(d.get() == b_ptr);
+  REQUIRE(e.get() == a_ptr);
+}
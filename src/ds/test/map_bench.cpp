@@ -66,6 +66,39 @@ static void benchmark_put(picobench::state& s)
   s.stop_timer();
 }
 
+template <class M>
+static void benchmark_bulk_put(picobench::state& s)
+{
+  size_t size = s.iterations();
+  auto v = gen_val(val_size);
+  auto map = gen_map<M>(size);
+  s.start_timer();
+  auto res = map;
+  for (auto i : s)
+  {
+    res = res.put(size + i, v);
+  }
+  s.stop_timer();
+  do_not_optimize(res);
+}
+
+template <class M>
+static void benchmark_bulk_put_transient(picobench::state& s)
+{
+  size_t size = s.iterations();
+  auto v = gen_val(val_size);
+  auto map = gen_map<M>(size);
+  s.start_timer();
+  auto transient = map.transient();
+  for (auto i : s)
+  {
+    transient.put(size + i, v);
+  }
+  auto res = transient.persistent();
+  s.stop_timer();
+  do_not_optimize(res);
+}
+
 template <class M>
 static void benchmark_get(picobench::state& s)
 {
@@ -125,6 +158,13 @@ PICOBENCH(bench_rb_map_put).iterations(sizes).samples(10).baseline();
 auto bench_champ_map_put = benchmark_put<champ::Map<K, V>>;
 PICOBENCH(bench_champ_map_put).iterations(sizes).samples(10);
 
+PICOBENCH_SUITE("bulk put");
+auto bench_champ_map_bulk_put = benchmark_bulk_put<champ::Map<K, V>>;
+PICOBENCH(bench_champ_map_bulk_put).iterations(sizes).samples(10).baseline();
+auto bench_champ_map_bulk_put_transient =
+  benchmark_bulk_put_transient<champ::Map<K, V>>;
+PICOBENCH(bench_champ_map_bulk_put_transient).iterations(sizes).samples(10);
+
 PICOBENCH_SUITE("get");
 auto bench_rb_map_get = benchmark_get<RBMap<K, V>>;
 PICOBENCH(bench_rb_map_get).iterations(sizes).samples(10).baseline();
@@ -136,3 +136,155 @@ TEST_CASE("persistent map operations")
     champ = champ_new;
   }
 }
+
+TEST_CASE("transient map operations")
+{
+  RBMap<K, V> rb;
+  champ::Map<K, V, H> champ;
+
+  auto ops = gen_ops(500);
+  size_t batch_start = 0;
+  while (batch_start < ops.size())
+  {
+    const auto batch_end = std::min(ops.size(), batch_start + 50);
+    auto rb_new = rb;
+    auto transient = champ.transient();
+    for (auto i = batch_start; i < batch_end; ++i)
+    {
+      auto op = dynamic_cast<Put*>(ops[i].get());
+      rb_new = rb_new.put(op->k, op->v);
+      transient.put(op->k, op->v);
+      REQUIRE(transient.size() == rb_new.size());
+      REQUIRE(transient.get(op->k) == op->v);
+    }
+    auto champ_new = transient.persistent();
+    REQUIRE_THROWS_AS(transient.put(0, 0), std::logic_error);
+
+    INFO("check consistency of batched updates");
+    {
+      size_t n = 0;
+      champ_new.foreach([&](const auto& k, const auto& v) {
+        n++;
+        auto p = rb_new.get(k);
+        REQUIRE(p.has_value());
+        REQUIRE(p.value() == v);
+        return true;
+      });
+      REQUIRE(n == rb_new.size());
+      REQUIRE(n == champ_new.size());
+    }
+
+    INFO("check that the source map is unchanged");
+    {
+      size_t n = 0;
+      champ.foreach([&](const auto& k, const auto& v) {
+        n++;
+        auto p = rb.get(k);
+        REQUIRE(p.has_value());
+        REQUIRE(p.value() == v);
+        return true;
+      });
+      REQUIRE(n == champ.size());
+    }
+
+    INFO("check that persistent updates do not modify the batch's result");
+    {
+      auto op = dynamic_cast<Put*>(ops[batch_start].get());
+      auto updated = champ_new.put(op->k, op->v + 1);
+      REQUIRE(champ_new.get(op->k) == rb_new.get(op->k));
+      REQUIRE(updated.get(op->k) == op->v + 1);
+    }
+
+    rb = rb_new;
+    champ = champ_new;
+    batch_start = batch_end;
+  }
+}
+
+TEST_CASE("persistent map removal")
+{
+  map<K, V> reference;
+  champ::Map<K, V, H> champ;
+
+  auto ops = gen_ops(500);
+  for (auto& op : ops)
+  {
+    auto put = dynamic_cast<Put*>(op.get());
+    reference[put->k] = put->v;
+    champ = champ.put(put->k, put->v);
+  }
+
+  random_device rand_dev;
+  mt19937 gen(rand_dev());
+  vector<K> keys;
+  for (const auto& [k, v] : reference)
+    keys.push_back(k);
+  shuffle(keys.begin(), keys.end(), gen);
+
+  for (const auto& k : keys)
+  {
+    auto champ_new = champ.remove(k);
+    reference.erase(k);
+
+    INFO("check consistency after removal");
+    {
+      REQUIRE(!champ_new.get(k).has_value());
+      REQUIRE(champ_new.size() == reference.size());
+      size_t n = 0;
+      champ_new.foreach([&](const auto& k, const auto& v) {
+        n++;
+        auto p = reference.find(k);
+        REQUIRE(p != reference.end());
+        REQUIRE(p->second == v);
+        return true;
+      });
+      REQUIRE(n == reference.size());
+    }
+
+    INFO("check persistence of previous versions");
+    {
+      REQUIRE(champ.get(k).has_value());
+      REQUIRE(champ.size() == reference.size() + 1);
+    }
+
+    INFO("removing an absent key has no effect");
+    {
+      REQUIRE(champ_new.remove(k).size() == champ_new.size());
+    }
+
+    champ = champ_new;
+  }
+
+  REQUIRE(champ.empty());
+}
+
+TEST_CASE("ordered map iteration")
+{
+  RBMap<K, V> rb;
+  for (K k = 0; k < 100; ++k)
+    rb = rb.put((k * 37) % 100, k);
+  REQUIRE(rb.size() == 100);
+
+  rb = rb.put(50, 0);
+  REQUIRE(rb.size() == 100);
+
+  INFO("entries are visited in key order");
+  {
+    K expected = 0;
+    REQUIRE(rb.foreach([&](const K& k, const V& v) {
+      REQUIRE(k == expected++);
+      return true;
+    }));
+    REQUIRE(expected == 100);
+  }
+
+  INFO("iteration can start from any key and stop early");
+  {
+    K expected = 42;
+    REQUIRE(!rb.foreach_from(42, [&](const K& k, const V& v) {
+      REQUIRE(k == expected++);
+      return k < 60;
+    }));
+    REQUIRE(expected == 61);
+  }
+}
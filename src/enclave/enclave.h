@@ -197,24 +197,32 @@ namespace enclave
 
         DISPATCHER_SET_MESSAGE_HANDLER(
           bp,
-          consensus::ledger_entry,
+          consensus::ledger_entry_range,
           [this](const uint8_t* data, size_t size) {
-            auto [body] =
-              ringbuffer::read_message<consensus::ledger_entry>(data, size);
-            if (node.is_reading_public_ledger())
-              node.recover_public_ledger_entry(body);
-            else if (node.is_reading_private_ledger())
-              node.recover_private_ledger_entry(body);
-            else
-              LOG_FAIL_FMT("Cannot recover ledger entry: Unexpected state");
+            auto [from, to, framed_entries] =
+              ringbuffer::read_message<consensus::ledger_entry_range>(
+                data, size);
+            node.recover_ledger_entries(
+              from, to, framed_entries.data, framed_entries.size);
+          });
+
+        DISPATCHER_SET_MESSAGE_HANDLER(
+          bp,
+          consensus::ledger_no_entry_range,
+          [this](const uint8_t* data, size_t size) {
+            auto [from, to] =
+              ringbuffer::read_message<consensus::ledger_no_entry_range>(
+                data, size);
+            node.recover_ledger_end(from);
           });
 
         DISPATCHER_SET_MESSAGE_HANDLER(
           bp,
-          consensus::ledger_no_entry,
+          consensus::ledger_durable,
           [this](const uint8_t* data, size_t size) {
-            ringbuffer::read_message<consensus::ledger_no_entry>(data, size);
-            node.recover_ledger_end();
+            auto [idx, truncations] =
+              ringbuffer::read_message<consensus::ledger_durable>(data, size);
+            node.ledger_durable(idx, truncations);
           });
 
         rpcsessions->register_message_handlers(bp.get_dispatcher());
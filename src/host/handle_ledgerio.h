@@ -0,0 +1,32 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the Apache 2.0 License.
+#pragma once
+
+#include "everyio.h"
+#include "ledgerio.h"
+
+namespace asynchost
+{
+  class HandleLedgerIOImpl
+  {
+  private:
+    LedgerIO& ledger_io;
+
+  public:
+    HandleLedgerIOImpl(LedgerIO& ledger_io) : ledger_io(ledger_io) {}
+
+    void every()
+    {
+      // On each uv loop iteration...
+
+      // ...ask for the entries appended while handling the ringbuffer messages
+      // to be made durable at once...
+      ledger_io.sync();
+
+      // ...and complete the ledger operations that have finished
+      ledger_io.process_completions();
+    }
+  };
+
+  using HandleLedgerIO = proxy_ptr<EveryIO<HandleLedgerIOImpl>>;
+}
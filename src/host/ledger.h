@@ -6,81 +6,246 @@
 #include "ds/logger.h"
 #include "ds/messaging.h"
 
+#include <algorithm>
 #include <cstdint>
 #include <cstdio>
+#include <deque>
+#include <dirent.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <list>
+#include <map>
+#include <memory>
+#include <optional>
 #include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
 #include <vector>
 
 namespace asynchost
 {
-  class Ledger
+  static constexpr size_t ledger_chunk_bytes_default = 5 * 1024 * 1024;
+  static constexpr size_t ledger_max_read_cache_files_default = 5;
+  static constexpr size_t ledger_recent_entries_bytes_default =
+    16 * 1024 * 1024;
+  // Responses to ledger_get_range are kept well under the default maximum
+  // size of ringbuffer messages
+  static constexpr size_t ledger_range_max_bytes = 1024 * 1024;
+
+  /**
+   * When entries written to the ledger are made durable.
+   *
+   * none: entries are left to the OS to write back, and are reported durable
+   * as soon as they are written.
+   * batched: all the entries written in one pass over the ringbuffer are
+   * synchronised to disk at once (group commit).
+   * every_entry: each entry is synchronised to disk as it is written.
+   */
+  enum class LedgerDurability
+  {
+    none,
+    batched,
+    every_entry
+  };
+
+  /**
+   * Last durable index of the ledger, and number of truncations applied since
+   * the previous report, as reported to the enclave.
+   */
+  struct DurabilityReport
+  {
+    size_t durable_idx;
+    size_t truncations;
+  };
+
+  static constexpr auto ledger_chunk_prefix = "ledger_";
+  static constexpr auto ledger_last_idx_delimiter = '-';
+
+  /**
+   * A contiguous range of framed ledger entries. owner keeps the memory
+   * pointed to by data alive, so that the entries can be handed to
+   * asynchronous writers without being copied.
+   */
+  struct FramedEntries
+  {
+    const uint8_t* data = nullptr;
+    size_t size = 0;
+    std::shared_ptr<const void> owner = nullptr;
+  };
+
+  /**
+   * A single chunk of the ledger, stored in its own file.
+   *
+   * The file starts with a header holding the offset of the positions table.
+   * The header is 0 while the chunk is still being written. Once the chunk is
+   * complete, the offsets of all its entries are appended to the file and the
+   * header is updated to point to them, so that a completed chunk can be
+   * indexed with a single read, without scanning its entries.
+   *
+   * Completed chunks are never modified in place, and are read through a
+   * read-only memory mapping.
+   */
+  class LedgerFile
   {
   private:
+    using positions_offset_header_t = size_t;
     static constexpr size_t frame_header_size = sizeof(uint32_t);
 
+    const std::string dir;
+    size_t start_idx = 1;
+    size_t total_len = 0;
+    std::vector<size_t> positions;
+
     // This uses C stdio instead of fstream because an fstream
     // cannot be truncated.
-    FILE* file;
-    std::vector<size_t> positions;
-    size_t total_len;
-    ringbuffer::WriterPtr to_enclave;
+    FILE* file = nullptr;
+    bool completed = false;
 
-  public:
-    Ledger(
-      const std::string& filename,
-      ringbuffer::AbstractWriterFactory& writer_factory) :
-      file(NULL),
-      to_enclave(writer_factory.create_writer_to_inside())
+    // Mapping of a completed chunk, shared with the views handed out over it
+    std::shared_ptr<const uint8_t> mapping = nullptr;
+
+    std::string get_file_path(const std::string& file_name) const
+    {
+      return fmt::format("{}/{}", dir, file_name);
+    }
+
+    const uint8_t* get_mapping()
     {
-      file = fopen(filename.c_str(), "r+b");
+      if (!completed)
+        return nullptr;
 
+      if (mapping == nullptr)
+      {
+        auto len = total_len;
+        auto p = mmap(nullptr, len, PROT_READ, MAP_SHARED, fileno(file), 0);
+        if (p == MAP_FAILED)
+        {
+          LOG_FAIL_FMT(
+            "Could not map ledger file {}: {}",
+            get_file_name(),
+            strerror(errno));
+          return nullptr;
+        }
+
+        mapping = std::shared_ptr<const uint8_t>(
+          (const uint8_t*)p,
+          [len](const uint8_t* p) { munmap((void*)p, len); });
+      }
+
+      return mapping.get();
+    }
+
+  public:
+    // Create a new, empty chunk whose first entry will be start_idx
+    LedgerFile(const std::string& dir, size_t start_idx) :
+      dir(dir),
+      start_idx(start_idx)
+    {
+      auto file_path = get_file_path(get_file_name());
+      file = fopen(file_path.c_str(), "w+b");
       if (!file)
-        file = fopen(filename.c_str(), "w+b");
+      {
+        throw std::logic_error(fmt::format(
+          "Unable to create ledger file {}: {}", file_path, strerror(errno)));
+      }
+
+      positions_offset_header_t table_offset = 0;
+      if (fwrite(&table_offset, sizeof(table_offset), 1, file) != 1)
+        throw std::logic_error("Failed to write to file");
+
+      total_len = sizeof(positions_offset_header_t);
+    }
 
+    // Open an existing chunk
+    LedgerFile(const std::string& dir, const std::string& file_name) :
+      dir(dir)
+    {
+      auto file_path = get_file_path(file_name);
+      file = fopen(file_path.c_str(), "r+b");
       if (!file)
-        throw std::logic_error("Unable to open or create ledger file");
+      {
+        throw std::logic_error(fmt::format(
+          "Unable to open ledger file {}: {}", file_path, strerror(errno)));
+      }
+
+      start_idx = get_start_idx_from_file_name(file_name);
 
       fseeko(file, 0, SEEK_END);
       auto len = ftello(file);
-      if (len == 1)
+      if (len == -1)
       {
-        std::stringstream ss;
-        ss << "Failed to tell file size: " << strerror(errno);
-        throw std::logic_error(ss.str());
+        throw std::logic_error(
+          fmt::format("Failed to tell file size: {}", strerror(errno)));
       }
       fseeko(file, 0, SEEK_SET);
-      size_t pos = 0;
-      uint32_t size = 0;
 
-      while (len >= frame_header_size)
+      positions_offset_header_t table_offset;
+      if (fread(&table_offset, sizeof(table_offset), 1, file) != 1)
+        throw std::logic_error("Failed to read positions offset from file");
+
+      if (table_offset != 0)
       {
-        if (fread(&size, frame_header_size, 1, file) != 1)
-          throw std::logic_error("Failed to read from file");
+        // Completed chunk: the positions table is read in one go
+        total_len = table_offset;
+        if (
+          (total_len < sizeof(positions_offset_header_t)) ||
+          (total_len > (size_t)len) ||
+          (((size_t)len - total_len) % sizeof(size_t) != 0))
+        {
+          throw std::logic_error(
+            fmt::format("Malformed ledger file {}", file_name));
+        }
 
-        len -= frame_header_size;
+        positions.resize(((size_t)len - total_len) / sizeof(size_t));
+        fseeko(file, total_len, SEEK_SET);
+        if (
+          !positions.empty() &&
+          fread(positions.data(), sizeof(size_t), positions.size(), file) !=
+            positions.size())
+        {
+          throw std::logic_error(fmt::format(
+            "Failed to read positions table from ledger file {}", file_name));
+        }
 
-        if (len < size)
-          throw std::logic_error("Malformed ledger file");
+        completed = true;
+      }
+      else
+      {
+        // Chunk still being written: recover the positions by scanning the
+        // entries. This is bounded by the chunk size.
+        size_t pos = sizeof(positions_offset_header_t);
+        len -= pos;
+        uint32_t size = 0;
 
-        fseeko(file, size, SEEK_CUR);
-        len -= size;
+        while (len >= frame_header_size)
+        {
+          if (fread(&size, frame_header_size, 1, file) != 1)
+            throw std::logic_error("Failed to read from file");
 
-        positions.push_back(pos);
-        pos += (size + frame_header_size);
-      }
+          len -= frame_header_size;
+
+          if (len < size)
+            throw std::logic_error("Malformed ledger file");
 
-      total_len = pos;
+          fseeko(file, size, SEEK_CUR);
+          len -= size;
 
-      if (len != 0)
-        throw std::logic_error("Malformed ledger file");
+          positions.push_back(pos);
+          pos += (size + frame_header_size);
+        }
+
+        total_len = pos;
+
+        if (len != 0)
+          throw std::logic_error("Malformed ledger file");
+      }
     }
 
-    Ledger(const Ledger& that) = delete;
+    LedgerFile(const LedgerFile& that) = delete;
 
-    ~Ledger()
+    ~LedgerFile()
     {
       if (file)
       {
@@ -89,141 +254,1100 @@ namespace asynchost
       }
     }
 
-    size_t get_last_idx()
+    static bool is_ledger_file_name(const std::string& file_name)
     {
-      return positions.size();
+      return file_name.rfind(ledger_chunk_prefix, 0) == 0 &&
+        file_name.size() > strlen(ledger_chunk_prefix);
     }
 
-    const std::vector<uint8_t> read_entry(size_t idx)
+    static size_t get_start_idx_from_file_name(const std::string& file_name)
+    {
+      auto pos = file_name.find(ledger_last_idx_delimiter);
+      return std::stoul(file_name.substr(
+        strlen(ledger_chunk_prefix),
+        pos == std::string::npos ? std::string::npos :
+                                   pos - strlen(ledger_chunk_prefix)));
+    }
+
+    static std::optional<size_t> get_last_idx_from_file_name(
+      const std::string& file_name)
+    {
+      auto pos = file_name.find(ledger_last_idx_delimiter);
+      if (pos == std::string::npos)
+        return std::nullopt;
+
+      return std::stoul(file_name.substr(pos + 1));
+    }
+
+    std::string get_file_name() const
+    {
+      if (completed)
+      {
+        return fmt::format(
+          "{}{}{}{}",
+          ledger_chunk_prefix,
+          start_idx,
+          ledger_last_idx_delimiter,
+          get_last_idx());
+      }
+      else
+      {
+        return fmt::format("{}{}", ledger_chunk_prefix, start_idx);
+      }
+    }
+
+    size_t get_start_idx() const
+    {
+      return start_idx;
+    }
+
+    size_t get_last_idx() const
+    {
+      return start_idx + positions.size() - 1;
+    }
+
+    size_t get_current_size() const
+    {
+      return total_len;
+    }
+
+    bool is_complete() const
+    {
+      return completed;
+    }
+
+    /**
+     * Append an entry to the chunk.
+     *
+     * @return Index of the entry written
+     */
+    size_t write_entry(const uint8_t* data, size_t size)
+    {
+      if (completed)
+        throw std::logic_error("Cannot write to completed ledger file");
+
+      fseeko(file, total_len, SEEK_SET);
+      positions.push_back(total_len);
+
+      total_len += (size + frame_header_size);
+
+      uint32_t frame = (uint32_t)size;
+
+      if (fwrite(&frame, frame_header_size, 1, file) != 1)
+        throw std::logic_error("Failed to write to file");
+
+      if (fwrite(data, size, 1, file) != 1)
+        throw std::logic_error("Failed to write to file");
+
+      return get_last_idx();
+    }
+
+    size_t framed_entries_size(size_t from, size_t to) const
+    {
+      if ((from < start_idx) || (to < from) || (to > get_last_idx()))
+        return 0;
+
+      if (to == get_last_idx())
+      {
+        return total_len - positions.at(from - start_idx);
+      }
+      else
+      {
+        return positions.at(to - start_idx + 1) -
+          positions.at(from - start_idx);
+      }
+    }
+
+    size_t entry_size(size_t idx) const
+    {
+      auto framed_size = framed_entries_size(idx, idx);
+
+      return framed_size ? framed_size - frame_header_size : 0;
+    }
+
+    std::vector<uint8_t> read_entry(size_t idx)
     {
-      if ((idx == 0) || (idx > positions.size()))
+      if ((idx < start_idx) || (idx > get_last_idx()))
         return {};
 
       auto len = entry_size(idx);
+      auto pos = positions.at(idx - start_idx) + frame_header_size;
+
+      auto m = get_mapping();
+      if (m != nullptr)
+        return {m + pos, m + pos + len};
+
       std::vector<uint8_t> entry(len);
-      fseeko(file, positions.at(idx - 1) + frame_header_size, SEEK_SET);
+      fseeko(file, pos, SEEK_SET);
 
-      if (fread(entry.data(), len, 1, file) != 1)
+      if (len > 0 && fread(entry.data(), len, 1, file) != 1)
         throw std::logic_error("Failed to read from file");
 
       return entry;
     }
 
-    const std::vector<uint8_t> read_framed_entries(size_t from, size_t to)
+    /**
+     * Append the framed entries [from, to] to the given buffer.
+     */
+    void read_framed_entries(
+      size_t from, size_t to, std::vector<uint8_t>& framed_entries)
     {
       auto framed_size = framed_entries_size(from, to);
-
-      std::vector<uint8_t> framed_entries(framed_size);
       if (framed_size == 0)
-        return framed_entries;
+        return;
 
-      fseeko(file, positions.at(from - 1), SEEK_SET);
+      auto pos = positions.at(from - start_idx);
 
-      if (fread(framed_entries.data(), framed_size, 1, file) != 1)
+      auto m = get_mapping();
+      if (m != nullptr)
+      {
+        framed_entries.insert(
+          framed_entries.end(), m + pos, m + pos + framed_size);
+        return;
+      }
+
+      auto offset = framed_entries.size();
+      framed_entries.resize(offset + framed_size);
+      fseeko(file, pos, SEEK_SET);
+
+      if (fread(framed_entries.data() + offset, framed_size, 1, file) != 1)
         throw std::logic_error("Failed to read from file");
+    }
 
-      return framed_entries;
+    /**
+     * View over the framed entries [from, to] of a completed chunk, without
+     * copying them.
+     *
+     * @return The view, or nothing if the chunk is not complete
+     */
+    std::optional<FramedEntries> get_framed_entries_view(size_t from, size_t to)
+    {
+      auto m = get_mapping();
+      if (m == nullptr)
+        return std::nullopt;
+
+      auto framed_size = framed_entries_size(from, to);
+      if (framed_size == 0)
+        return FramedEntries();
+
+      return FramedEntries{
+        m + positions.at(from - start_idx), framed_size, mapping};
     }
 
-    size_t framed_entries_size(size_t from, size_t to)
+    /**
+     * Truncate the chunk so that last_idx is its final entry.
+     *
+     * A completed chunk is re-opened for writing.
+     *
+     * @return true if the chunk is now empty
+     */
+    bool truncate(size_t last_idx)
     {
-      if ((from == 0) || (to < from) || (to > positions.size()))
-        return 0;
+      if (last_idx >= get_last_idx() && !completed)
+        return false;
 
-      if (to == positions.size())
+      auto original_file_name = get_file_name();
+
+      if (last_idx < get_last_idx())
       {
-        return total_len - positions.at(from - 1);
+        total_len = positions.at(last_idx - start_idx + 1);
+        positions.resize(last_idx - start_idx + 1);
       }
-      else
+
+      if (completed)
+      {
+        open(original_file_name);
+        return positions.empty();
+      }
+
+      if (fflush(file) != 0)
       {
-        return positions.at(to) - positions.at(from - 1);
+        throw std::logic_error(
+          fmt::format("Failed to flush file: {}", strerror(errno)));
       }
+
+      if (ftruncate(fileno(file), total_len))
+        throw std::logic_error("Failed to truncate file");
+
+      fseeko(file, total_len, SEEK_SET);
+
+      return positions.empty();
     }
 
-    size_t entry_size(size_t idx)
+    /**
+     * Write the chunk through to disk. fdatasync also persists the size of
+     * the file, which is needed to read the entries back.
+     */
+    void sync()
     {
-      auto framed_size = framed_entries_size(idx, idx);
+      if (fflush(file) != 0)
+      {
+        throw std::logic_error(
+          fmt::format("Failed to flush file: {}", strerror(errno)));
+      }
 
-      return framed_size ? framed_size - frame_header_size : 0;
+      if (fdatasync(fileno(file)) != 0)
+      {
+        throw std::logic_error(
+          fmt::format("Failed to sync file: {}", strerror(errno)));
+      }
     }
 
-    void write_entry(const uint8_t* data, size_t size)
+    /**
+     * Mark the chunk as complete: append its positions table, point the
+     * header at it and rename the file to include the last index.
+     *
+     * If durable is set, the positions table is synchronised to disk before
+     * the header points to it, so that a completed chunk is never found with
+     * a partial table after a crash.
+     */
+    void complete(bool durable = false)
     {
+      if (completed)
+        return;
+
+      auto original_file_name = get_file_name();
+
       fseeko(file, total_len, SEEK_SET);
-      positions.push_back(total_len);
+      if (
+        !positions.empty() &&
+        fwrite(positions.data(), sizeof(size_t), positions.size(), file) !=
+          positions.size())
+      {
+        throw std::logic_error("Failed to write positions table to file");
+      }
 
-      LOG_DEBUG_FMT("Ledger write {}: {} bytes", positions.size(), size);
+      if (durable)
+        sync();
 
-      total_len += (size + frame_header_size);
+      fseeko(file, 0, SEEK_SET);
+      positions_offset_header_t table_offset = total_len;
+      if (fwrite(&table_offset, sizeof(table_offset), 1, file) != 1)
+        throw std::logic_error("Failed to write positions offset to file");
 
-      uint32_t frame = (uint32_t)size;
+      if (durable)
+      {
+        sync();
+      }
+      else if (fflush(file) != 0)
+      {
+        throw std::logic_error(
+          fmt::format("Failed to flush file: {}", strerror(errno)));
+      }
 
-      if (fwrite(&frame, frame_header_size, 1, file) != 1)
+      completed = true;
+      rename_from(original_file_name);
+    }
+
+    /**
+     * Rename the file to match the completion state of the chunk. Required
+     * when a chunk was completed but the process stopped before it was
+     * renamed.
+     */
+    void rename_from(const std::string& file_name)
+    {
+      auto new_file_name = get_file_name();
+      if (file_name == new_file_name)
+        return;
+
+      auto from = get_file_path(file_name);
+      auto to = get_file_path(new_file_name);
+      if (std::rename(from.c_str(), to.c_str()) != 0)
+      {
+        throw std::logic_error(fmt::format(
+          "Could not rename ledger file {} to {}: {}",
+          from,
+          to,
+          strerror(errno)));
+      }
+    }
+
+    void remove()
+    {
+      auto file_path = get_file_path(get_file_name());
+      fclose(file);
+      file = nullptr;
+
+      if (std::remove(file_path.c_str()) != 0)
+      {
+        throw std::logic_error(fmt::format(
+          "Could not remove ledger file {}: {}", file_path, strerror(errno)));
+      }
+    }
+
+  private:
+    // Re-open a completed chunk for writing, keeping its first total_len
+    // bytes. The completed file may still be mapped by outstanding views, so
+    // rather than modifying it in place, the retained entries are copied to a
+    // new file and the completed file is unlinked.
+    void open(const std::string& completed_file_name)
+    {
+      std::vector<uint8_t> data(total_len - sizeof(positions_offset_header_t));
+      fseeko(file, sizeof(positions_offset_header_t), SEEK_SET);
+      if (!data.empty() && fread(data.data(), data.size(), 1, file) != 1)
+        throw std::logic_error("Failed to read from file");
+
+      auto completed_file_path = get_file_path(completed_file_name);
+      completed = false;
+      auto file_path = get_file_path(get_file_name());
+
+      auto new_file = fopen(file_path.c_str(), "w+b");
+      if (!new_file)
+      {
+        throw std::logic_error(fmt::format(
+          "Unable to create ledger file {}: {}", file_path, strerror(errno)));
+      }
+
+      positions_offset_header_t table_offset = 0;
+      if (fwrite(&table_offset, sizeof(table_offset), 1, new_file) != 1)
         throw std::logic_error("Failed to write to file");
 
-      if (fwrite(data, size, 1, file) != 1)
+      if (!data.empty() && fwrite(data.data(), data.size(), 1, new_file) != 1)
         throw std::logic_error("Failed to write to file");
+
+      fclose(file);
+      file = new_file;
+      mapping = nullptr;
+
+      if (std::remove(completed_file_path.c_str()) != 0)
+      {
+        throw std::logic_error(fmt::format(
+          "Could not remove ledger file {}: {}",
+          completed_file_path,
+          strerror(errno)));
+      }
     }
+  };
 
-    void truncate(size_t last_idx)
+  /**
+   * Bounded in-memory cache of the most recently written framed entries.
+   *
+   * Entries written to the ledger are usually read again shortly after, to be
+   * sent to each backup in turn. This serves reads of the tail of the ledger
+   * without touching the ledger files. Entries are appended to blocks of fixed
+   * capacity, which are never reallocated so that views over them remain
+   * valid, and the oldest blocks are evicted first.
+   */
+  class RecentEntries
+  {
+  private:
+    static constexpr size_t frame_header_size = sizeof(uint32_t);
+    static constexpr size_t blocks_per_cache = 16;
+
+    struct Block
     {
-      LOG_DEBUG_FMT("Ledger truncate: {}/{}", last_idx, positions.size());
+      size_t start_idx;
+      std::vector<size_t> positions;
+      std::vector<uint8_t> data;
 
-      // positions[last_idx - 1] is the position of the specified
-      // final index. Truncate the ledger at position[last_idx].
-      if (last_idx >= positions.size())
-        return;
+      size_t get_last_idx() const
+      {
+        return start_idx + positions.size() - 1;
+      }
 
-      total_len = positions.at(last_idx);
-      positions.resize(last_idx);
+      size_t framed_entries_size(size_t from, size_t to) const
+      {
+        auto end = (to == get_last_idx()) ? data.size() :
+                                            positions.at(to - start_idx + 1);
+        return end - positions.at(from - start_idx);
+      }
+    };
 
-      if (fflush(file) != 0)
+    const size_t max_bytes;
+    std::deque<std::shared_ptr<Block>> blocks;
+    size_t cached_bytes = 0;
+
+    size_t hits = 0;
+    size_t misses = 0;
+
+  public:
+    RecentEntries(size_t max_bytes) : max_bytes(max_bytes) {}
+
+    void append(size_t idx, const uint8_t* data, size_t size)
+    {
+      auto framed_size = size + frame_header_size;
+      if (framed_size > max_bytes)
       {
-        std::stringstream ss;
-        ss << "Failed to flush file: " << strerror(errno);
-        throw std::logic_error(ss.str());
+        clear();
+        return;
       }
 
-      if (ftruncate(fileno(file), total_len))
-        throw std::logic_error("Failed to truncate file");
+      if (!blocks.empty() && blocks.back()->get_last_idx() + 1 != idx)
+        clear();
 
-      fseeko(file, total_len, SEEK_SET);
+      if (
+        blocks.empty() ||
+        blocks.back()->data.size() + framed_size >
+          blocks.back()->data.capacity())
+      {
+        auto block = std::make_shared<Block>();
+        block->start_idx = idx;
+        block->data.reserve(
+          std::max(max_bytes / blocks_per_cache, framed_size));
+        cached_bytes += block->data.capacity();
+        blocks.push_back(block);
+
+        while (cached_bytes > max_bytes && blocks.size() > 1)
+        {
+          cached_bytes -= blocks.front()->data.capacity();
+          blocks.pop_front();
+        }
+      }
+
+      // The capacity of the block is sufficient, so this never reallocates
+      auto& block = blocks.back();
+      auto frame = (uint32_t)size;
+      block->positions.push_back(block->data.size());
+      block->data.insert(
+        block->data.end(), (uint8_t*)&frame, (uint8_t*)&frame + sizeof(frame));
+      block->data.insert(block->data.end(), data, data + size);
     }
 
-    void register_message_handlers(
-      messaging::Dispatcher<ringbuffer::Message>& disp)
+    /**
+     * Framed entries [from, to], if they are all cached. Ranges held by a
+     * single block are returned without being copied.
+     */
+    std::optional<FramedEntries> get(size_t from, size_t to)
     {
-      DISPATCHER_SET_MESSAGE_HANDLER(
-        disp,
-        consensus::ledger_append,
-        [this](const uint8_t* data, size_t size) { write_entry(data, size); });
+      if (
+        blocks.empty() || (from < blocks.front()->start_idx) ||
+        (to > blocks.back()->get_last_idx()) || (to < from))
+      {
+        misses++;
+        return std::nullopt;
+      }
+
+      hits++;
 
-      DISPATCHER_SET_MESSAGE_HANDLER(
-        disp,
-        consensus::ledger_truncate,
-        [this](const uint8_t* data, size_t size) {
-          auto idx = serialized::read<consensus::Index>(data, size);
-          truncate(idx);
+      auto it = std::upper_bound(
+        blocks.begin(), blocks.end(), from, [](size_t idx, const auto& block) {
+          return idx < block->start_idx;
         });
+      auto& block = *std::prev(it);
 
-      DISPATCHER_SET_MESSAGE_HANDLER(
-        disp, consensus::ledger_get, [&](const uint8_t* data, size_t size) {
-          // The enclave has asked for a ledger entry.
-          auto [idx] =
-            ringbuffer::read_message<consensus::ledger_get>(data, size);
+      if (to <= block->get_last_idx())
+      {
+        return FramedEntries{
+          block->data.data() + block->positions.at(from - block->start_idx),
+          block->framed_entries_size(from, to),
+          block};
+      }
+
+      auto framed_entries = std::make_shared<std::vector<uint8_t>>();
+      for (auto b = std::prev(it); from <= to; ++b)
+      {
+        const auto& block_ = *b;
+        auto to_ = std::min(to, block_->get_last_idx());
+        auto start =
+          block_->data.data() + block_->positions.at(from - block_->start_idx);
+        framed_entries->insert(
+          framed_entries->end(),
+          start,
+          start + block_->framed_entries_size(from, to_));
+        from = to_ + 1;
+      }
+
+      return FramedEntries{
+        framed_entries->data(), framed_entries->size(), framed_entries};
+    }
+
+    // Entries are only truncated in whole blocks, since existing views may
+    // still point past the truncation point
+    void truncate(size_t idx)
+    {
+      while (!blocks.empty() && blocks.back()->get_last_idx() > idx)
+      {
+        cached_bytes -= blocks.back()->data.capacity();
+        blocks.pop_back();
+      }
+    }
+
+    void clear()
+    {
+      blocks.clear();
+      cached_bytes = 0;
+    }
+
+    size_t get_hits() const
+    {
+      return hits;
+    }
+
+    size_t get_misses() const
+    {
+      return misses;
+    }
+  };
+
+  /**
+   * The host ledger, split into chunks of roughly chunk_threshold bytes.
+   *
+   * Only the last chunk is opened at startup. Completed chunks are located
+   * through their file names, which hold the range of indices they contain,
+   * and are opened on demand when read. A bounded number of them are kept open
+   * to serve reads.
+   *
+   * sync() should be called after each pass over the messages from the
+   * enclave. It makes the entries written during the pass durable, according
+   * to the durability policy, and reports the last durable index to the
+   * enclave, which only acknowledges and commits durable entries.
+   */
+  class Ledger
+  {
+  private:
+    ringbuffer::WriterPtr to_enclave;
+
+    const std::string ledger_dir;
+    const size_t chunk_threshold;
+    const size_t max_read_cache_files;
+    const LedgerDurability durability;
+
+    // File names of completed chunks, keyed by their last index
+    std::map<size_t, std::string> completed_chunks;
 
-          auto& entry = read_entry(idx);
+    // Chunk currently being written to, if any
+    std::shared_ptr<LedgerFile> current_file = nullptr;
 
-          if (entry.size() > 0)
+    // Most recently used completed chunks, kept open for reading
+    std::list<std::shared_ptr<LedgerFile>> read_cache;
+
+    // Most recently written entries, served without reading files
+    RecentEntries recent_entries;
+
+    // Index of the first entry held, which follows the snapshot last installed
+    // in place of the entries before it, if any
+    size_t start_idx = 1;
+    size_t last_idx = 0;
+
+    // Whether entries were written or files created since the last sync
+    bool entries_unsynced = false;
+    bool dir_unsynced = false;
+
+    // Last durable index reported to the enclave, and number of truncations
+    // since then
+    size_t reported_idx = 0;
+    size_t truncations = 0;
+
+    std::shared_ptr<LedgerFile> get_file_from_idx(size_t idx)
+    {
+      if ((idx < start_idx) || (idx > last_idx))
+        return nullptr;
+
+      if (current_file && idx >= current_file->get_start_idx())
+        return current_file;
+
+      for (auto it = read_cache.begin(); it != read_cache.end(); ++it)
+      {
+        auto f = *it;
+        if (idx >= f->get_start_idx() && idx <= f->get_last_idx())
+        {
+          read_cache.splice(read_cache.begin(), read_cache, it);
+          return f;
+        }
+      }
+
+      auto chunk = completed_chunks.lower_bound(idx);
+      if (chunk == completed_chunks.end())
+        return nullptr;
+
+      auto f = std::make_shared<LedgerFile>(ledger_dir, chunk->second);
+      add_to_read_cache(f);
+      return f;
+    }
+
+    void read_framed_entries_from_files(
+      size_t from, size_t to, std::vector<uint8_t>& framed_entries)
+    {
+      framed_entries.reserve(framed_entries_size(from, to));
+
+      auto idx = from;
+      while (idx <= to)
+      {
+        auto f = get_file_from_idx(idx);
+        if (f == nullptr)
+          throw std::logic_error(fmt::format("No ledger file for {}", idx));
+
+        auto to_ = std::min(to, f->get_last_idx());
+        f->read_framed_entries(idx, to_, framed_entries);
+        idx = to_ + 1;
+      }
+    }
+
+    void remove_chunk_file(const std::string& file_name)
+    {
+      auto file_path = fmt::format("{}/{}", ledger_dir, file_name);
+      if (std::remove(file_path.c_str()) != 0)
+      {
+        throw std::logic_error(fmt::format(
+          "Could not remove ledger file {}: {}", file_path, strerror(errno)));
+      }
+    }
+
+    void add_to_read_cache(const std::shared_ptr<LedgerFile>& f)
+    {
+      read_cache.push_front(f);
+      if (read_cache.size() > max_read_cache_files)
+        read_cache.pop_back();
+    }
+
+    void remove_from_read_cache(size_t from_idx)
+    {
+      read_cache.remove_if([from_idx](const auto& f) {
+        return f->get_last_idx() >= from_idx;
+      });
+    }
+
+    // Chunks are created and removed as the ledger grows and is truncated, so
+    // the directory itself must be synchronised for new chunks to survive
+    void sync_dir()
+    {
+      auto fd = ::open(ledger_dir.c_str(), O_RDONLY | O_DIRECTORY);
+      if (fd == -1)
+      {
+        throw std::logic_error(fmt::format(
+          "Unable to open ledger directory {}: {}",
+          ledger_dir,
+          strerror(errno)));
+      }
+
+      auto rc = fsync(fd);
+      close(fd);
+      if (rc != 0)
+      {
+        throw std::logic_error(fmt::format(
+          "Failed to sync ledger directory {}: {}",
+          ledger_dir,
+          strerror(errno)));
+      }
+    }
+
+    void sync_entries()
+    {
+      if (durability != LedgerDurability::none)
+      {
+        if (current_file)
+          current_file->sync();
+
+        if (dir_unsynced)
+          sync_dir();
+      }
+
+      entries_unsynced = false;
+      dir_unsynced = false;
+    }
+
+  public:
+    Ledger(
+      const std::string& ledger_dir,
+      ringbuffer::AbstractWriterFactory& writer_factory,
+      size_t chunk_threshold = ledger_chunk_bytes_default,
+      size_t max_read_cache_files = ledger_max_read_cache_files_default,
+      size_t recent_entries_max_bytes = ledger_recent_entries_bytes_default,
+      LedgerDurability durability = LedgerDurability::batched) :
+      to_enclave(writer_factory.create_writer_to_inside()),
+      ledger_dir(ledger_dir),
+      chunk_threshold(chunk_threshold),
+      max_read_cache_files(max_read_cache_files),
+      durability(durability),
+      recent_entries(recent_entries_max_bytes)
+    {
+      if (mkdir(ledger_dir.c_str(), 0755) != 0 && errno != EEXIST)
+      {
+        throw std::logic_error(fmt::format(
+          "Unable to create ledger directory {}: {}",
+          ledger_dir,
+          strerror(errno)));
+      }
+
+      DIR* dir = opendir(ledger_dir.c_str());
+      if (dir == nullptr)
+      {
+        throw std::logic_error(fmt::format(
+          "Unable to open ledger directory {}: {}",
+          ledger_dir,
+          strerror(errno)));
+      }
+
+      // Only the file names are inspected here: the range of indices held by
+      // each completed chunk is part of its name
+      std::map<size_t, std::string> chunks;
+      while (auto entry = readdir(dir))
+      {
+        std::string file_name(entry->d_name);
+        if (!LedgerFile::is_ledger_file_name(file_name))
+          continue;
+
+        chunks.emplace(
+          LedgerFile::get_start_idx_from_file_name(file_name), file_name);
+      }
+      closedir(dir);
+
+      // The ledger starts after a snapshot if its first chunk does not start
+      // at 1
+      if (!chunks.empty())
+      {
+        start_idx = chunks.begin()->first;
+        last_idx = start_idx - 1;
+      }
+
+      for (auto it = chunks.begin(); it != chunks.end(); ++it)
+      {
+        const auto& [start_idx, file_name] = *it;
+
+        if (start_idx != last_idx + 1)
+        {
+          throw std::logic_error(fmt::format(
+            "Ledger file {} does not follow index {}", file_name, last_idx));
+        }
+
+        auto chunk_last_idx =
+          LedgerFile::get_last_idx_from_file_name(file_name);
+        if (chunk_last_idx.has_value())
+        {
+          completed_chunks.emplace(chunk_last_idx.value(), file_name);
+          last_idx = chunk_last_idx.value();
+        }
+        else
+        {
+          if (std::next(it) != chunks.end())
           {
-            RINGBUFFER_WRITE_MESSAGE(
-              consensus::ledger_entry, to_enclave, entry);
+            throw std::logic_error(
+              fmt::format("Incomplete ledger file {} is not last", file_name));
+          }
+
+          current_file = std::make_shared<LedgerFile>(ledger_dir, file_name);
+          if (current_file->is_complete())
+          {
+            current_file->rename_from(file_name);
+            completed_chunks.emplace(
+              current_file->get_last_idx(), current_file->get_file_name());
+            add_to_read_cache(current_file);
+            last_idx = current_file->get_last_idx();
+            current_file = nullptr;
           }
           else
           {
-            RINGBUFFER_WRITE_MESSAGE(consensus::ledger_no_entry, to_enclave);
+            last_idx = current_file->get_last_idx();
           }
-        });
+        }
+      }
+
+      // Entries found on startup are reported durable as they are
+      reported_idx = last_idx;
+
+      LOG_INFO_FMT(
+        "Opened ledger {}: {} chunks, last index {}",
+        ledger_dir,
+        chunks.size(),
+        last_idx);
+    }
+
+    Ledger(const Ledger& that) = delete;
+
+    ~Ledger()
+    {
+      LOG_INFO_FMT(
+        "Ledger recent entries: {} hits, {} misses",
+        recent_entries.get_hits(),
+        recent_entries.get_misses());
+    }
+
+    size_t get_last_idx()
+    {
+      return last_idx;
+    }
+
+    size_t get_recent_entries_hits() const
+    {
+      return recent_entries.get_hits();
+    }
+
+    size_t get_recent_entries_misses() const
+    {
+      return recent_entries.get_misses();
+    }
+
+    size_t get_chunk_count()
+    {
+      return completed_chunks.size() + (current_file ? 1 : 0);
+    }
+
+    const std::vector<uint8_t> read_entry(size_t idx)
+    {
+      if ((idx < start_idx) || (idx > last_idx))
+        return {};
+
+      auto cached = recent_entries.get(idx, idx);
+      if (cached.has_value())
+      {
+        return {cached->data + sizeof(uint32_t),
+                cached->data + cached->size};
+      }
+
+      auto f = get_file_from_idx(idx);
+      if (f == nullptr)
+        return {};
+
+      return f->read_entry(idx);
+    }
+
+    const std::vector<uint8_t> read_framed_entries(size_t from, size_t to)
+    {
+      std::vector<uint8_t> framed_entries;
+      if ((from < start_idx) || (to < from) || (to > last_idx))
+        return framed_entries;
+
+      auto cached = recent_entries.get(from, to);
+      if (cached.has_value())
+      {
+        framed_entries.assign(cached->data, cached->data + cached->size);
+        return framed_entries;
+      }
+
+      read_framed_entries_from_files(from, to, framed_entries);
+      return framed_entries;
+    }
+
+    /**
+     * Framed entries [from, to], for asynchronous writers. Recently written
+     * entries and ranges held by a single completed chunk are returned without
+     * being copied. Other ranges are read into a buffer owned by the result.
+     */
+    FramedEntries get_framed_entries(size_t from, size_t to)
+    {
+      if ((from < start_idx) || (to < from) || (to > last_idx))
+        return {};
+
+      auto cached = recent_entries.get(from, to);
+      if (cached.has_value())
+        return cached.value();
+
+      auto f = get_file_from_idx(from);
+      if (f != nullptr && to <= f->get_last_idx())
+      {
+        auto view = f->get_framed_entries_view(from, to);
+        if (view.has_value())
+          return view.value();
+      }
+
+      auto framed_entries = std::make_shared<std::vector<uint8_t>>();
+      read_framed_entries_from_files(from, to, *framed_entries);
+      return {framed_entries->data(), framed_entries->size(), framed_entries};
+    }
+
+    size_t framed_entries_size(size_t from, size_t to)
+    {
+      if ((from < start_idx) || (to < from) || (to > last_idx))
+        return 0;
+
+      size_t size = 0;
+      auto idx = from;
+      while (idx <= to)
+      {
+        auto f = get_file_from_idx(idx);
+        if (f == nullptr)
+          throw std::logic_error(fmt::format("No ledger file for {}", idx));
+
+        auto to_ = std::min(to, f->get_last_idx());
+        size += f->framed_entries_size(idx, to_);
+        idx = to_ + 1;
+      }
+
+      return size;
+    }
+
+    size_t entry_size(size_t idx)
+    {
+      auto f = get_file_from_idx(idx);
+      if (f == nullptr)
+        return 0;
+
+      return f->entry_size(idx);
+    }
+
+    /**
+     * Last index end, at most to, such that the framed entries [from, end]
+     * fit in max_size bytes. The entry at from is always included, even if it
+     * is larger than max_size.
+     *
+     * @return The last index of the range, or 0 if from is not in the ledger
+     */
+    size_t get_range_end(size_t from, size_t to, size_t max_size)
+    {
+      if ((from < start_idx) || (to < from) || (from > last_idx))
+        return 0;
+
+      to = std::min(to, last_idx);
+      auto end = from;
+      auto size = framed_entries_size(from, from);
+      while (end < to)
+      {
+        auto next_size = framed_entries_size(end + 1, end + 1);
+        if (size + next_size > max_size)
+          break;
+
+        size += next_size;
+        end++;
+      }
+
+      return end;
+    }
+
+    void write_entry(const uint8_t* data, size_t size)
+    {
+      if (current_file == nullptr)
+      {
+        current_file = std::make_shared<LedgerFile>(ledger_dir, last_idx + 1);
+        dir_unsynced = true;
+      }
+
+      last_idx = current_file->write_entry(data, size);
+      recent_entries.append(last_idx, data, size);
+      entries_unsynced = true;
+
+      LOG_DEBUG_FMT("Ledger write {}: {} bytes", last_idx, size);
+
+      if (durability == LedgerDurability::every_entry)
+        sync_entries();
+
+      if (current_file->get_current_size() >= chunk_threshold)
+      {
+        // The rest of the chunk is made durable now, as it is not written to
+        // again
+        current_file->complete(durability != LedgerDurability::none);
+        completed_chunks.emplace(last_idx, current_file->get_file_name());
+        add_to_read_cache(current_file);
+        current_file = nullptr;
+
+        LOG_DEBUG_FMT("Ledger chunk completed at {}", last_idx);
+      }
+    }
+
+    void truncate(size_t idx)
+    {
+      LOG_DEBUG_FMT("Ledger truncate: {}/{}", idx, last_idx);
+
+      // Reports of durable indices sent before this truncation are stale, and
+      // the enclave relies on this count to discard them
+      truncations++;
+
+      // Truncate the ledger so that idx is its final index
+      if (idx >= last_idx)
+        return;
+
+      remove_from_read_cache(idx + 1);
+      recent_entries.truncate(idx);
+
+      if (current_file)
+      {
+        if (current_file->get_start_idx() > idx)
+        {
+          current_file->remove();
+          current_file = nullptr;
+        }
+        else
+        {
+          current_file->truncate(idx);
+          last_idx = idx;
+          entries_unsynced = true;
+          return;
+        }
+      }
+
+      // Discard completed chunks past idx, and re-open the chunk holding idx
+      // unless idx is its last index
+      auto it = completed_chunks.upper_bound(idx);
+      while (it != completed_chunks.end())
+      {
+        if (LedgerFile::get_start_idx_from_file_name(it->second) > idx)
+        {
+          remove_chunk_file(it->second);
+        }
+        else
+        {
+          current_file = std::make_shared<LedgerFile>(ledger_dir, it->second);
+          current_file->truncate(idx);
+        }
+        it = completed_chunks.erase(it);
+      }
+
+      start_idx = std::min(start_idx, idx + 1);
+      last_idx = idx;
+      entries_unsynced = true;
+      dir_unsynced = true;
+    }
+
+    /**
+     * Discard every entry, so that the ledger continues after idx. This is
+     * used when a snapshot of the state at idx is installed in place of the
+     * entries up to idx.
+     */
+    void reset(size_t idx)
+    {
+      LOG_DEBUG_FMT("Ledger reset: {}/{}", idx, last_idx);
+
+      // As for truncations, reports sent before the reset are stale
+      truncations++;
+
+      read_cache.clear();
+      recent_entries.clear();
+
+      if (current_file)
+      {
+        current_file->remove();
+        current_file = nullptr;
+      }
+
+      for (auto& [chunk_last_idx, file_name] : completed_chunks)
+        remove_chunk_file(file_name);
+      completed_chunks.clear();
+
+      start_idx = idx + 1;
+      last_idx = idx;
+      entries_unsynced = true;
+      dir_unsynced = true;
+    }
+
+    /**
+     * Make the entries written since the last call durable.
+     *
+     * With the batched policy, this issues a single fdatasync for all the
+     * entries written since the last call.
+     *
+     * @return The report to send to the enclave, if the ledger changed
+     */
+    std::optional<DurabilityReport> make_durable()
+    {
+      if (entries_unsynced || dir_unsynced)
+        sync_entries();
+
+      if (last_idx == reported_idx && truncations == 0)
+        return std::nullopt;
+
+      LOG_DEBUG_FMT(
+        "Ledger durable up to {} ({} truncations)", last_idx, truncations);
+
+      DurabilityReport report{last_idx, truncations};
+      reported_idx = last_idx;
+      truncations = 0;
+      return report;
+    }
+
+    /**
+     * Make the entries written since the last call durable and, if the ledger
+     * changed, report its last index to the enclave as durable.
+     */
+    void sync()
+    {
+      auto report = make_durable();
+      if (report.has_value())
+      {
+        RINGBUFFER_WRITE_MESSAGE(
+          consensus::ledger_durable,
+          to_enclave,
+          report->durable_idx,
+          report->truncations);
+      }
     }
   };
-}
\ No newline at end of file
+}
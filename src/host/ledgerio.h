@@ -0,0 +1,324 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the Apache 2.0 License.
+#pragma once
+
+#include "ledger.h"
+
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+namespace asynchost
+{
+  /**
+   * Runs all operations on the ledger on a dedicated thread, so that the uv
+   * loop never waits for the disk.
+   *
+   * Operations are queued, and run in order on the ledger thread. Appends and
+   * truncations are pipelined: they return as soon as they are queued. The
+   * results of reads are passed to callbacks, which run on the uv loop when
+   * process_completions() is called.
+   *
+   * Once the ledger thread has drained its queue, it makes all the entries it
+   * wrote durable at once. Entries appended while the disk is busy are
+   * synchronised together.
+   */
+  class LedgerIO
+  {
+  private:
+    using Task = std::function<void()>;
+
+    Ledger& ledger;
+    ringbuffer::WriterPtr to_enclave;
+
+    std::mutex lock;
+    std::condition_variable cv;
+    // Run on the ledger thread
+    std::deque<Task> requests;
+    // Run on the uv loop
+    std::deque<Task> completions;
+    bool sync_requested = false;
+    bool finished = false;
+
+    // Whether the ledger was modified since the last sync was requested.
+    // Only accessed on the uv loop.
+    bool modified = false;
+
+    std::thread worker;
+
+    void request(Task&& task)
+    {
+      {
+        std::lock_guard<std::mutex> guard(lock);
+        requests.push_back(std::move(task));
+      }
+      cv.notify_one();
+    }
+
+    void complete(Task&& task)
+    {
+      std::lock_guard<std::mutex> guard(lock);
+      completions.push_back(std::move(task));
+    }
+
+    void run()
+    {
+      while (true)
+      {
+        std::deque<Task> batch;
+        bool sync = false;
+
+        {
+          std::unique_lock<std::mutex> guard(lock);
+          cv.wait(guard, [this]() {
+            return finished || sync_requested || !requests.empty();
+          });
+
+          if (finished && !sync_requested && requests.empty())
+            return;
+
+          batch.swap(requests);
+          std::swap(sync, sync_requested);
+        }
+
+        try
+        {
+          for (auto& task : batch)
+            task();
+
+          if (sync)
+          {
+            auto report = ledger.make_durable();
+            if (report.has_value())
+            {
+              complete([this, report = report.value()]() {
+                RINGBUFFER_WRITE_MESSAGE(
+                  consensus::ledger_durable,
+                  to_enclave,
+                  report.durable_idx,
+                  report.truncations);
+              });
+            }
+          }
+        }
+        catch (const std::exception& e)
+        {
+          // Failures are raised on the uv loop, as they were before ledger
+          // operations were moved to their own thread
+          LOG_FAIL_FMT("Ledger operation failed: {}", e.what());
+          complete([e = std::current_exception()]() {
+            std::rethrow_exception(e);
+          });
+          return;
+        }
+      }
+    }
+
+  public:
+    LedgerIO(Ledger& ledger, ringbuffer::AbstractWriterFactory& writer_factory) :
+      ledger(ledger),
+      to_enclave(writer_factory.create_writer_to_inside()),
+      worker([this]() { run(); })
+    {}
+
+    LedgerIO(const LedgerIO& that) = delete;
+
+    ~LedgerIO()
+    {
+      {
+        std::lock_guard<std::mutex> guard(lock);
+        finished = true;
+      }
+      cv.notify_one();
+      worker.join();
+    }
+
+    void write_entry(const uint8_t* data, size_t size)
+    {
+      // The entry is copied, as data only lives as long as the ringbuffer
+      // message it was read from
+      request([this, entry = std::vector<uint8_t>(data, data + size)]() {
+        ledger.write_entry(entry.data(), entry.size());
+      });
+      modified = true;
+    }
+
+    void truncate(size_t idx)
+    {
+      request([this, idx]() { ledger.truncate(idx); });
+      modified = true;
+    }
+
+    void reset(size_t idx)
+    {
+      request([this, idx]() { ledger.reset(idx); });
+      modified = true;
+    }
+
+    /**
+     * Request the entries written so far to be made durable, and reported to
+     * the enclave.
+     */
+    void sync()
+    {
+      if (!modified)
+        return;
+
+      modified = false;
+      {
+        std::lock_guard<std::mutex> guard(lock);
+        sync_requested = true;
+      }
+      cv.notify_one();
+    }
+
+    void read_entry(
+      size_t idx, std::function<void(std::vector<uint8_t>&&)> callback)
+    {
+      request([this, idx, callback = std::move(callback)]() {
+        complete([callback, entry = ledger.read_entry(idx)]() mutable {
+          callback(std::move(entry));
+        });
+      });
+    }
+
+    /**
+     * Read the framed entries [from, to]. The views handed to callback remain
+     * valid while their owner is held, even if the ledger is modified in the
+     * meantime.
+     */
+    void get_framed_entries(
+      size_t from, size_t to, std::function<void(FramedEntries&&)> callback)
+    {
+      request([this, from, to, callback = std::move(callback)]() {
+        auto framed_entries = ledger.get_framed_entries(from, to);
+        complete(
+          [callback, framed_entries = std::move(framed_entries)]() mutable {
+            callback(std::move(framed_entries));
+          });
+      });
+    }
+
+    /**
+     * Read a prefix of the framed entries [from, to], no larger than max_size
+     * bytes. The callback is passed the last index of the prefix, or 0 if
+     * from is not in the ledger.
+     */
+    void get_framed_entries_range(
+      size_t from,
+      size_t to,
+      size_t max_size,
+      std::function<void(size_t, FramedEntries&&)> callback)
+    {
+      request([this, from, to, max_size, callback = std::move(callback)]() {
+        auto end = ledger.get_range_end(from, to, max_size);
+        FramedEntries fe;
+        if (end != 0)
+          fe = ledger.get_framed_entries(from, end);
+
+        complete([callback, end, fe = std::move(fe)]() mutable {
+          callback(end, std::move(fe));
+        });
+      });
+    }
+
+    /**
+     * Run the callbacks of the operations completed by the ledger thread.
+     * Must be called on the uv loop.
+     *
+     * @return Number of callbacks run
+     */
+    size_t process_completions()
+    {
+      std::deque<Task> batch;
+      {
+        std::lock_guard<std::mutex> guard(lock);
+        batch.swap(completions);
+      }
+
+      for (auto& task : batch)
+        task();
+
+      return batch.size();
+    }
+
+    void register_message_handlers(
+      messaging::Dispatcher<ringbuffer::Message>& disp)
+    {
+      DISPATCHER_SET_MESSAGE_HANDLER(
+        disp,
+        consensus::ledger_append,
+        [this](const uint8_t* data, size_t size) { write_entry(data, size); });
+
+      DISPATCHER_SET_MESSAGE_HANDLER(
+        disp,
+        consensus::ledger_truncate,
+        [this](const uint8_t* data, size_t size) {
+          auto idx = serialized::read<consensus::Index>(data, size);
+          truncate(idx);
+        });
+
+      DISPATCHER_SET_MESSAGE_HANDLER(
+        disp,
+        consensus::ledger_reset,
+        [this](const uint8_t* data, size_t size) {
+          auto idx = serialized::read<consensus::Index>(data, size);
+          reset(idx);
+        });
+
+      DISPATCHER_SET_MESSAGE_HANDLER(
+        disp, consensus::ledger_get, [this](const uint8_t* data, size_t size) {
+          // The enclave has asked for a ledger entry.
+          auto [idx] =
+            ringbuffer::read_message<consensus::ledger_get>(data, size);
+
+          read_entry(idx, [this](std::vector<uint8_t>&& entry) {
+            if (entry.size() > 0)
+            {
+              RINGBUFFER_WRITE_MESSAGE(
+                consensus::ledger_entry, to_enclave, entry);
+            }
+            else
+            {
+              RINGBUFFER_WRITE_MESSAGE(consensus::ledger_no_entry, to_enclave);
+            }
+          });
+        });
+
+      DISPATCHER_SET_MESSAGE_HANDLER(
+        disp,
+        consensus::ledger_get_range,
+        [this](const uint8_t* data, size_t size) {
+          // The enclave has asked for a range of ledger entries. As many as
+          // fit in a single message are sent back.
+          auto [from, to] =
+            ringbuffer::read_message<consensus::ledger_get_range>(data, size);
+
+          get_framed_entries_range(
+            from,
+            to,
+            ledger_range_max_bytes,
+            [this, from = from, to = to](
+              size_t end, FramedEntries&& framed_entries) {
+              if (end == 0)
+              {
+                RINGBUFFER_WRITE_MESSAGE(
+                  consensus::ledger_no_entry_range, to_enclave, from, to);
+                return;
+              }
+
+              RINGBUFFER_WRITE_MESSAGE(
+                consensus::ledger_entry_range,
+                to_enclave,
+                from,
+                (consensus::Index)end,
+                serializer::ByteRange{framed_entries.data,
+                                      framed_entries.size});
+            });
+        });
+    }
+  };
+}
@@ -7,6 +7,7 @@
 #include "ds/nonblocking.h"
 #include "ds/oversized.h"
 #include "enclave.h"
+#include "handle_ledgerio.h"
 #include "handle_ringbuffer.h"
 #include "nodeconnections.h"
 #include "notifyconnections.h"
@@ -86,8 +87,35 @@ int main(int argc, char** argv)
     "Address to advertise publicly to clients (defaults to same as "
     "--rpc-address)");
 
-  std::string ledger_file("ccf.ledger");
-  app.add_option("--ledger-file", ledger_file, "Ledger file", true);
+  std::string ledger_dir("ledger");
+  app.add_option("--ledger-dir", ledger_dir, "Ledger directory", true);
+
+  size_t ledger_chunk_max_bytes = asynchost::ledger_chunk_bytes_default;
+  app.add_option(
+    "--ledger-chunk-max-bytes",
+    ledger_chunk_max_bytes,
+    "Size in bytes after which the current ledger file is completed and a "
+    "new one is started. Only the last ledger file is read on startup.",
+    true);
+
+  size_t ledger_recent_entries_max_bytes =
+    asynchost::ledger_recent_entries_bytes_default;
+  app.add_option(
+    "--ledger-recent-entries-max-bytes",
+    ledger_recent_entries_max_bytes,
+    "Size in bytes of the in-memory cache of the most recently written ledger "
+    "entries, from which entries replicated to other nodes are read",
+    true);
+
+  std::string ledger_durability("batched");
+  app.add_set(
+    "--ledger-durability",
+    ledger_durability,
+    {"none", "batched", "every-entry"},
+    "When ledger entries are synchronised to disk. Entries are only "
+    "acknowledged and committed once durable. batched synchronises all the "
+    "entries written in one pass over the enclave messages at once.",
+    true);
 
   std::string host_log_level("info");
   app.add_set(
@@ -156,6 +184,69 @@ int main(int argc, char** argv)
     "set to a significantly lower value than --raft-election-timeout-ms.",
     true);
 
+  size_t raft_max_inflight_batches = 128;
+  app.add_option(
+    "--raft-max-inflight-batches",
+    raft_max_inflight_batches,
+    "Maximum number of batches of entries the Raft leader sends to a follower "
+    "before the follower acknowledges them",
+    true);
+
+  size_t raft_max_inflight_bytes = 1 << 25;
+  app.add_option(
+    "--raft-max-inflight-bytes",
+    raft_max_inflight_bytes,
+    "Maximum size in bytes of the entries the Raft leader sends to a follower "
+    "before the follower acknowledges them",
+    true);
+
+  size_t raft_commit_latency_target = 50;
+  app.add_option(
+    "--raft-commit-latency-target-ms",
+    raft_commit_latency_target,
+    "Target p99 latency in milliseconds between the Raft leader replicating "
+    "an entry and a majority of nodes acknowledging it. The leader batches "
+    "new entries for as long as the observed latency of a majority "
+    "acknowledging them allows. 0, or a latency that already exceeds the "
+    "target, only sends entries once they exceed the size of a batch, or on "
+    "heartbeat.",
+    true);
+
+  bool raft_async_apply = false;
+  app.add_flag(
+    "--raft-async-apply",
+    raft_async_apply,
+    "Raft followers acknowledge entries as soon as they are written to the "
+    "ledger, and apply them to the store on a worker thread. Requires "
+    "--worker_threads to be at least 1.");
+
+  bool raft_leader_lease = false;
+  app.add_flag(
+    "--raft-leader-lease",
+    raft_leader_lease,
+    "The Raft leader answers read-only RPCs locally from the globally "
+    "committed state while it holds a lease, and rejects them otherwise. "
+    "Followers do not vote for a new leader within an election timeout of "
+    "hearing from the current one.");
+
+  size_t raft_lease_clock_drift = 500;
+  app.add_option(
+    "--raft-lease-clock-drift-ms",
+    raft_lease_clock_drift,
+    "Maximum drift in milliseconds between the clocks of any two nodes over "
+    "an election timeout, including the interval between clock ticks. The "
+    "leader lease is shorter than the election timeout by this much.",
+    true);
+
+  size_t raft_snapshot_min_lag = 0;
+  app.add_option(
+    "--raft-snapshot-min-lag",
+    raft_snapshot_min_lag,
+    "Raft followers lagging behind the commit index by at least this many "
+    "entries, including newly joined nodes, are sent a snapshot of the "
+    "committed state instead of the entries. 0 never sends snapshots.",
+    true);
+
   size_t max_msg_size = 24;
   app.add_option(
     "--max-msg-size",
@@ -348,7 +439,15 @@ int main(int argc, char** argv)
 #endif
 
   CCFConfig ccf_config;
-  ccf_config.raft_config = {raft_timeout, raft_election_timeout};
+  ccf_config.raft_config = {raft_timeout,
+                            raft_election_timeout,
+                            raft_max_inflight_batches,
+                            raft_max_inflight_bytes,
+                            raft_commit_latency_target,
+                            raft_async_apply,
+                            raft_leader_lease,
+                            raft_lease_clock_drift,
+                            raft_snapshot_min_lag};
   ccf_config.signature_intervals = {sig_max_tx, sig_max_ms};
   ccf_config.node_info_network = {rpc_address.hostname,
                                   public_rpc_address.hostname,
@@ -410,11 +509,32 @@ int main(int argc, char** argv)
   LOG_INFO_FMT("Created new node");
 
   // ledger
-  asynchost::Ledger ledger(ledger_file, writer_factory);
-  ledger.register_message_handlers(bp.get_dispatcher());
+  auto durability = asynchost::LedgerDurability::batched;
+  if (ledger_durability == "none")
+  {
+    durability = asynchost::LedgerDurability::none;
+  }
+  else if (ledger_durability == "every-entry")
+  {
+    durability = asynchost::LedgerDurability::every_entry;
+  }
+
+  asynchost::Ledger ledger(
+    ledger_dir,
+    writer_factory,
+    ledger_chunk_max_bytes,
+    asynchost::ledger_max_read_cache_files_default,
+    ledger_recent_entries_max_bytes,
+    durability);
+
+  // run ledger operations on their own thread, so that the loop never waits
+  // for the disk
+  asynchost::LedgerIO ledger_io(ledger, writer_factory);
+  ledger_io.register_message_handlers(bp.get_dispatcher());
+  asynchost::HandleLedgerIO handle_ledger_io(ledger_io);
 
   asynchost::NodeConnections node(
-    ledger, writer_factory, node_address.hostname, node_address.port);
+    ledger_io, writer_factory, node_address.hostname, node_address.port);
   node.register_message_handlers(bp.get_dispatcher());
 
   asynchost::NotifyConnections report(
@@ -5,10 +5,11 @@
 #include "consensus/consensustypes.h"
 #include "consensus/pbft/pbfttypes.h"
 #include "consensus/raft/rafttypes.h"
-#include "ledger.h"
+#include "ledgerio.h"
 #include "node/nodetypes.h"
 #include "tcp.h"
 
+#include <deque>
 #include <unordered_map>
 
 namespace asynchost
@@ -167,7 +168,21 @@ namespace asynchost
       }
     };
 
-    Ledger& ledger;
+    // A message to a node, waiting for the ledger entries it carries to be
+    // read
+    struct OutboundMessage
+    {
+      std::vector<uint8_t> data;
+      bool append_entries;
+      std::optional<FramedEntries> framed_entries;
+
+      bool is_ready() const
+      {
+        return !append_entries || framed_entries.has_value();
+      }
+    };
+
+    LedgerIO& ledger_io;
     TCP listener;
     std::unordered_map<ccf::NodeId, TCP> outgoing;
     std::unordered_map<size_t, TCP> incoming;
@@ -175,13 +190,18 @@ namespace asynchost
     size_t next_id = 1;
     ringbuffer::WriterPtr to_enclave;
 
+    // Messages to each node that must wait for the ledger entries of an
+    // earlier append entries message, so that they are sent in order
+    using OutboundQueue = std::deque<std::shared_ptr<OutboundMessage>>;
+    std::unordered_map<ccf::NodeId, OutboundQueue> outbound;
+
   public:
     NodeConnections(
-      Ledger& ledger,
+      LedgerIO& ledger_io,
       ringbuffer::AbstractWriterFactory& writer_factory,
       const std::string& host,
       const std::string& service) :
-      ledger(ledger),
+      ledger_io(ledger_io),
       to_enclave(writer_factory.create_writer_to_inside())
     {
       listener->set_behaviour(std::make_unique<ServerBehaviour>(*this));
@@ -234,37 +254,108 @@ namespace asynchost
 
             const auto& ae =
               serialized::overlay<consensus::AppendEntriesIndex>(p, psize);
-            // Find the total frame size, and write it along with the header.
-            auto count = ae.idx - ae.prev_idx;
-            uint32_t frame = (uint32_t)(
-              size_to_send +
-              ledger.framed_entries_size(ae.prev_idx + 1, ae.idx));
-
-            LOG_DEBUG_FMT(
-              "send AE to {} [{}]: {}, {}", to, frame, ae.idx, ae.prev_idx);
-
-            node.value()->write(sizeof(uint32_t), (uint8_t*)&frame);
-            node.value()->write(size_to_send, data_to_send);
-
-            auto framed_entries =
-              ledger.read_framed_entries(ae.prev_idx + 1, ae.idx);
-            frame = (uint32_t)framed_entries.size();
-            node.value()->write(frame, framed_entries.data());
+
+            LOG_DEBUG_FMT("read AE to {}: {}, {}", to, ae.idx, ae.prev_idx);
+
+            // The entries are read on the ledger thread. The message, and the
+            // ones sent to the same node after it, are queued until then.
+            auto msg = std::make_shared<OutboundMessage>(OutboundMessage{
+              {data_to_send, data_to_send + size_to_send}, true, std::nullopt});
+            outbound[to].push_back(msg);
+
+            ledger_io.get_framed_entries(
+              ae.prev_idx + 1,
+              ae.idx,
+              [this, to, msg](FramedEntries&& framed_entries) {
+                msg->framed_entries = std::move(framed_entries);
+                send_outbound(to);
+              });
           }
           else
           {
-            // Write as framed data to the recipient.
-            uint32_t frame = (uint32_t)size_to_send;
-
-            LOG_DEBUG_FMT("node send to {} [{}]", to, frame);
-
-            node.value()->write(sizeof(uint32_t), (uint8_t*)&frame);
-            node.value()->write(size_to_send, data_to_send);
+            auto q = outbound.find(to);
+            if (q != outbound.end())
+            {
+              q->second.push_back(std::make_shared<OutboundMessage>(
+                OutboundMessage{{data_to_send, data_to_send + size_to_send},
+                                false,
+                                std::nullopt}));
+              return;
+            }
+
+            send(node.value(), to, data_to_send, size_to_send, nullptr);
           }
         });
     }
 
   private:
+    void send(
+      TCP& node,
+      ccf::NodeId to,
+      const uint8_t* data,
+      size_t size,
+      FramedEntries* framed_entries)
+    {
+      if (framed_entries != nullptr)
+      {
+        // Find the total frame size, and write it along with the header.
+        // Completed ledger chunks and recent entries are written without
+        // being copied.
+        uint32_t frame = (uint32_t)(size + framed_entries->size);
+
+        LOG_DEBUG_FMT("send AE to {} [{}]", to, frame);
+
+        node->write(sizeof(uint32_t), (uint8_t*)&frame);
+        node->write(size, data);
+        node->write(
+          framed_entries->size,
+          framed_entries->data,
+          std::move(framed_entries->owner));
+      }
+      else
+      {
+        // Write as framed data to the recipient.
+        uint32_t frame = (uint32_t)size;
+
+        LOG_DEBUG_FMT("node send to {} [{}]", to, frame);
+
+        node->write(sizeof(uint32_t), (uint8_t*)&frame);
+        node->write(size, data);
+      }
+    }
+
+    // Send the queued messages to a node, up to the first one whose ledger
+    // entries have not been read yet
+    void send_outbound(ccf::NodeId to)
+    {
+      auto q = outbound.find(to);
+      if (q == outbound.end())
+        return;
+
+      auto& messages = q->second;
+      while (!messages.empty() && messages.front()->is_ready())
+      {
+        auto& msg = messages.front();
+
+        // The node may have been removed while its entries were read
+        auto node = find(to, true);
+        if (node)
+        {
+          send(
+            node.value(),
+            to,
+            msg->data.data(),
+            msg->data.size(),
+            msg->append_entries ? &msg->framed_entries.value() : nullptr);
+        }
+
+        messages.pop_front();
+      }
+
+      if (messages.empty())
+        outbound.erase(q);
+    }
+
     bool add_node(
       ccf::NodeId node, const std::string& host, const std::string& service)
     {
@@ -312,6 +403,8 @@ namespace asynchost
     {
       LOG_DEBUG_FMT("removing node {}", node);
 
+      outbound.erase(node);
+
       if (outgoing.erase(node) < 1)
       {
         LOG_FAIL_FMT("Cannot remove node {}: does not exist", node);
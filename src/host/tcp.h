@@ -48,6 +48,15 @@ namespace asynchost
       RECONNECTING
     };
 
+    // Memory written by an in-flight write. This is either a copy owned by
+    // the write, or a view kept alive by a reference to its owner.
+    struct WriteData
+    {
+      std::unique_ptr<uint8_t[]> copy;
+      std::shared_ptr<const void> owner;
+      const uint8_t* data;
+    };
+
     struct PendingWrite
     {
       uv_write_t* req;
@@ -142,12 +151,30 @@ namespace asynchost
 
     bool write(size_t len, const uint8_t* data)
     {
-      auto req = new uv_write_t;
-      char* copy = new char[len];
+      auto copy = std::unique_ptr<uint8_t[]>(new uint8_t[len]);
       if (data)
-        memcpy(copy, data, len);
-      req->data = copy;
+        memcpy(copy.get(), data, len);
+
+      auto req = new uv_write_t;
+      req->data = new WriteData{std::move(copy), nullptr, nullptr};
+      return write_req(req, len);
+    }
 
+    /**
+     * Write data without copying it. owner must keep data alive, and is
+     * released once the write has completed.
+     */
+    bool write(
+      size_t len, const uint8_t* data, std::shared_ptr<const void> owner)
+    {
+      auto req = new uv_write_t;
+      req->data = new WriteData{nullptr, std::move(owner), data};
+      return write_req(req, len);
+    }
+
+  private:
+    bool write_req(uv_write_t* req, size_t len)
+    {
       switch (status)
       {
         case CONNECTING_RESOLVING:
@@ -165,6 +192,7 @@ namespace asynchost
         case DISCONNECTED:
         {
           LOG_DEBUG_FMT("Disconnected: Ignoring write of size {}", len);
+          free_write(req);
           break;
         }
 
@@ -178,7 +206,6 @@ namespace asynchost
       return true;
     }
 
-  private:
     bool init()
     {
       assert_status(FRESH, FRESH);
@@ -202,10 +229,11 @@ namespace asynchost
 
     bool send_write(uv_write_t* req, size_t len)
     {
-      char* copy = (char*)req->data;
+      auto write_data = (WriteData*)req->data;
 
       uv_buf_t buf;
-      buf.base = copy;
+      buf.base = write_data->copy ? (char*)write_data->copy.get() :
+                                    (char*)write_data->data;
       buf.len = len;
 
       int rc;
@@ -516,8 +544,8 @@ namespace asynchost
       if (req == nullptr)
         return;
 
-      char* copy = (char*)req->data;
-      delete[] copy;
+      auto write_data = (WriteData*)req->data;
+      delete write_data;
       delete req;
     }
 
@@ -2,6 +2,7 @@
 // Licensed under the Apache 2.0 License.
 #define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
 #include "../ledger.h"
+#include "../ledgerio.h"
 
 #include <doctest/doctest.h>
 #include <string>
@@ -14,14 +15,14 @@ TEST_CASE("Read/Write test")
   const std::vector<uint8_t> e1 = {1, 2, 3};
   const std::vector<uint8_t> e2 = {5, 5, 6, 7};
   {
-    asynchost::Ledger l("testlog", wf);
+    asynchost::Ledger l("testlog_dir", wf);
     l.truncate(0);
     REQUIRE(l.get_last_idx() == 0);
     l.write_entry(e1.data(), e1.size());
     l.write_entry(e2.data(), e2.size());
   }
 
-  asynchost::Ledger l("testlog", wf);
+  asynchost::Ledger l("testlog_dir", wf);
   REQUIRE(l.get_last_idx() == 2);
   auto r1 = l.read_entry(1);
   REQUIRE(e1 == r1);
@@ -37,7 +38,7 @@ TEST_CASE("Entry sizes")
   const std::vector<uint8_t> e1 = {1, 2, 3};
   const std::vector<uint8_t> e2 = {5, 5, 6, 7};
 
-  asynchost::Ledger l("testlog", wf);
+  asynchost::Ledger l("testlog_dir", wf);
   l.truncate(0);
   REQUIRE(l.get_last_idx() == 0);
   l.write_entry(e1.data(), e1.size());
@@ -58,4 +59,543 @@ TEST_CASE("Entry sizes")
     for (auto c : e)
       std::cout << std::hex << (int)c;
     std::cout << std::endl;*/
-}
\ No newline at end of file
+}
+
+TEST_CASE("Chunked ledger")
+{
+  ringbuffer::Circuit eio(2);
+  auto wf = ringbuffer::WriterFactory(eio);
+
+  const std::string ledger_dir = "testlog_chunks";
+  const size_t entry_count = 20;
+  // Small enough that every chunk holds a few entries only
+  const size_t chunk_threshold = 64;
+
+  auto make_entry = [](size_t idx) {
+    return std::vector<uint8_t>(idx, (uint8_t)idx);
+  };
+
+  {
+    asynchost::Ledger l(ledger_dir, wf, chunk_threshold);
+    l.truncate(0);
+    REQUIRE(l.get_last_idx() == 0);
+    for (size_t i = 1; i <= entry_count; ++i)
+    {
+      auto e = make_entry(i);
+      l.write_entry(e.data(), e.size());
+    }
+    REQUIRE(l.get_last_idx() == entry_count);
+    REQUIRE(l.get_chunk_count() > 1);
+  }
+
+  INFO("Entries can be read from every chunk after restart");
+  {
+    asynchost::Ledger l(ledger_dir, wf, chunk_threshold, 2);
+    REQUIRE(l.get_last_idx() == entry_count);
+    for (size_t i = 1; i <= entry_count; ++i)
+    {
+      REQUIRE(l.read_entry(i) == make_entry(i));
+      REQUIRE(l.entry_size(i) == i);
+    }
+    REQUIRE(l.read_entry(entry_count + 1).empty());
+  }
+
+  INFO("Framed entries span chunks");
+  {
+    asynchost::Ledger l(ledger_dir, wf, chunk_threshold);
+    auto framed = l.read_framed_entries(1, entry_count);
+    REQUIRE(framed.size() == l.framed_entries_size(1, entry_count));
+
+    const uint8_t* data = framed.data();
+    size_t size = framed.size();
+    for (size_t i = 1; i <= entry_count; ++i)
+    {
+      auto len = serialized::read<uint32_t>(data, size);
+      REQUIRE(len == i);
+      REQUIRE(std::vector<uint8_t>(data, data + len) == make_entry(i));
+      serialized::skip(data, size, len);
+    }
+    REQUIRE(size == 0);
+  }
+
+  INFO("Truncation across chunks");
+  {
+    asynchost::Ledger l(ledger_dir, wf, chunk_threshold);
+    const size_t truncate_idx = 5;
+    l.truncate(truncate_idx);
+    REQUIRE(l.get_last_idx() == truncate_idx);
+    REQUIRE(l.read_entry(truncate_idx + 1).empty());
+
+    auto e = make_entry(42);
+    l.write_entry(e.data(), e.size());
+    REQUIRE(l.read_entry(truncate_idx + 1) == e);
+  }
+
+  {
+    asynchost::Ledger l(ledger_dir, wf, chunk_threshold);
+    REQUIRE(l.get_last_idx() == 6);
+    for (size_t i = 1; i <= 5; ++i)
+    {
+      REQUIRE(l.read_entry(i) == make_entry(i));
+    }
+    REQUIRE(l.read_entry(6) == make_entry(42));
+
+    l.truncate(0);
+    REQUIRE(l.get_last_idx() == 0);
+    REQUIRE(l.get_chunk_count() == 0);
+  }
+}
+
+TEST_CASE("Reset")
+{
+  ringbuffer::Circuit eio(2);
+  auto wf = ringbuffer::WriterFactory(eio);
+
+  const std::string ledger_dir = "testlog_reset";
+  const size_t chunk_threshold = 64;
+  const std::vector<uint8_t> e(20, 1);
+  const size_t snapshot_idx = 10;
+
+  {
+    asynchost::Ledger l(ledger_dir, wf, chunk_threshold);
+    l.truncate(0);
+    for (size_t i = 0; i < 5; ++i)
+      l.write_entry(e.data(), e.size());
+    REQUIRE(l.get_chunk_count() > 1);
+
+    INFO("Every entry is discarded and the ledger continues after the index");
+    l.reset(snapshot_idx);
+    REQUIRE(l.get_last_idx() == snapshot_idx);
+    REQUIRE(l.get_chunk_count() == 0);
+    REQUIRE(l.read_entry(1).empty());
+    REQUIRE(l.read_entry(snapshot_idx).empty());
+
+    l.write_entry(e.data(), e.size());
+    l.write_entry(e.data(), e.size());
+    REQUIRE(l.read_entry(snapshot_idx + 1) == e);
+    REQUIRE(l.read_framed_entries(snapshot_idx, snapshot_idx + 1).empty());
+  }
+
+  INFO("The ledger starts after the reset index on restart");
+  {
+    asynchost::Ledger l(ledger_dir, wf, chunk_threshold);
+    REQUIRE(l.get_last_idx() == snapshot_idx + 2);
+    REQUIRE(l.read_entry(snapshot_idx).empty());
+    REQUIRE(l.read_entry(snapshot_idx + 2) == e);
+
+    l.truncate(0);
+    REQUIRE(l.get_last_idx() == 0);
+    REQUIRE(l.get_chunk_count() == 0);
+  }
+}
+
+TEST_CASE("Framed entries views")
+{
+  ringbuffer::Circuit eio(2);
+  auto wf = ringbuffer::WriterFactory(eio);
+
+  const std::string ledger_dir = "testlog_views";
+  const size_t chunk_threshold = 64;
+  const std::vector<uint8_t> e = {1, 2, 3, 4, 5, 6, 7, 8, 9, 10};
+
+  // No recent entries are cached, so that all views are over ledger files
+  asynchost::Ledger l(
+    ledger_dir,
+    wf,
+    chunk_threshold,
+    asynchost::ledger_max_read_cache_files_default,
+    0);
+  l.truncate(0);
+  for (size_t i = 0; i < 10; ++i)
+  {
+    l.write_entry(e.data(), e.size());
+  }
+
+  INFO("Views match entries read from the ledger");
+  {
+    for (size_t from = 1; from <= l.get_last_idx(); ++from)
+    {
+      for (size_t to = from; to <= l.get_last_idx(); ++to)
+      {
+        auto view = l.get_framed_entries(from, to);
+        auto framed_entries = l.read_framed_entries(from, to);
+        REQUIRE(view.size == framed_entries.size());
+        REQUIRE(
+          std::vector<uint8_t>(view.data, view.data + view.size) ==
+          framed_entries);
+      }
+    }
+  }
+
+  INFO("Views outlive truncation of the chunk they point to");
+  {
+    auto view = l.get_framed_entries(1, 1);
+    auto framed_entries = l.read_framed_entries(1, 1);
+    REQUIRE(view.size > 0);
+
+    l.truncate(0);
+    REQUIRE(l.get_last_idx() == 0);
+    REQUIRE(
+      std::vector<uint8_t>(view.data, view.data + view.size) ==
+      framed_entries);
+  }
+}
+
+TEST_CASE("Recent entries")
+{
+  ringbuffer::Circuit eio(2);
+  auto wf = ringbuffer::WriterFactory(eio);
+
+  const std::string ledger_dir = "testlog_recent";
+  const size_t entry_count = 100;
+  const size_t entry_size = 10;
+  // Holds roughly the last 20 entries
+  const size_t recent_entries_bytes = 20 * (entry_size + sizeof(uint32_t));
+
+  auto make_entry = [](size_t idx) {
+    return std::vector<uint8_t>(entry_size, (uint8_t)idx);
+  };
+
+  asynchost::Ledger l(
+    ledger_dir,
+    wf,
+    asynchost::ledger_chunk_bytes_default,
+    asynchost::ledger_max_read_cache_files_default,
+    recent_entries_bytes);
+  l.truncate(0);
+  for (size_t i = 1; i <= entry_count; ++i)
+  {
+    auto e = make_entry(i);
+    l.write_entry(e.data(), e.size());
+  }
+
+  INFO("The tail of the ledger is served from memory");
+  {
+    auto framed_entries = l.read_framed_entries(entry_count - 9, entry_count);
+    REQUIRE(l.get_recent_entries_hits() == 1);
+    REQUIRE(l.get_recent_entries_misses() == 0);
+
+    auto view = l.get_framed_entries(entry_count - 9, entry_count);
+    REQUIRE(
+      std::vector<uint8_t>(view.data, view.data + view.size) ==
+      framed_entries);
+    REQUIRE(l.read_entry(entry_count) == make_entry(entry_count));
+    REQUIRE(l.get_recent_entries_hits() == 3);
+  }
+
+  INFO("Older entries are read from the ledger files");
+  {
+    REQUIRE(l.read_entry(1) == make_entry(1));
+    REQUIRE(l.get_recent_entries_misses() == 1);
+  }
+
+  INFO("Truncated entries are no longer served from memory");
+  {
+    l.truncate(entry_count - 1);
+    auto e = make_entry(42);
+    l.write_entry(e.data(), e.size());
+    REQUIRE(l.read_entry(entry_count) == e);
+
+    auto framed_entries = l.read_framed_entries(entry_count - 1, entry_count);
+    const uint8_t* data = framed_entries.data();
+    size_t size = framed_entries.size();
+    auto len = serialized::read<uint32_t>(data, size);
+    REQUIRE(
+      std::vector<uint8_t>(data, data + len) == make_entry(entry_count - 1));
+    serialized::skip(data, size, len);
+    len = serialized::read<uint32_t>(data, size);
+    REQUIRE(std::vector<uint8_t>(data, data + len) == e);
+  }
+}
+
+TEST_CASE("Durability reports")
+{
+  ringbuffer::Circuit eio(1024);
+  auto wf = ringbuffer::WriterFactory(eio);
+  auto to_host = wf.create_writer_to_outside();
+
+  // Returns the durability reports sent to the enclave since the last call
+  auto read_reports = [&eio]() {
+    std::vector<std::pair<consensus::Index, size_t>> reports;
+    eio.read_from_outside().read(
+      -1, [&reports](ringbuffer::Message m, const uint8_t* data, size_t size) {
+        REQUIRE(m == consensus::ledger_durable);
+        auto [idx, truncations] =
+          ringbuffer::read_message<consensus::ledger_durable>(data, size);
+        reports.emplace_back(idx, truncations);
+      });
+    return reports;
+  };
+
+  const std::vector<uint8_t> e = {1, 2, 3};
+
+  for (auto durability : {asynchost::LedgerDurability::none,
+                          asynchost::LedgerDurability::batched,
+                          asynchost::LedgerDurability::every_entry})
+  {
+    asynchost::Ledger l(
+      "testlog_durability",
+      wf,
+      // Small enough that chunks are completed while entries are written
+      64,
+      asynchost::ledger_max_read_cache_files_default,
+      asynchost::ledger_recent_entries_bytes_default,
+      durability);
+    asynchost::LedgerIO ledger_io(l, wf);
+    messaging::BufferProcessor bp("Host");
+    ledger_io.register_message_handlers(bp.get_dispatcher());
+
+    // Requests a sync, and returns the report it sends to the enclave
+    auto sync = [&]() {
+      ledger_io.sync();
+      std::vector<std::pair<consensus::Index, size_t>> reports;
+      while (reports.empty())
+      {
+        ledger_io.process_completions();
+        reports = read_reports();
+        std::this_thread::yield();
+      }
+      REQUIRE(reports.size() == 1);
+      return reports[0];
+    };
+
+    RINGBUFFER_WRITE_MESSAGE(
+      consensus::ledger_truncate, to_host, (consensus::Index)0);
+    bp.read_n(-1, eio.read_from_inside());
+    sync();
+
+    INFO("Entries written in one pass are reported durable at once");
+    for (size_t i = 0; i < 20; ++i)
+    {
+      RINGBUFFER_WRITE_MESSAGE(consensus::ledger_append, to_host, e);
+    }
+    bp.read_n(-1, eio.read_from_inside());
+    REQUIRE(read_reports().empty());
+
+    auto report = sync();
+    REQUIRE(report.first == 20);
+    REQUIRE(report.second == 0);
+
+    INFO("Nothing is reported if the ledger did not change");
+    ledger_io.sync();
+    ledger_io.process_completions();
+    REQUIRE(read_reports().empty());
+
+    INFO("Truncations are counted in the next report");
+    const consensus::Index truncate_idx = 15;
+    RINGBUFFER_WRITE_MESSAGE(consensus::ledger_truncate, to_host, truncate_idx);
+    RINGBUFFER_WRITE_MESSAGE(consensus::ledger_truncate, to_host, truncate_idx);
+    RINGBUFFER_WRITE_MESSAGE(consensus::ledger_append, to_host, e);
+    bp.read_n(-1, eio.read_from_inside());
+    report = sync();
+    REQUIRE(report.first == 16);
+    REQUIRE(report.second == 2);
+  }
+
+  INFO("Durable entries are found on startup");
+  asynchost::Ledger l("testlog_durability", wf, 64);
+  REQUIRE(l.get_last_idx() == 16);
+  REQUIRE(l.read_entry(16) == e);
+}
+
+TEST_CASE("Ledger thread")
+{
+  ringbuffer::Circuit eio(1024);
+  auto wf = ringbuffer::WriterFactory(eio);
+  auto to_host = wf.create_writer_to_outside();
+
+  asynchost::Ledger l("testlog_thread", wf, 64);
+  asynchost::LedgerIO ledger_io(l, wf);
+  messaging::BufferProcessor bp("Host");
+  ledger_io.register_message_handlers(bp.get_dispatcher());
+
+  // Runs the completions of the ledger thread until the enclave is sent a
+  // message, and returns it
+  auto wait_for_message = [&]() {
+    std::optional<std::pair<ringbuffer::Message, std::vector<uint8_t>>> msg;
+    while (!msg.has_value())
+    {
+      ledger_io.process_completions();
+      eio.read_from_outside().read(
+        1, [&msg](ringbuffer::Message m, const uint8_t* data, size_t size) {
+          msg.emplace(m, std::vector<uint8_t>(data, data + size));
+        });
+      std::this_thread::yield();
+    }
+    return msg.value();
+  };
+
+  auto make_entry = [](size_t i) { return std::vector<uint8_t>(i, (uint8_t)i); };
+
+  RINGBUFFER_WRITE_MESSAGE(
+    consensus::ledger_truncate, to_host, (consensus::Index)0);
+  const size_t entry_count = 20;
+  for (size_t i = 1; i <= entry_count; ++i)
+  {
+    RINGBUFFER_WRITE_MESSAGE(consensus::ledger_append, to_host, make_entry(i));
+  }
+  bp.read_n(-1, eio.read_from_inside());
+
+  INFO("Appended entries are reported durable once synced");
+  ledger_io.sync();
+  auto [m, report] = wait_for_message();
+  REQUIRE(m == consensus::ledger_durable);
+  const uint8_t* data = report.data();
+  auto size = report.size();
+  auto [idx, truncations] =
+    ringbuffer::read_message<consensus::ledger_durable>(data, size);
+  REQUIRE(idx == entry_count);
+  REQUIRE(truncations == 1);
+
+  INFO("Reads see all previously queued appends");
+  RINGBUFFER_WRITE_MESSAGE(
+    consensus::ledger_get, to_host, (consensus::Index)entry_count);
+  RINGBUFFER_WRITE_MESSAGE(
+    consensus::ledger_get, to_host, (consensus::Index)(entry_count + 1));
+  bp.read_n(-1, eio.read_from_inside());
+  auto [m_entry, entry] = wait_for_message();
+  REQUIRE(m_entry == consensus::ledger_entry);
+  data = entry.data();
+  size = entry.size();
+  auto [read] = ringbuffer::read_message<consensus::ledger_entry>(data, size);
+  REQUIRE(read == make_entry(entry_count));
+  auto [m_no_entry, no_entry] = wait_for_message();
+  REQUIRE(m_no_entry == consensus::ledger_no_entry);
+
+  INFO("Ranges are read on the ledger thread");
+  RINGBUFFER_WRITE_MESSAGE(
+    consensus::ledger_get_range,
+    to_host,
+    (consensus::Index)1,
+    (consensus::Index)(entry_count + 1));
+  bp.read_n(-1, eio.read_from_inside());
+  auto [m_range, range] = wait_for_message();
+  REQUIRE(m_range == consensus::ledger_entry_range);
+  data = range.data();
+  size = range.size();
+  auto [from, to, framed_range] =
+    ringbuffer::read_message<consensus::ledger_entry_range>(data, size);
+  REQUIRE(from == 1);
+  REQUIRE(to == entry_count);
+  REQUIRE(
+    std::vector<uint8_t>(
+      framed_range.data, framed_range.data + framed_range.size) ==
+    l.read_framed_entries(1, entry_count));
+
+  INFO("Framed entries are handed to the callback");
+  std::optional<asynchost::FramedEntries> framed_entries;
+  ledger_io.get_framed_entries(
+    1, entry_count, [&framed_entries](asynchost::FramedEntries&& fe) {
+      framed_entries = std::move(fe);
+    });
+  while (!framed_entries.has_value())
+  {
+    ledger_io.process_completions();
+    std::this_thread::yield();
+  }
+  REQUIRE(
+    framed_entries->size ==
+    l.read_framed_entries(1, entry_count).size());
+}
+
+TEST_CASE("Range reads")
+{
+  ringbuffer::Circuit eio(1 << 22);
+  auto wf = ringbuffer::WriterFactory(eio);
+  auto to_host = wf.create_writer_to_outside();
+
+  asynchost::Ledger l("testlog_range", wf, 1024);
+  l.truncate(0);
+
+  auto make_entry = [](size_t i) { return std::vector<uint8_t>(i, (uint8_t)i); };
+  const size_t entry_count = 100;
+  for (size_t i = 1; i <= entry_count; ++i)
+  {
+    auto e = make_entry(i);
+    l.write_entry(e.data(), e.size());
+  }
+
+  asynchost::LedgerIO ledger_io(l, wf);
+  messaging::BufferProcessor bp("Host");
+  ledger_io.register_message_handlers(bp.get_dispatcher());
+
+  // Requests the range [from, to] and returns the range sent back, checking
+  // its entries
+  auto get_range = [&](consensus::Index from, consensus::Index to) {
+    RINGBUFFER_WRITE_MESSAGE(consensus::ledger_get_range, to_host, from, to);
+    bp.read_n(-1, eio.read_from_inside());
+
+    std::optional<std::pair<consensus::Index, consensus::Index>> range;
+    // The range is read on the ledger thread, and sent once its completion
+    // is processed
+    bool responded = false;
+    while (!responded)
+    {
+      ledger_io.process_completions();
+      eio.read_from_outside().read(
+        -1, [&](ringbuffer::Message m, const uint8_t* data, size_t size) {
+          responded = true;
+          if (m == consensus::ledger_no_entry_range)
+          {
+            auto [from_, to_] =
+              ringbuffer::read_message<consensus::ledger_no_entry_range>(
+                data, size);
+            REQUIRE(from_ == from);
+            REQUIRE(to_ == to);
+            return;
+          }
+
+          REQUIRE(m == consensus::ledger_entry_range);
+          auto [from_, to_, framed_entries] =
+            ringbuffer::read_message<consensus::ledger_entry_range>(
+              data, size);
+          REQUIRE(from_ == from);
+          REQUIRE(to_ <= to);
+
+          auto d = framed_entries.data;
+          auto s = framed_entries.size;
+          for (auto idx = from_; idx <= to_; ++idx)
+          {
+            auto len = serialized::read<uint32_t>(d, s);
+            REQUIRE(std::vector<uint8_t>(d, d + len) == make_entry(idx));
+            serialized::skip(d, s, len);
+          }
+          REQUIRE(s == 0);
+          range.emplace(from_, to_);
+        });
+      std::this_thread::yield();
+    }
+    return range;
+  };
+
+  INFO("Ranges spanning several chunks are read at once");
+  auto range = get_range(1, entry_count);
+  REQUIRE(range.has_value());
+  REQUIRE(range->second == entry_count);
+
+  INFO("Ranges are truncated at the end of the ledger");
+  range = get_range(entry_count - 5, entry_count + 10);
+  REQUIRE(range.has_value());
+  REQUIRE(range->second == entry_count);
+
+  INFO("Ranges past the end of the ledger have no entries");
+  REQUIRE(!get_range(entry_count + 1, entry_count + 10).has_value());
+  REQUIRE(!get_range(0, 10).has_value());
+
+  INFO("Responses are limited in size");
+  std::vector<uint8_t> large_entry(asynchost::ledger_range_max_bytes / 2, 42);
+  for (size_t i = 0; i < 3; ++i)
+  {
+    l.write_entry(large_entry.data(), large_entry.size());
+  }
+  REQUIRE(
+    l.get_range_end(
+      entry_count, entry_count + 3, asynchost::ledger_range_max_bytes) ==
+    entry_count + 1);
+  REQUIRE(
+    l.get_range_end(
+      entry_count + 1, entry_count + 3, asynchost::ledger_range_max_bytes) ==
+    entry_count + 1);
+  REQUIRE(
+    l.get_range_end(entry_count + 3, entry_count + 3, 1) == entry_count + 3);
+}
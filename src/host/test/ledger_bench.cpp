@@ -0,0 +1,215 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the Apache 2.0 License.
+#define PICOBENCH_IMPLEMENT_WITH_MAIN
+#include "../ledger.h"
+
+#include <picobench/picobench.hpp>
+#include <string>
+
+static constexpr auto ledger_dir = "ledger_bench_dir";
+static constexpr size_t entry_size = 256;
+
+static void write_ledger(size_t entries, size_t chunk_threshold)
+{
+  ringbuffer::Circuit eio(2);
+  auto wf = ringbuffer::WriterFactory(eio);
+
+  asynchost::Ledger l(ledger_dir, wf, chunk_threshold);
+  l.truncate(0);
+
+  std::vector<uint8_t> entry(entry_size, 42);
+  for (size_t i = 0; i < entries; ++i)
+  {
+    l.write_entry(entry.data(), entry.size());
+  }
+}
+
+// Measures the time taken to open a ledger of s.iterations() entries, and to
+// read its last entry
+template <size_t chunk_threshold>
+static void benchmark_startup(picobench::state& s)
+{
+  size_t size = s.iterations();
+  write_ledger(size, chunk_threshold);
+
+  ringbuffer::Circuit eio(2);
+  auto wf = ringbuffer::WriterFactory(eio);
+
+  s.start_timer();
+  asynchost::Ledger l(ledger_dir, wf, chunk_threshold);
+  auto e = l.read_entry(l.get_last_idx());
+  s.stop_timer();
+
+  if (l.get_last_idx() != size || e.size() != entry_size)
+    throw std::logic_error("Unexpected ledger contents");
+
+  s.set_result(l.get_last_idx());
+}
+
+// Measures the time taken to fetch batches of 32 entries from completed
+// chunks, as done when sending append entries to a follower catching up
+template <bool view>
+static void benchmark_read(picobench::state& s)
+{
+  const size_t batch_size = 32;
+  const size_t size = 1 << 14;
+  write_ledger(size, 1024 * 1024);
+
+  ringbuffer::Circuit eio(2);
+  auto wf = ringbuffer::WriterFactory(eio);
+  asynchost::Ledger l(ledger_dir, wf, 1024 * 1024);
+
+  size_t idx = 1;
+  size_t total = 0;
+  s.start_timer();
+  for (auto _ : s)
+  {
+    (void)_;
+    if (idx + batch_size > size)
+      idx = 1;
+
+    if constexpr (view)
+    {
+      auto framed_entries = l.get_framed_entries(idx, idx + batch_size - 1);
+      total += framed_entries.size;
+    }
+    else
+    {
+      auto framed_entries = l.read_framed_entries(idx, idx + batch_size - 1);
+      total += framed_entries.size();
+    }
+    idx += batch_size;
+  }
+  s.stop_timer();
+
+  s.set_result(total);
+}
+
+// Measures the time taken to read the last 32 entries of the ledger, as done
+// by a primary sending the same new entries to each of its backups
+template <size_t recent_entries_bytes>
+static void benchmark_read_tail(picobench::state& s)
+{
+  const size_t batch_size = 32;
+  const size_t size = 1 << 10;
+
+  ringbuffer::Circuit eio(2);
+  auto wf = ringbuffer::WriterFactory(eio);
+  asynchost::Ledger l(
+    ledger_dir,
+    wf,
+    asynchost::ledger_chunk_bytes_default,
+    asynchost::ledger_max_read_cache_files_default,
+    recent_entries_bytes);
+  l.truncate(0);
+
+  std::vector<uint8_t> entry(entry_size, 42);
+  for (size_t i = 0; i < size; ++i)
+  {
+    l.write_entry(entry.data(), entry.size());
+  }
+
+  size_t total = 0;
+  s.start_timer();
+  for (auto _ : s)
+  {
+    (void)_;
+    auto framed_entries = l.get_framed_entries(size - batch_size + 1, size);
+    total += framed_entries.size;
+  }
+  s.stop_timer();
+
+  s.set_result(total);
+}
+
+// Measures the time taken to write s.iterations() entries and make them
+// durable. As on the host, sync() is called after each pass over the messages
+// from the enclave, which holds at most 128 entries.
+template <asynchost::LedgerDurability durability>
+static void benchmark_write(picobench::state& s)
+{
+  const size_t entries_per_pass = 128;
+
+  ringbuffer::Circuit eio(1 << 12);
+  auto wf = ringbuffer::WriterFactory(eio);
+  asynchost::Ledger l(
+    ledger_dir,
+    wf,
+    asynchost::ledger_chunk_bytes_default,
+    asynchost::ledger_max_read_cache_files_default,
+    asynchost::ledger_recent_entries_bytes_default,
+    durability);
+  l.truncate(0);
+
+  std::vector<uint8_t> entry(entry_size, 42);
+  size_t written = 0;
+  s.start_timer();
+  for (auto _ : s)
+  {
+    (void)_;
+    l.write_entry(entry.data(), entry.size());
+    if (++written % entries_per_pass == 0)
+    {
+      l.sync();
+      // Discard the durability report sent to the enclave
+      eio.read_from_outside().read(-1, [](auto, auto, auto) {});
+    }
+  }
+  l.sync();
+  s.stop_timer();
+
+  s.set_result(l.get_last_idx());
+}
+
+const std::vector<int> sizes = {1 << 10, 1 << 13, 1 << 16};
+
+// A single chunk must be scanned in full on startup, as the unchunked ledger
+// used to be
+PICOBENCH_SUITE("startup");
+auto bench_startup_single_chunk = benchmark_startup<SIZE_MAX>;
+PICOBENCH(bench_startup_single_chunk).iterations(sizes).samples(5).baseline();
+auto bench_startup_1mb_chunks = benchmark_startup<1024 * 1024>;
+PICOBENCH(bench_startup_1mb_chunks).iterations(sizes).samples(5);
+auto bench_startup_default_chunks =
+  benchmark_startup<asynchost::ledger_chunk_bytes_default>;
+PICOBENCH(bench_startup_default_chunks).iterations(sizes).samples(5);
+
+const std::vector<int> read_iterations = {1 << 8, 1 << 12};
+
+PICOBENCH_SUITE("read");
+auto bench_read_copy = benchmark_read<false>;
+PICOBENCH(bench_read_copy).iterations(read_iterations).samples(5).baseline();
+auto bench_read_view = benchmark_read<true>;
+PICOBENCH(bench_read_view).iterations(read_iterations).samples(5);
+
+PICOBENCH_SUITE("read tail");
+auto bench_read_tail_from_file = benchmark_read_tail<0>;
+PICOBENCH(bench_read_tail_from_file)
+  .iterations(read_iterations)
+  .samples(5)
+  .baseline();
+auto bench_read_tail_recent_entries =
+  benchmark_read_tail<asynchost::ledger_recent_entries_bytes_default>;
+PICOBENCH(bench_read_tail_recent_entries)
+  .iterations(read_iterations)
+  .samples(5);
+
+const std::vector<int> write_iterations = {1 << 8, 1 << 11};
+
+PICOBENCH_SUITE("write");
+auto bench_write_durability_none =
+  benchmark_write<asynchost::LedgerDurability::none>;
+PICOBENCH(bench_write_durability_none)
+  .iterations(write_iterations)
+  .samples(5)
+  .baseline();
+auto bench_write_durability_batched =
+  benchmark_write<asynchost::LedgerDurability::batched>;
+PICOBENCH(bench_write_durability_batched)
+  .iterations(write_iterations)
+  .samples(5);
+auto bench_write_durability_every_entry =
+  benchmark_write<asynchost::LedgerDurability::every_entry>;
+PICOBENCH(bench_write_durability_every_entry)
+  .iterations(write_iterations)
+  .samples(5);
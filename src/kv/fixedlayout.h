@@ -0,0 +1,39 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the Apache 2.0 License.
+#pragma once
+
+#include <type_traits>
+
+namespace kv
+{
+  /** Keys and values that are serialised as their in-memory representation.
+   *
+   * Types for which this is true (see DECLARE_KV_FIXED_LAYOUT) are written to
+   * the ledger as a single binary blob of sizeof(T) bytes, and are read back
+   * with a bounds check and a memcpy, rather than being packed and unpacked
+   * field by field. Since the encoding depends on the layout of the type, it
+   * is only suitable for trivially copyable types without padding whose
+   * definition does not change over the lifetime of a service. All other
+   * types are serialised as before.
+   */
+  template <typename T>
+  struct is_fixed_layout : std::false_type
+  {};
+
+  template <typename T>
+  inline constexpr bool is_fixed_layout_v =
+    is_fixed_layout<std::remove_cv_t<std::remove_reference_t<T>>>::value;
+}
+
+// Must be used at global scope, after the type is complete
+#define DECLARE_KV_FIXED_LAYOUT(TYPE) \
+  template <> \
+  struct kv::is_fixed_layout<TYPE> : std::true_type \
+  { \
+    static_assert( \
+      std::is_trivially_copyable_v<TYPE>, \
+      #TYPE " must be trivially copyable to have a fixed layout"); \
+    static_assert( \
+      std::has_unique_object_representations_v<TYPE>, \
+      #TYPE " must not contain padding to have a fixed layout"); \
+  };
@@ -68,6 +68,11 @@ namespace kv
     // must only be set by set_current_domain, since it affects current_writer
     SecurityDomain current_domain;
 
+    // Each map is written as a section that starts with its size, so that
+    // maps can be deserialised independently. This is the position of the
+    // size of the map being written, in current_writer.
+    std::optional<size_t> current_section;
+
     template <typename T>
     void serialise_internal(T&& t)
     {
@@ -80,6 +85,15 @@ namespace kv
       public_writer.append(std::forward<T>(t));
     }
 
+    void end_map()
+    {
+      if (current_section.has_value())
+      {
+        current_writer->end_section(current_section.value());
+        current_section.reset();
+      }
+    }
+
     void set_current_domain(SecurityDomain domain)
     {
       switch (domain)
@@ -115,11 +129,14 @@ namespace kv
           "Private map {} cannot be serialised without an encryptor", name));
       }
 
+      end_map();
+
       if (domain != current_domain)
         set_current_domain(domain);
 
       serialise_internal(KvOperationType::KOT_MAP_START_INDICATOR);
       serialise_internal(name);
+      current_section = current_writer->start_section();
     }
 
     template <class Version>
@@ -133,6 +150,11 @@ namespace kv
       serialise_internal(ctr);
     }
 
+    void serialise_raw(const std::vector<uint8_t>& raw)
+    {
+      serialise_internal(raw);
+    }
+
     template <class K>
     void serialise_read(const K& k, const Version& version)
     {
@@ -171,67 +193,57 @@ namespace kv
 
     std::vector<uint8_t> get_raw_data()
     {
+      end_map();
+
       // make sure the private buffer is empty when we return
       auto writer_guard_func = [](W* writer) { writer->clear(); };
       std::unique_ptr<decltype(private_writer), decltype(writer_guard_func)>
         writer_guard(&private_writer, writer_guard_func);
 
-      auto serialised_public_domain = public_writer.get_raw_data();
-
       // If no crypto util is set, all maps have been serialised by the public
       // writer.
       if (!crypto_util)
       {
-        return serialised_public_domain;
+        return public_writer.get_raw_data();
       }
 
-      auto serialised_private_domain = private_writer.get_raw_data();
-
       return serialise_domains(
-        serialised_public_domain, serialised_private_domain);
+        public_writer.get_raw_data_view(), private_writer.get_raw_data_view());
     }
 
     std::vector<uint8_t> serialise_domains(
-      const std::vector<uint8_t>& serialised_public_domain,
-      const std::vector<uint8_t>& serialised_private_domain =
-        std::vector<uint8_t>())
+      CBuffer serialised_public_domain, CBuffer serialised_private_domain = {})
     {
-      std::vector<uint8_t> serialised_tx;
-      std::vector<uint8_t> serialised_hdr;
-      std::vector<uint8_t> encrypted_private_domain(
-        serialised_private_domain.size());
-
-      crypto_util->encrypt(
-        serialised_private_domain,
-        serialised_public_domain,
-        serialised_hdr,
-        encrypted_private_domain,
-        version);
-
       // Serialise entire tx
       // Format: gcm hdr (iv + tag) + len of public domain + public domain +
       // encrypted privated domain
-      auto space = serialised_hdr.size() + sizeof(size_t) +
-        serialised_public_domain.size() + encrypted_private_domain.size();
-      serialised_tx.resize(space);
+      // The transaction is written once, into a buffer of its final size. The
+      // private domain is encrypted straight into it, rather than into a
+      // separate buffer that would then be copied.
+      const auto hdr_size = crypto_util->get_header_length();
+      auto space = hdr_size + sizeof(size_t) + serialised_public_domain.n +
+        serialised_private_domain.n;
+      std::vector<uint8_t> serialised_tx(space);
       auto data_ = serialised_tx.data();
 
-      serialized::write(
-        data_, space, serialised_hdr.data(), serialised_hdr.size());
-      serialized::write(data_, space, serialised_public_domain.size());
+      auto serialised_hdr = data_;
+      data_ += hdr_size;
+      space -= hdr_size;
+
+      serialized::write(data_, space, serialised_public_domain.n);
+      auto public_domain = data_;
       serialized::write(
         data_,
         space,
-        serialised_public_domain.data(),
-        serialised_public_domain.size());
-      if (encrypted_private_domain.size() > 0)
-      {
-        serialized::write(
-          data_,
-          space,
-          encrypted_private_domain.data(),
-          encrypted_private_domain.size());
-      }
+        serialised_public_domain.p,
+        serialised_public_domain.n);
+
+      crypto_util->encrypt(
+        serialised_private_domain,
+        {public_domain, serialised_public_domain.n},
+        serialised_hdr,
+        data_,
+        version);
 
       return serialised_tx;
     }
@@ -288,6 +300,30 @@ namespace kv
       return KvOperationType::KOT_NOT_SUPPORTED;
     }
 
+    // Reads the name of the next map and the size of its section
+    std::optional<std::pair<std::string, size_t>> read_map_header()
+    {
+      if (current_reader->is_eos())
+      {
+        if (current_reader == &public_reader && !private_reader.is_eos())
+          current_reader = &private_reader;
+        else
+          return {};
+      }
+
+      if (!try_read_op(KvOperationType::KOT_MAP_START_INDICATOR))
+      {
+        return {};
+      }
+
+      auto name = current_reader->template read_next<std::string>();
+      auto size = current_reader->template read_next<uint64_t>();
+      if (size > current_reader->remaining())
+        return {};
+
+      return std::make_pair(std::move(name), size);
+    }
+
   public:
     GenericDeserialiseWrapper(
       std::shared_ptr<AbstractTxEncryptor> e,
@@ -357,21 +393,37 @@ namespace kv
 
     std::optional<std::string> start_map()
     {
-      if (current_reader->is_eos())
-      {
-        if (current_reader == &public_reader && !private_reader.is_eos())
-          current_reader = &private_reader;
-        else
-          return {};
-      }
+      auto header = read_map_header();
+      if (!header.has_value())
+        return {};
 
-      if (!try_read_op(KvOperationType::KOT_MAP_START_INDICATOR))
-      {
+      return std::move(header->first);
+    }
+
+    using MapSection =
+      std::pair<std::string, std::unique_ptr<GenericDeserialiseWrapper>>;
+
+    /** Reads the name of the next map, and skips past its contents.
+     *
+     * The contents are read by the returned deserialiser instead, which
+     * refers to the data of this one but can be used concurrently with it
+     * and with the deserialisers of other maps.
+     */
+    std::optional<MapSection> start_map_section()
+    {
+      auto header = read_map_header();
+      if (!header.has_value())
         return {};
-      }
 
-      return std::optional<std::string>{
-        current_reader->template read_next<std::string>()};
+      auto& [name, size] = header.value();
+      auto section = std::make_unique<GenericDeserialiseWrapper>(
+        crypto_util, domain_restriction);
+      section->version = version;
+      section->public_reader.init_section(*current_reader, size);
+      section->current_reader = &section->public_reader;
+      current_reader->skip(size);
+
+      return std::make_pair(std::move(name), std::move(section));
     }
 
     template <class Version>
@@ -380,6 +432,11 @@ namespace kv
       return current_reader->template read_next<Version>();
     }
 
+    std::vector<uint8_t> deserialise_raw()
+    {
+      return current_reader->template read_next<std::vector<uint8_t>>();
+    }
+
     uint64_t deserialise_read_header()
     {
       return current_reader->template read_next<uint64_t>();
@@ -2,11 +2,16 @@
 // Licensed under the Apache 2.0 License.
 #pragma once
 
+#include "ds/arena.h"
 #include "ds/champmap.h"
 #include "ds/logger.h"
+#include "ds/rbmap.h"
 #include "ds/spinlock.h"
 #include "kvtypes.h"
 
+#include <algorithm>
+#include <deque>
+#include <exception>
 #include <functional>
 #include <iostream>
 #include <limits>
@@ -51,13 +56,32 @@ namespace kv
     }
   }
 
+  /** Committed state kept by the maps of a store for historical reads.
+   *
+   * Maps normally discard their states before the latest globally committed
+   * version. A store with a retention window keeps them instead, so that
+   * transactions can read the store as of any committed version in the window
+   * (see Tx::set_read_historical). States are evicted oldest first, once they
+   * fall out of the window or once the writes they hold exceed the budget of
+   * their map. Since states are persistent, a retained state only costs the
+   * entries written at its version.
+   */
+  struct HistoryRetention
+  {
+    // Number of versions before the latest globally committed version that
+    // can be read
+    Version versions = 0;
+    // Maximum number of writes retained by each map
+    size_t max_writes = std::numeric_limits<size_t>::max();
+  };
+
   template <class S, class D>
   class Tx;
 
   template <class S, class D>
   class Store;
 
-  template <class K, class V, class H, class S, class D>
+  template <class K, class V, class H, class S, class D, bool Ordered = false>
   class Map : public AbstractMap<S, D>
   {
   public:
@@ -75,43 +99,128 @@ namespace kv
       VersionV(Version ver, V val) : version(ver), value(val) {}
     };
 
-    using State = champ::Map<K, VersionV, H>;
-    using Read = std::unordered_map<K, Version, H>;
+    // Ordered maps support range queries, at the cost of slower lookups
+    using State = std::conditional_t<
+      Ordered,
+      RBMap<K, VersionV>,
+      champ::Map<K, VersionV, H>>;
+    // Reads are only needed until the transaction completes, and are
+    // allocated from its arena
+    using Read = std::unordered_map<
+      K,
+      Version,
+      H,
+      std::equal_to<K>,
+      ds::ArenaAllocator<std::pair<const K, Version>>>;
     using Write = std::unordered_map<K, VersionV, H>;
     /// Signature for transaction commit handlers
     using CommitHook = std::function<void(Version, const State&, const Write&)>;
+    /// Signature for batched global commit handlers, called with the first
+    /// and last versions that changed the map, the state at the last version,
+    /// and the writes of all these versions merged into one write set
+    using BatchedCommitHook =
+      std::function<void(Version, Version, const State&, const Write&)>;
 
   private:
-    using This = Map<K, V, H, S, D>;
+    using This = Map<K, V, H, S, D, Ordered>;
+
+    // Applies a batch of writes to an ordered state, one put at a time
+    struct OrderedBatch
+    {
+      State state;
+
+      explicit OrderedBatch(const State& state_) : state(state_) {}
+
+      const VersionV* getp(const K& key) const
+      {
+        return state.getp(key);
+      }
+
+      void put(const K& key, const VersionV& value)
+      {
+        state = state.put(key, value);
+      }
+
+      State persistent()
+      {
+        return std::move(state);
+      }
+    };
+
+    // Unordered states apply batches through a transient, which updates the
+    // nodes it has already copied in place
+    using StateBatch = std::conditional_t<
+      Ordered,
+      OrderedBatch,
+      champ::TransientMap<K, VersionV, H>>;
+
+    // The state of a secondary index at a given version
+    struct IndexState
+    {
+      virtual ~IndexState() {}
+    };
+    using IndexStates = std::vector<std::shared_ptr<const IndexState>>;
+
+    class AbstractIndex
+    {
+    public:
+      virtual ~AbstractIndex() {}
+      virtual std::shared_ptr<const IndexState> build(
+        const State& state) const = 0;
+      virtual std::shared_ptr<const IndexState> update(
+        const std::shared_ptr<const IndexState>& index_state,
+        const State& state,
+        const Write& writes) const = 0;
+    };
 
     struct LocalCommit
     {
       Version version;
       State state;
       Write writes;
+      IndexStates indexes;
+      // Number of writes, which are handed to the global hook on compaction
+      size_t write_count = 0;
     };
     using LocalCommits = std::list<LocalCommit>;
 
+    // Globally committed state, retained after compaction for historical reads
+    struct HistoricalState
+    {
+      Version version;
+      State state;
+      IndexStates indexes;
+      size_t write_count;
+    };
+    using HistoricalStates = std::deque<HistoricalState>;
+
     Store<S, D>* store;
     std::string name;
+    MapHandle handle;
     size_t rollback_counter;
     std::unique_ptr<LocalCommits> roll;
     CommitHook local_hook;
     CommitHook global_hook;
+    std::vector<BatchedCommitHook> batched_global_hooks;
     LocalCommits commit_deltas;
+    HistoricalStates history;
+    size_t history_write_count = 0;
     SpinLock sl;
     const SecurityDomain security_domain;
     const bool replicated;
+    std::vector<std::unique_ptr<AbstractIndex>> indexes;
 
     Map(
       Store<S, D>* store_,
       std::string name_,
+      MapHandle handle_,
       SecurityDomain security_domain_,
       bool replicated_,
       CommitHook local_hook_,
       CommitHook global_hook_) :
       store(store_),
       name(name_),
+      handle(handle_),
       roll(std::make_unique<LocalCommits>()),
       rollback_counter(0),
       security_domain(security_domain_),
@@ -133,7 +242,7 @@ namespace kv
         throw std::logic_error("Failed to cast store in Map clone");
 
       return new Map(
-        store_, name, security_domain, replicated, nullptr, nullptr);
+        store_, name, handle, security_domain, replicated, nullptr, nullptr);
     }
 
     /** Get the name of the map
@@ -154,6 +263,15 @@ namespace kv
       return store;
     }
 
+    /** Get the handle of the map in its store
+     *
+     * @return Handle, unique among the maps of the store
+     */
+    MapHandle get_handle() override
+    {
+      return handle;
+    }
+
     /** Set handler to be called on local transaction commit
      *
      * @param hook function to be called on local transaction commit
@@ -174,6 +292,21 @@ namespace kv
       global_hook = hook;
     }
 
+    /** Add a handler to be called on global commit, with batched writes
+     *
+     * Rather than once per version, batched handlers are called once per
+     * compaction of the store, with the writes of all newly globally committed
+     * versions. The merged write set is built once and shared by all batched
+     * handlers of the map. Each key maps to its latest write.
+     *
+     * @param hook function to be called on global commit
+     */
+    void add_batched_global_hook(BatchedCommitHook hook)
+    {
+      std::lock_guard<SpinLock> guard(sl);
+      batched_global_hooks.push_back(hook);
+    }
+
     /** Get security domain of a Map
      *
      * @return Security domain of the map (affects serialisation)
@@ -250,6 +383,169 @@ namespace kv
       return !(*this == that);
     }
 
+    class Snapshot : public AbstractMap<S, D>::Snapshot
+    {
+    private:
+      const std::string name;
+      const SecurityDomain security_domain;
+      const Version version;
+      const State state;
+
+    public:
+      Snapshot(
+        const std::string& name_,
+        SecurityDomain security_domain_,
+        Version version_,
+        const State& state_) :
+        name(name_),
+        security_domain(security_domain_),
+        version(version_),
+        state(state_)
+      {}
+
+      void serialise(S& s) override
+      {
+        s.start_map(name, security_domain);
+        s.serialise_read_version(version);
+
+        // Deleted keys are kept, with their (negative) versions, so that the
+        // installed state is identical to this one
+        s.serialise_count_header(state.size());
+        state.foreach([&s](const K& k, const VersionV& v) {
+          s.serialise_write_version(k, v.value, v.version);
+          return true;
+        });
+      }
+    };
+
+    /** Secondary index over the values of a Map
+     *
+     * Maps index keys, extracted from each entry of the Map, to the keys of
+     * those entries. It is derived state: it is updated as transactions are
+     * committed on the Map, and is never serialised.
+     */
+    template <class IK, class IH = std::hash<IK>>
+    class Index : public AbstractIndex
+    {
+    public:
+      using Extractor = std::function<IK(const K&, const V&)>;
+
+    private:
+      friend This;
+
+      // Only the keys of a set are used. A set is dropped once it is empty.
+      using KeySet = champ::Map<K, bool, H>;
+
+      struct Keys : public IndexState
+      {
+        champ::Map<IK, KeySet, IH> keys;
+      };
+
+      const size_t position;
+      const Extractor extract;
+
+      Index(size_t position_, Extractor extract_) :
+        position(position_),
+        extract(extract_)
+      {}
+
+      static void add(Keys& index, const IK& ik, const K& k)
+      {
+        auto search = index.keys.getp(ik);
+        auto keys = (search == nullptr) ? KeySet() : *search;
+        index.keys = index.keys.put(ik, keys.put(k, true));
+      }
+
+      static void remove(Keys& index, const IK& ik, const K& k)
+      {
+        auto search = index.keys.getp(ik);
+        if (search == nullptr)
+          return;
+
+        auto keys = search->remove(k);
+        if (keys.empty())
+          index.keys = index.keys.remove(ik);
+        else
+          index.keys = index.keys.put(ik, keys);
+      }
+
+      // Views created before the index was added do not have its state, which
+      // is then built from the state they read
+      const Keys& get_state(
+        IndexStates& index_states, const State& state) const
+      {
+        if (index_states.size() <= position)
+          index_states.resize(position + 1);
+
+        auto& index_state = index_states[position];
+        if (index_state == nullptr)
+          index_state = build(state);
+
+        return static_cast<const Keys&>(*index_state);
+      }
+
+    public:
+      std::shared_ptr<const IndexState> build(
+        const State& state) const override
+      {
+        auto index = std::make_shared<Keys>();
+        state.foreach([this, &index](const K& k, const VersionV& v) {
+          if (!deleted(v.version))
+            add(*index, extract(k, v.value), k);
+          return true;
+        });
+        return index;
+      }
+
+      std::shared_ptr<const IndexState> update(
+        const std::shared_ptr<const IndexState>& index_state,
+        const State& state,
+        const Write& writes) const override
+      {
+        auto index =
+          std::make_shared<Keys>(static_cast<const Keys&>(*index_state));
+
+        for (auto& [k, v] : writes)
+        {
+          // Remove the key from the index entry of its previous value...
+          auto previous = state.getp(k);
+          if (previous != nullptr && !deleted(previous->version))
+            remove(*index, extract(k, previous->value), k);
+
+          // ...and add it to the one of its new value.
+          if (!deleted(v.version))
+            add(*index, extract(k, v.value), k);
+        }
+
+        return index;
+      }
+    };
+
+    /** Add a secondary index to the Map
+     *
+     * The index is built from the current state of the Map, and is then
+     * maintained as transactions are committed.
+     *
+     * @param extract function returning the index key of an entry
+     *
+     * @return Index, to be queried with `TxView::get_by_index`
+     */
+    template <class IK, class IH = std::hash<IK>>
+    Index<IK, IH>& add_index(typename Index<IK, IH>::Extractor extract)
+    {
+      std::lock_guard<SpinLock> guard(sl);
+
+      auto index = new Index<IK, IH>(indexes.size(), extract);
+      indexes.emplace_back(index);
+
+      for (auto& r : *roll)
+        r.indexes.push_back(index->build(r.state));
+      for (auto& h : history)
+        h.indexes.push_back(index->build(h.state));
+
+      return *index;
+    }
+
     class TxView : public AbstractTxView<S, D>
     {
       friend Map;
@@ -258,8 +554,11 @@ namespace kv
     private:
       This& map;
       State state;
+      IndexStates index_states;
       State committed;
       Read reads;
+      // Key ranges read by an ordered map, as [from, to)
+      std::vector<std::pair<K, std::optional<K>>> ranges;
       Write writes;
       Version start_version;
       size_t rollback_counter;
@@ -268,10 +567,17 @@ namespace kv
       bool changes;
       bool deserialised;
       bool committed_writes;
-
-      TxView(This& parent, State& s, Version v, size_t r) :
+      bool read_only;
+
+      TxView(
+        This& parent,
+        State& s,
+        const IndexStates& is,
+        Version v,
+        size_t r) :
         map(parent),
         state(s),
+        index_states(is),
         committed(parent.roll->front().state),
         start_version(v),
         rollback_counter(r),
@@ -279,7 +585,8 @@ namespace kv
         commit_version(NoVersion),
         changes(false),
         deserialised(false),
-        committed_writes(false)
+        committed_writes(false),
+        read_only(false)
       {}
 
     public:
@@ -326,16 +633,20 @@ namespace kv
 
         // If the key doesn't exist, return empty and record that we depend on
         // the key not existing.
+        // Read-only views read a consistent state and are never validated, so
+        // they do not record reads.
         auto search = state.get(key);
         if (!search.has_value())
         {
-          reads.insert(std::make_pair(key, NoVersion));
+          if (!read_only)
+            reads.insert(std::make_pair(key, NoVersion));
           return {};
         }
 
         // Record the version that we depend on.
         auto& found = search.value();
-        reads.insert(std::make_pair(key, found.version));
+        if (!read_only)
+          reads.insert(std::make_pair(key, found.version));
 
         // If the key has been deleted, return empty.
         if (deleted(found.version))
@@ -392,6 +703,9 @@ namespace kv
         if (commit_version != NoVersion)
           return false;
 
+        if (read_only)
+          throw std::logic_error("Cannot write in a read-only transaction");
+
         // Record in the write set.
         writes[key] = {0, value};
         return true;
@@ -411,6 +725,9 @@ namespace kv
         if (commit_version != NoVersion)
           return false;
 
+        if (read_only)
+          throw std::logic_error("Cannot write in a read-only transaction");
+
         auto write = writes.find(key);
         auto search = state.get(key).has_value();
 
@@ -475,6 +792,88 @@ namespace kv
         return true;
       }
 
+      /** Iterate in key order over entries with keys in a range
+       *
+       * Only available on ordered maps. The transaction will conflict with
+       * any transaction writing a key in the range.
+       *
+       * @param from Lower bound of the range, inclusive
+       * @param to Upper bound of the range, exclusive
+       * @param F functor, taking a key and a value, return value determines
+       * whether the iteration should continue (true) or stop (false)
+       */
+      template <class F>
+      bool range(const K& from, const K& to, F&& f)
+      {
+        return range_internal(from, to, std::forward<F>(f));
+      }
+
+      /** Iterate in key order over entries whose key starts with a prefix
+       *
+       * Only available on ordered maps with string keys. The transaction will
+       * conflict with any transaction writing a key with this prefix.
+       *
+       * @param prefix Key prefix
+       * @param F functor, taking a key and a value, return value determines
+       * whether the iteration should continue (true) or stop (false)
+       */
+      template <class F>
+      bool foreach_prefix(const K& prefix, F&& f)
+      {
+        // Keys with this prefix are those below the prefix with its last
+        // non-maximal character incremented, if any.
+        auto end = prefix;
+        while (!end.empty() && static_cast<unsigned char>(end.back()) == 0xff)
+          end.pop_back();
+
+        if (end.empty())
+          return range_internal(prefix, std::nullopt, std::forward<F>(f));
+
+        end.back() = static_cast<unsigned char>(end.back()) + 1;
+        return range_internal(prefix, end, std::forward<F>(f));
+      }
+
+      /** Get the keys of the entries with an index key
+       *
+       * This reads the index as of the version the transaction started from,
+       * along with the writes in the transaction. The transaction will
+       * conflict with any transaction writing to the map.
+       *
+       * @param index Index of the map, as returned by `Map::add_index`
+       * @param ik Index key
+       *
+       * @return Keys of the entries with that index key, in no specific order
+       */
+      template <class IK, class IH>
+      std::vector<K> get_by_index(const Index<IK, IH>& index, const IK& ik)
+      {
+        if (commit_version != NoVersion)
+          return {};
+
+        // Record a global read dependency.
+        read_version = start_version;
+
+        std::vector<K> keys;
+        auto search = index.get_state(index_states, state).keys.getp(ik);
+        if (search != nullptr)
+        {
+          auto& w = writes;
+          search->foreach([&w, &keys](const K& k, const bool&) {
+            if (w.find(k) == w.end())
+              keys.push_back(k);
+            return true;
+          });
+        }
+
+        for (auto& [k, v] : writes)
+        {
+          if (!deleted(v.version) && (index.extract(k, v.value) == ik))
+            keys.push_back(k);
+        }
+
+        return keys;
+      }
+
       Version start_order()
       {
         return start_version;
@@ -493,7 +892,94 @@ namespace kv
         return map.is_replicated();
       }
 
+      void set_read_only()
+      {
+        read_only = true;
+      }
+
     private:
+      void set_arena(ds::Arena* arena)
+      {
+        reads = Read(typename Read::allocator_type(arena));
+      }
+
+      template <class F>
+      bool range_internal(const K& from, const std::optional<K>& to, F&& f)
+      {
+        static_assert(Ordered, "Range queries require an ordered map");
+
+        if (commit_version != NoVersion)
+          return false;
+
+        // Record a read dependency on the whole range.
+        if (!read_only)
+          ranges.emplace_back(from, to);
+
+        auto in_range = [&to](const K& k) {
+          return !to.has_value() || k < to.value();
+        };
+
+        // Writes in the range take precedence over the state, so merge them
+        // in key order with the entries from the state.
+        std::vector<typename Write::const_pointer> range_writes;
+        for (auto& write : writes)
+        {
+          if (!(write.first < from) && in_range(write.first))
+            range_writes.push_back(&write);
+        }
+        std::sort(
+          range_writes.begin(), range_writes.end(), [](auto& a, auto& b) {
+            return a->first < b->first;
+          });
+        auto next_write = range_writes.begin();
+
+        bool stopped = false;
+        auto visit = [&f, &stopped](const K& k, const VersionV& v) {
+          if (!deleted(v.version) && !f(k, v.value))
+            stopped = true;
+          return !stopped;
+        };
+
+        state.foreach_from(from, [&](const K& k, const VersionV& v) {
+          if (!in_range(k))
+            return false;
+
+          for (; next_write != range_writes.end() && (*next_write)->first < k;
+               ++next_write)
+          {
+            if (!visit((*next_write)->first, (*next_write)->second))
+              return false;
+          }
+
+          if (next_write != range_writes.end() && !(k < (*next_write)->first))
+          {
+            auto& write = **next_write++;
+            return visit(write.first, write.second);
+          }
+
+          return visit(k, v);
+        });
+
+        for (; !stopped && next_write != range_writes.end(); ++next_write)
+          visit((*next_write)->first, (*next_write)->second);
+
+        return !stopped;
+      }
+
+      static std::vector<std::pair<K, Version>> range_versions(
+        const State& s, const K& from, const std::optional<K>& to)
+      {
+        std::vector<std::pair<K, Version>> versions;
+        s.foreach_from(from, [&](const K& k, const VersionV& v) {
+          if (to.has_value() && !(k < to.value()))
+            return false;
+
+          versions.emplace_back(k, v.version);
+          return true;
+        });
+        return versions;
+      }
+
       virtual bool has_writes()
       {
         return committed_writes || !writes.empty();
@@ -550,6 +1036,25 @@ namespace kv
           }
         }
 
+        if constexpr (Ordered)
+        {
+          // Check that no key in each range that we read has been written
+          // since, unless the map has not changed at all.
+          if (!ranges.empty() && (current.version != start_version))
+          {
+            for (auto& [from, to] : ranges)
+            {
+              if (
+                range_versions(state, from, to) !=
+                range_versions(current.state, from, to))
+              {
+                LOG_DEBUG_FMT("Read depends on invalid range of entries");
+                return false;
+              }
+            }
+          }
+        }
+
         return true;
       }
 
@@ -567,7 +1072,7 @@ namespace kv
 
         if (!writes.empty())
         {
-          auto state = map.roll->back().state;
+          StateBatch batch(map.roll->back().state);
 
           for (auto it = writes.begin(); it != writes.end(); ++it)
           {
@@ -575,23 +1080,33 @@ namespace kv
             {
               // Write the new value with the global version.
               changes = true;
-              state = state.put(it->first, VersionV{v, it->second.value});
+              batch.put(it->first, VersionV{v, it->second.value});
             }
             else
             {
               // Write an empty value with the deleted global version only if
               // the key exists.
-              auto search = state.get(it->first);
-              if (search.has_value())
+              if (batch.getp(it->first) != nullptr)
               {
                 changes = true;
-                state = state.put(it->first, VersionV{-v, V()});
+                batch.put(it->first, VersionV{-v, V()});
               }
             }
           }
 
+          auto state = batch.persistent();
+
           if (changes)
-            map.roll->push_back({v, state, writes});
+          {
+            auto& previous = map.roll->back();
+            IndexStates indexes;
+            for (size_t i = 0; i < map.indexes.size(); ++i)
+              indexes.push_back(map.indexes[i]->update(
+                previous.indexes[i], previous.state, writes));
+
+            map.roll->push_back(
+              {v, state, writes, std::move(indexes), writes.size()});
+          }
         }
       }
 
@@ -619,7 +1134,9 @@ namespace kv
 
         if (include_reads)
         {
-          s.serialise_read_version(read_version);
+          // Range reads are serialised as a dependency on the whole map.
+          s.serialise_read_version(
+            ranges.empty() ? read_version : start_version);
 
           s.serialise_count_header(reads.size());
           for (auto it = reads.begin(); it != reads.end(); ++it)
@@ -711,8 +1228,12 @@ namespace kv
 
     TxView* create_view(Version version) override
     {
-      lock();
+      std::lock_guard<SpinLock> guard(sl);
+      return create_view_unlocked(version);
+    }
 
+    TxView* create_view_unlocked(Version version)
+    {
       // Find the last entry committed at or before this version.
       TxView* view = nullptr;
 
@@ -720,7 +1241,8 @@ namespace kv
       {
         if (it->version <= version)
         {
-          view = new TxView(*this, it->state, it->version, rollback_counter);
+          view = new TxView(
+            *this, it->state, it->indexes, it->version, rollback_counter);
           break;
         }
       }
@@ -728,14 +1250,48 @@ namespace kv
       if (view == nullptr)
       {
         view = new TxView(
-          *this, roll->front().state, roll->front().version, rollback_counter);
+          *this,
+          roll->front().state,
+          roll->front().indexes,
+          roll->front().version,
+          rollback_counter);
       }
 
-      unlock();
       return view;
     }
 
+    TxView* create_historical_view(Version version)
+    {
+      std::lock_guard<SpinLock> guard(sl);
+
+      // The state at this version is the last one committed at or before it,
+      // either still in the roll or retained after compaction.
+      if (roll->front().version <= version)
+        return create_view_unlocked(version);
+
+      auto it = std::upper_bound(
+        history.begin(),
+        history.end(),
+        version,
+        [](Version v, const HistoricalState& h) { return v < h.version; });
+      if (it == history.begin())
+        throw std::logic_error(fmt::format(
+          "State of map {} at version {} is no longer retained",
+          name,
+          version));
+
+      --it;
+      return new TxView(
+        *this, it->state, it->indexes, it->version, rollback_counter);
+    }
+
     void compact(Version v) override
+    {
+      compact_roll(v);
+      evict_history(v);
+    }
+
+    void compact_roll(Version v)
     {
       // This discards available rollback state before version v, and populates
       // the commit_deltas to be passed to the global commit hook, if there is
@@ -748,32 +1304,64 @@ namespace kv
         if (r->version == v)
         {
           // We know that write set is not empty.
-          if (global_hook)
+          if (has_global_hooks())
             commit_deltas.emplace_back(
               LocalCommit{r->version, r->state, move(r->writes)});
           return;
         }
 
         // Discardable, so move to commit_deltas.
-        if (global_hook && !r->writes.empty())
-          std::move(r, std::next(r), std::back_inserter(commit_deltas));
+        if (has_global_hooks() && !r->writes.empty())
+          commit_deltas.emplace_back(
+            LocalCommit{r->version, r->state, move(r->writes)});
 
         // Stop if the next state may be rolled back or is the only state.
         // This ensures there is always a state present.
         if (std::next(r)->version > v)
           return;
 
+        // Keep the state for historical reads, if the store retains any.
+        if (store->get_history_retention().versions > 0)
+        {
+          history.push_back(
+            {r->version, r->state, r->indexes, r->write_count});
+          history_write_count += r->write_count;
+        }
+
         roll->pop_front();
       }
 
       // There is only one roll. We may need to call the commit hook.
       auto r = roll->begin();
 
-      if (global_hook && !r->writes.empty())
+      if (has_global_hooks() && !r->writes.empty())
         commit_deltas.emplace_back(
           LocalCommit{r->version, r->state, move(r->writes)});
     }
 
+    void evict_history(Version v)
+    {
+      // States are needed to read at versions from the start of the retention
+      // window, so the last state before that is kept too.
+      const auto& retention = store->get_history_retention();
+      while (!history.empty())
+      {
+        auto next = history.size() > 1 ? history[1].version :
+                                         roll->front().version;
+        auto in_window = next > v || v - next < retention.versions;
+        if (in_window && history_write_count <= retention.max_writes)
+          break;
+
+        history_write_count -= history.front().write_count;
+        history.pop_front();
+      }
+    }
+
+    bool has_global_hooks() const
+    {
+      return global_hook || !batched_global_hooks.empty();
+    }
+
     void post_compact() override
     {
       if (global_hook)
@@ -782,6 +1370,26 @@ namespace kv
           global_hook(r.version, r.state, r.writes);
       }
 
+      if (!batched_global_hooks.empty() && !commit_deltas.empty())
+      {
+        // The writes are no longer needed once the per-version hook has run,
+        // so they are moved into the merged write set. Later writes to a key
+        // replace earlier ones.
+        auto& first = commit_deltas.front();
+        auto& last = commit_deltas.back();
+        Write merged = std::move(first.writes);
+        for (auto r = std::next(commit_deltas.begin());
+             r != commit_deltas.end();
+             ++r)
+        {
+          for (auto& [k, v] : r->writes)
+            merged.insert_or_assign(k, std::move(v));
+        }
+
+        for (auto& hook : batched_global_hooks)
+          hook(first.version, last.version, last.state, merged);
+      }
+
       commit_deltas.clear();
     }
 
@@ -813,29 +1421,111 @@ namespace kv
       // This discards all entries in the roll and resets the compacted value
       // and rollback counter. The Map expects to be locked before clearing it.
       roll->clear();
-      roll->push_back({0, State(), Write()});
+      roll->push_back({0, State(), Write(), build_indexes(State())});
+      history.clear();
+      history_write_count = 0;
       rollback_counter = 0;
     }
 
-    void lock() override
+    std::unique_ptr<typename AbstractMap<S, D>::Snapshot> snapshot(
+      Version v) override
     {
-      sl.lock();
+      // This captures the state at version v, which is cheap since the state
+      // is persistent. The Map expects to be locked while it is snapshotted.
+      for (auto it = roll->rbegin(); it != roll->rend(); ++it)
+      {
+        if (it->version <= v)
+          return std::make_unique<Snapshot>(
+            name, security_domain, it->version, it->state);
+      }
+
+      // The state at version v has been compacted away.
+      return nullptr;
     }
 
-    void unlock() override
+    bool deserialise_snapshot(D& d) override
     {
-      sl.unlock();
+      // This replaces the roll with the state read from a snapshot. The Map
+      // expects to be locked while the snapshot is installed.
+      auto v = d.template deserialise_read_version<Version>();
+      auto ctr = d.deserialise_write_header();
+
+      StateBatch batch{State()};
+      for (size_t i = 0; i < ctr; ++i)
+      {
+        auto w = d.template deserialise_write_version<K, V, Version>();
+        if (!w.has_value() || w->is_remove)
+          return false;
+
+        batch.put(w->key, VersionV{w->version, w->value});
+      }
+      auto state = batch.persistent();
+
+      roll->clear();
+      roll->push_back({v, state, Write(), build_indexes(state)});
+      history.clear();
+      history_write_count = 0;
+      rollback_counter++;
+      return true;
     }
 
-    void swap(AbstractMap<S, D>* map_) override
+    void post_deserialise_snapshot() override
     {
-      This* map = dynamic_cast<This*>(map_);
-      if (map == nullptr)
-        throw std::logic_error(
-          "Attempted to swap maps with incompatible types");
+      // Local hooks see the whole state as written at once, as they would
+      // have seen it had every transaction up to the snapshot version been
+      // deserialised. They only run once the snapshot has been verified.
+      std::lock_guard<SpinLock> guard(sl);
+      if (!local_hook)
+        return;
+
+      const auto& r = roll->front();
+      Write writes;
+      r.state.foreach([&writes](const K& k, const VersionV& v) {
+        writes[k] = v;
+        return true;
+      });
+      local_hook(r.version, r.state, writes);
+    }
+
+    void lock() override
+    {
+      sl.lock();
+    }
+
+    void unlock() override
+    {
+      sl.unlock();
+    }
+
+    void swap(AbstractMap<S, D>* map_) override
+    {
+      This* map = dynamic_cast<This*>(map_);
+      if (map == nullptr)
+        throw std::logic_error(
+          "Attempted to swap maps with incompatible types");
 
       std::swap(rollback_counter, map->rollback_counter);
       std::swap(roll, map->roll);
+      std::swap(history, map->history);
+      std::swap(history_write_count, map->history_write_count);
+
+      // Indexes are not swapped with the state, so must be rebuilt
+      for (auto& r : *roll)
+        r.indexes = build_indexes(r.state);
+      for (auto& h : history)
+        h.indexes = build_indexes(h.state);
+      for (auto& r : *map->roll)
+        r.indexes = map->build_indexes(r.state);
+      for (auto& h : map->history)
+        h.indexes = map->build_indexes(h.state);
+    }
+
+    IndexStates build_indexes(const State& state)
+    {
+      IndexStates index_states;
+      for (auto& index : indexes)
+        index_states.push_back(index->build(state));
+      return index_states;
     }
   };
 
@@ -849,36 +1539,140 @@ namespace kv
     std::unique_ptr<AbstractTxView<S, D>> view;
   };
 
-  // When a collection of Maps are locked, the locks must be acquired in a
-  // stable order to avoid deadlocks. This ordered map will claim in name-order
+  // Views of a transaction, stored densely by the handles of their maps so
+  // that finding the view over a map is a single index. When a collection of
+  // Maps are locked, the locks must be acquired in a stable order to avoid
+  // deadlocks. Views are iterated, and so claimed, in handle order.
   template <class S, class D>
-  using OrderedViews = std::map<std::string, MapView<S, D>>;
-
-  template <typename SP, typename DP>
-  static inline std::
-    map<kv::SecurityDomain, std::vector<AbstractTxView<SP, DP>*>>
-    get_maps_grouped_by_domain(const OrderedViews<SP, DP>& maps)
+  class OrderedViews
   {
-    std::map<kv::SecurityDomain, std::vector<AbstractTxView<SP, DP>*>>
-      grouped_maps;
-    for (auto it = maps.cbegin(); it != maps.cend(); ++it)
+  private:
+    using Views =
+      std::vector<MapView<S, D>, ds::ArenaAllocator<MapView<S, D>>>;
+    Views views;
+    size_t count = 0;
+
+  public:
+    class iterator
+    {
+    private:
+      typename Views::iterator it;
+      typename Views::iterator end;
+
+      void skip_empty()
+      {
+        while (it != end && it->view == nullptr)
+          ++it;
+      }
+
+    public:
+      iterator(typename Views::iterator it_, typename Views::iterator end_) :
+        it(it_),
+        end(end_)
+      {
+        skip_empty();
+      }
+
+      MapView<S, D>& operator*() const
+      {
+        return *it;
+      }
+
+      MapView<S, D>* operator->() const
+      {
+        return &*it;
+      }
+
+      iterator& operator++()
+      {
+        ++it;
+        skip_empty();
+        return *this;
+      }
+
+      bool operator!=(const iterator& that) const
+      {
+        return it != that.it;
+      }
+
+      bool operator==(const iterator& that) const
+      {
+        return it == that.it;
+      }
+    };
+
+    OrderedViews(ds::Arena* arena = nullptr) :
+      views(typename Views::allocator_type(arena))
+    {}
+
+    iterator begin()
     {
-      grouped_maps[it->second.map->get_security_domain()].push_back(
-        it->second.view.get());
+      return iterator(views.begin(), views.end());
+    }
+
+    iterator end()
+    {
+      return iterator(views.end(), views.end());
+    }
+
+    size_t size() const
+    {
+      return count;
+    }
+
+    bool empty() const
+    {
+      return count == 0;
     }
-    return grouped_maps;
-  }
+
+    MapView<S, D>* find(MapHandle handle)
+    {
+      if (handle >= views.size() || views[handle].view == nullptr)
+        return nullptr;
+
+      return &views[handle];
+    }
+
+    // Returns false, and leaves the views unchanged, if there already is a
+    // view over that map
+    bool insert(MapView<S, D>&& map_view)
+    {
+      auto handle = map_view.map->get_handle();
+      if (handle >= views.size())
+        views.resize(handle + 1);
+
+      auto& slot = views[handle];
+      if (slot.view != nullptr)
+        return false;
+
+      slot = std::move(map_view);
+      count++;
+      return true;
+    }
+
+    void clear()
+    {
+      // Release the storage too, as the arena it came from may be reset
+      views = Views(views.get_allocator());
+      count = 0;
+    }
+  };
 
   template <class S, class D>
   class Tx
   {
   private:
+    // Backs the view list and read sets, and is recycled once the transaction
+    // is destroyed
+    std::unique_ptr<ds::Arena> arena;
     OrderedViews<S, D> view_list;
     bool committed;
     bool success;
     Version read_version;
     Version version;
     bool read_globally_committed = false;
+    bool read_historical = false;
+    bool read_only = false;
 
     kv::TxHistory::RequestID req_id;
 
@@ -886,16 +1680,16 @@ namespace kv
     std::tuple<typename M::TxView*> get_tuple(M& m)
     {
       // If the M is present, its AbtractTxView must be an M::TxView.
-      auto search = view_list.find(m.name);
-      if (search != view_list.end())
+      auto search = view_list.find(m.get_handle());
+      if (search != nullptr && search->map == &m)
         return std::make_tuple(
-          static_cast<typename M::TxView*>(search->second.view.get()));
+          static_cast<typename M::TxView*>(search->view.get()));
 
       auto it = view_list.begin();
       if (it != view_list.end())
       {
         // All Maps must be in the same store.
-        if (it->second.map->get_store() != m.get_store())
+        if (it->map->get_store() != m.get_store())
           throw std::logic_error(
             "Transaction must be over maps in the same store");
       }
@@ -909,8 +1703,24 @@ namespace kv
           read_version = m.get_store()->current_version();
       }
 
-      typename M::TxView* view = m.create_view(read_version);
-      view_list[m.name] = {&m, std::unique_ptr<AbstractTxView<S, D>>(view)};
+      typename M::TxView* view = nullptr;
+      if (read_historical)
+      {
+        if (read_version > m.get_store()->commit_version())
+          throw std::logic_error(fmt::format(
+            "Cannot read at version {}, which is not globally committed",
+            read_version));
+
+        view = m.create_historical_view(read_version);
+      }
+      else
+      {
+        view = m.create_view(read_version);
+      }
+      view->set_arena(arena.get());
+      if (read_only)
+        view->set_read_only();
+      view_list.insert({&m, std::unique_ptr<AbstractTxView<S, D>>(view)});
       return std::make_tuple(view);
     }
 
@@ -924,15 +1734,18 @@ namespace kv
     void reset()
     {
       view_list.clear();
+      arena->reset();
       committed = false;
       success = false;
       read_version = NoVersion;
       version = NoVersion;
+      read_historical = false;
     }
 
   public:
     Tx() :
-      view_list(),
+      arena(ds::ThreadLocalPool<ds::Arena>::acquire()),
+      view_list(arena.get()),
       committed(false),
       success(false),
       read_version(NoVersion),
@@ -941,11 +1754,22 @@ namespace kv
 
     Tx(const Tx& that) = delete;
 
+    ~Tx()
+    {
+      // The views, and the reads they hold, must be destroyed before their
+      // memory is reused
+      view_list.clear();
+      arena->reset();
+      ds::ThreadLocalPool<ds::Arena>::release(std::move(arena));
+    }
+
     void set_view_list(OrderedViews<S, D>& view_list_)
     {
-      // if view list is not empty then any coinciding keys will not be
+      // if view list is not empty then any coinciding views will not be
       // overwritten
-      view_list.merge(view_list_);
+      for (auto& map_view : view_list_)
+        view_list.insert(std::move(map_view));
+      view_list_.clear();
     }
 
     void set_req_id(const kv::TxHistory::RequestID& req_id_)
@@ -1014,7 +1838,40 @@ namespace kv
         return CommitSuccess::OK;
       }
 
-      auto store = view_list.begin()->second.map->get_store();
+      auto store = view_list.begin()->map->get_store();
+
+      if (read_only)
+      {
+        // A read-only transaction does not track its reads, so there is
+        // nothing to validate, lock or replicate. Its views are only
+        // consistent if each was created at the read version: a map compacted
+        // past the read version gives a view of a newer state instead, and the
+        // transaction must be retried.
+        for (auto& map_view : view_list)
+        {
+          if (map_view.view->start_order() > read_version)
+          {
+            reset();
+
+            LOG_TRACE_FMT(
+              "Could not commit read-only transaction, state at {} was "
+              "compacted",
+              read_version);
+            return CommitSuccess::CONFLICT;
+          }
+        }
+
+        committed = true;
+        success = true;
+        version = 0;
+
+        auto h = store->get_history();
+        if (h != nullptr)
+          h->add_result(req_id, NoVersion);
+
+        return CommitSuccess::OK;
+      }
+
       auto c = commit(view_list, [store]() { return store->next_version(); });
       success = c.has_value();
 
@@ -1039,10 +1896,10 @@ namespace kv
         try
         {
           auto data = serialise();
+          auto h = store->get_history();
 
           if (data.empty())
           {
-            auto h = store->get_history();
             if (h != nullptr)
             {
               // This tx does not have a write set, so this is a read only tx
@@ -1052,8 +1909,17 @@ namespace kv
             return CommitSuccess::OK;
           }
 
+          // The entry is hashed here, concurrently with other transactions,
+          // rather than once it is ordered under the store's version lock
+          std::optional<crypto::Sha256Hash> hash;
+          if (h != nullptr)
+            hash = h->hash_entry(data);
+
           return store->commit(
-            version, MovePendingTx(std::move(data), std::move(req_id)), false);
+            version,
+            MovePendingTx(std::move(data), std::move(req_id)),
+            false,
+            std::move(hash));
         }
         catch (const std::exception& e)
         {
@@ -1084,7 +1950,9 @@ namespace kv
     }
 
     static std::optional<Version> commit(
-      OrderedViews<S, D>& views, std::function<Version()> f)
+      OrderedViews<S, D>& views,
+      std::function<Version()> f,
+      AbstractExecutor* executor = nullptr)
     {
       // All maps with pending writes are locked, transactions are prepared
       // and possibly committed, and then all maps with pending writes are
@@ -1095,9 +1963,9 @@ namespace kv
 
       for (auto it = views.begin(); it != views.end(); ++it)
       {
-        if (it->second.view->has_writes())
+        if (it->view->has_writes())
         {
-          it->second.map->lock();
+          it->map->lock();
           has_writes = true;
         }
       }
@@ -1106,7 +1974,7 @@ namespace kv
 
       for (auto it = views.begin(); it != views.end(); ++it)
       {
-        if (!it->second.view->prepare())
+        if (!it->view->prepare())
         {
           ok = false;
           break;
@@ -1118,17 +1986,51 @@ namespace kv
         // Get the version number to be used for this commit.
         version = f();
 
-        for (auto it = views.begin(); it != views.end(); ++it)
-          it->second.view->commit(version);
+        if (executor != nullptr && views.size() > 1)
+        {
+          // Each view only updates the state of its own map, so views can be
+          // committed concurrently. Tasks must not throw, so errors are
+          // rethrown here instead.
+          std::vector<std::exception_ptr> errors(views.size());
+          std::vector<std::function<void()>> tasks;
+          size_t i = 0;
+          for (auto it = views.begin(); it != views.end(); ++it, ++i)
+          {
+            auto view = it->view.get();
+            auto& error = errors[i];
+            tasks.emplace_back([view, version, &error]() {
+              try
+              {
+                view->commit(version);
+              }
+              catch (...)
+              {
+                error = std::current_exception();
+              }
+            });
+          }
+          executor->run(tasks);
+
+          for (auto& error : errors)
+          {
+            if (error != nullptr)
+              std::rethrow_exception(error);
+          }
+        }
+        else
+        {
+          for (auto it = views.begin(); it != views.end(); ++it)
+            it->view->commit(version);
+        }
 
         for (auto it = views.begin(); it != views.end(); ++it)
-          it->second.view->post_commit();
+          it->view->post_commit();
       }
 
       for (auto it = views.begin(); it != views.end(); ++it)
       {
-        if (it->second.view->has_writes())
-          it->second.map->unlock();
+        if (it->view->has_writes())
+          it->map->unlock();
       }
 
       if (!ok)
@@ -1150,7 +2052,7 @@ namespace kv
 
       for (auto it = view_list.begin(); it != view_list.end(); ++it)
       {
-        if (it->second.view->has_changes())
+        if (it->view->has_changes())
         {
           changes = true;
           break;
@@ -1162,21 +2064,21 @@ namespace kv
         return {};
       }
       // Retrieve encryptor.
-      auto map = view_list.begin()->second.map;
+      auto map = view_list.begin()->map;
       auto e = map->get_store()->get_encryptor();
 
       S replicated_serialiser(e, version);
-      // flags that indicate if we have actually written any data in the
-      // serializers
-      auto grouped_maps = get_maps_grouped_by_domain(view_list);
 
-      for (auto domain_it : grouped_maps)
+      // Public maps are serialised first
+      for (auto domain : {SecurityDomain::PUBLIC, SecurityDomain::PRIVATE})
       {
-        for (auto curr_map : domain_it.second)
+        for (auto& map_view : view_list)
         {
-          if (curr_map->is_replicated())
+          if (
+            map_view.map->get_security_domain() == domain &&
+            map_view.view->is_replicated())
           {
-            curr_map->serialise(replicated_serialiser, include_reads);
+            map_view.view->serialise(replicated_serialiser, include_reads);
           }
         }
       }
@@ -1187,7 +2089,8 @@ namespace kv
 
     // Used by frontend for reserved transactions
     Tx(Version reserved) :
-      view_list(),
+      arena(ds::ThreadLocalPool<ds::Arena>::acquire()),
+      view_list(arena.get()),
       committed(false),
       success(false),
       read_version(reserved - 1),
@@ -1214,6 +2117,33 @@ namespace kv
       return {CommitSuccess::OK, {0, 0, 0}, std::move(serialise())};
     }
 
+    // Make the transaction read-only. Its views do not track reads, writing
+    // to them throws, and committing it neither validates nor replicates
+    // anything. Committing only conflicts if one of its maps was compacted past
+    // the read version before it was viewed. Fails if the transaction has
+    // already written.
+    void set_read_only()
+    {
+      if (has_writes())
+        throw std::logic_error(
+          "Cannot set_read_only, transaction has already written");
+
+      for (auto& map_view : view_list)
+        map_view.view->set_read_only();
+
+      read_only = true;
+    }
+
+    bool has_writes()
+    {
+      for (auto& map_view : view_list)
+      {
+        if (map_view.view->has_writes())
+          return true;
+      }
+      return false;
+    }
+
     // Set all reads on transaction to read at the global commit version,
     // rather than the local commit.
     void set_read_committed()
@@ -1228,6 +2158,21 @@ namespace kv
           "Cannot set_read_committed, read_version is already set");
       }
     }
+
+    // Set all reads on transaction to read the state of the store as of a
+    // past globally committed version, which must still be retained by the
+    // maps it reads (see Store::set_history_retention). The transaction is
+    // read-only.
+    void set_read_historical(Version v)
+    {
+      if (read_version != NoVersion)
+        throw std::logic_error(
+          "Cannot set_read_historical, read_version is already set");
+
+      read_version = v;
+      read_historical = true;
+      read_only = true;
+    }
   };
 
   template <class S, class D>
@@ -1236,6 +2181,8 @@ namespace kv
   public:
     template <class K, class V, class H = std::hash<K>>
     using Map = Map<K, V, H, S, D>;
+    template <class K, class V>
+    using OrderedMap = kv::Map<K, V, std::hash<K>, S, D, true>;
     using Tx = Tx<S, D>;
 
   private:
@@ -1247,13 +2194,22 @@ namespace kv
     std::shared_ptr<Consensus> consensus = nullptr;
     std::shared_ptr<TxHistory> history = nullptr;
     std::shared_ptr<AbstractTxEncryptor> encryptor = nullptr;
+    std::shared_ptr<AbstractExecutor> executor = nullptr;
     Version version = 0;
     Version compacted = 0;
+    HistoryRetention history_retention;
+
+    // Deserialised transactions smaller than this are applied on the calling
+    // thread, as they are cheaper to apply than to hand over to others
+    static constexpr size_t parallel_deserialise_threshold = 16 * 1024;
 
     SpinLock maps_lock;
     SpinLock version_lock;
 
-    std::unordered_map<Version, std::pair<PendingTx, bool>> pending_txs;
+    std::unordered_map<
+      Version,
+      std::tuple<PendingTx, bool, std::optional<crypto::Sha256Hash>>>
+      pending_txs;
     Version last_replicated = 0;
     Version last_committable = 0;
     Version rollback_count = 0;
@@ -1275,10 +2231,20 @@ namespace kv
       return grouped_maps;
     }
 
+    // Must be called with maps_lock held
+    MapView<S, D>* find_view(OrderedViews<S, D>& views, const std::string& name)
+    {
+      auto search = maps.find(name);
+      if (search == maps.end())
+        return nullptr;
+
+      return views.find(search->second->get_handle());
+    }
+
     DeserialiseSuccess commit_deserialised(
-      OrderedViews<S, D>& views, Version& v)
+      OrderedViews<S, D>& views, Version& v, AbstractExecutor* executor_)
     {
-      auto c = Tx::commit(views, [v]() { return v; });
+      auto c = Tx::commit(views, [v]() { return v; }, executor_);
       if (!c.has_value())
       {
         LOG_FAIL_FMT("Failed to commit deserialised Tx at version {}", v);
@@ -1349,6 +2315,35 @@ namespace kv
       return encryptor;
     }
 
+    void set_executor(std::shared_ptr<AbstractExecutor> executor_)
+    {
+      executor = executor_;
+    }
+
+    std::shared_ptr<AbstractExecutor> get_executor()
+    {
+      return executor;
+    }
+
+    /** Set how much committed state is kept for historical reads
+     *
+     * Takes effect from the next compaction. States that have already been
+     * discarded are not recovered.
+     *
+     * @param retention Retention window and budget
+     */
+    void set_history_retention(const HistoryRetention& retention)
+    {
+      std::lock_guard<SpinLock> mguard(maps_lock);
+      history_retention = retention;
+    }
+
+    // Maps read this during compaction, while maps_lock is held
+    const HistoryRetention& get_history_retention() const
+    {
+      return history_retention;
+    }
+
     template <class K, class V, class H = std::hash<K>>
     Map<K, V, H>* get(std::string name)
     {
@@ -1436,8 +2431,15 @@ namespace kv
         }
       }
 
-      auto result =
-        new M(this, name, security_domain, replicated, local_hook, global_hook);
+      // Maps are never removed, so the number of maps is the next free handle
+      auto result = new M(
+        this,
+        name,
+        maps.size(),
+        security_domain,
+        replicated,
+        local_hook,
+        global_hook);
       maps[name] = std::unique_ptr<AbstractMap<S, D>>(result);
       return *result;
     }
@@ -1514,11 +2516,141 @@ namespace kv
         e->rollback(v);
     }
 
+    /**
+     * A serialised transaction, decrypted and hashed by prepare_deserialise()
+     * ahead of being applied to the store.
+     */
+    class PreparedTx
+    {
+    private:
+      friend class Store<S, D>;
+
+      std::vector<uint8_t> data;
+      std::unique_ptr<D> d;
+      std::optional<crypto::Sha256Hash> hash;
+    };
+
+    /**
+     * The state of the replicated maps at a committed version, along with the
+     * history at that version, as captured by snapshot().
+     */
+    class Snapshot
+    {
+    private:
+      friend class Store<S, D>;
+
+      Version version;
+      std::vector<std::unique_ptr<typename AbstractMap<S, D>::Snapshot>>
+        snapshots;
+      std::vector<uint8_t> tree;
+      std::shared_ptr<AbstractTxEncryptor> encryptor;
+
+    public:
+      Version get_version() const
+      {
+        return version;
+      }
+
+      /**
+       * Serialises the snapshot, one map at a time. Private maps are
+       * encrypted as they would be in a transaction at the snapshot version.
+       * Does not lock the store.
+       */
+      std::vector<uint8_t> serialise()
+      {
+        S s(encryptor, version);
+        s.serialise_raw(tree);
+
+        for (auto& snapshot : snapshots)
+          snapshot->serialise(s);
+
+        return s.get_raw_data();
+      }
+    };
+
+    /**
+     * Captures the state of the replicated maps at version v, which must be
+     * committed and not yet compacted away. Only the persistent map states
+     * are copied here, so this is cheap and blocks transactions only
+     * briefly. The snapshot can be serialised later, off the critical path.
+     */
+    std::unique_ptr<Snapshot> snapshot(Version v)
+    {
+      std::lock_guard<SpinLock> mguard(maps_lock);
+
+      if (v > commit_version())
+        throw std::logic_error(fmt::format(
+          "Cannot snapshot at version {} which is not committed yet", v));
+
+      auto snapshot = std::make_unique<Snapshot>();
+      snapshot->version = v;
+      snapshot->encryptor = get_encryptor();
+
+      bool available = true;
+
+      for (auto& map : maps)
+        map.second->lock();
+
+      for (auto& map : maps)
+      {
+        if (!map.second->is_replicated())
+          continue;
+
+        auto map_snapshot = map.second->snapshot(v);
+        if (map_snapshot == nullptr)
+        {
+          available = false;
+          break;
+        }
+
+        snapshot->snapshots.push_back(std::move(map_snapshot));
+      }
+
+      for (auto& map : maps)
+        map.second->unlock();
+
+      if (!available)
+        throw std::logic_error(fmt::format(
+          "Cannot snapshot at version {} which is already compacted", v));
+
+      {
+        std::lock_guard<SpinLock> vguard(version_lock);
+        auto h = get_history();
+        if (h)
+          snapshot->tree = h->serialise_tree(v);
+      }
+
+      return snapshot;
+    }
+
+  private:
+    // Decrypts the private domain of the transaction, unless public_only is
+    // set. Returns nullptr if the transaction cannot be decrypted.
+    std::unique_ptr<D> init_deserialiser(
+      const uint8_t* data, size_t size, bool public_only)
+    {
+      // create the first deserialiser
+      auto d = std::make_unique<D>(
+        get_encryptor(),
+        public_only ? kv::SecurityDomain::PUBLIC :
+                      std::optional<kv::SecurityDomain>());
+
+      if (!d->init(data, size))
+      {
+        LOG_FAIL_FMT("Initialisation of deserialise object failed");
+        return nullptr;
+      }
+
+      return d;
+    }
+
     DeserialiseSuccess deserialise_views(
-      const std::vector<uint8_t>& data,
-      bool public_only = false,
-      Term* term = nullptr,
-      Tx* tx = nullptr)
+      D& d,
+      const uint8_t* data,
+      size_t size,
+      const std::optional<crypto::Sha256Hash>& hash,
+      Term* term,
+      Tx* tx)
     {
       // If we pass in a transaction we don't want to commit, just deserialise
       // and put the views into that transaction.
@@ -1532,21 +2664,7 @@ namespace kv
       // Processing transactions locally and also deserialising to the
       // same store will result in a store version mismatch and
       // deserialisation will then fail.
-      auto e = get_encryptor();
-
-      // create the first deserialiser
-      auto d = std::make_unique<D>(
-        e,
-        public_only ? kv::SecurityDomain::PUBLIC :
-                      std::optional<kv::SecurityDomain>());
-
-      if (!d->init(data.data(), data.size()))
-      {
-        LOG_FAIL_FMT("Initialisation of deserialise object failed");
-        return DeserialiseSuccess::FAILED;
-      }
-
-      Version v = d->template deserialise_version<Version>();
+      Version v = d.template deserialise_version<Version>();
       // Throw away any local commits that have not propagated via the
       // consensus.
       rollback(v - 1);
@@ -1567,9 +2685,23 @@ namespace kv
       std::lock_guard<SpinLock> mguard(maps_lock);
       OrderedViews<S, D> views;
 
-      for (auto r = d->start_map(); r.has_value(); r = d->start_map())
+      // Each map is deserialised from its own section of the transaction, so
+      // that the maps of a large transaction can be deserialised and
+      // committed on several threads
+      struct MapSection
+      {
+        std::string name;
+        std::unique_ptr<D> d;
+        AbstractTxView<S, D>* view;
+        bool ok = false;
+        std::exception_ptr error = nullptr;
+      };
+      std::vector<MapSection> sections;
+
+      for (auto r = d.start_map_section(); r.has_value();
+           r = d.start_map_section())
       {
-        const auto map_name = r.value();
+        auto& [map_name, section] = r.value();
 
         auto search = maps.find(map_name);
         if (search == maps.end())
@@ -1578,42 +2710,80 @@ namespace kv
           return DeserialiseSuccess::FAILED;
         }
 
-        auto view_search = views.find(map_name);
-        if (view_search != views.end())
+        if (views.find(search->second->get_handle()) != nullptr)
         {
           LOG_FAIL_FMT("Multiple writes on {} at version {}", map_name, v);
           return DeserialiseSuccess::FAILED;
         }
 
         auto view = search->second->create_view(v);
-        // if we are not committing now then use NoVersion to deserialise
-        // otherwise the view will be considered as having a committed
-        // version
-        auto deserialise_version = (commit ? v : NoVersion);
-        if (!view->deserialise(*d, deserialise_version))
+        views.insert({search->second.get(),
+                      std::unique_ptr<AbstractTxView<S, D>>(view)});
+        sections.push_back({map_name, std::move(section), view});
+      }
+
+      if (!d.end())
+      {
+        LOG_FAIL_FMT("Unexpected content in Tx at version {}", v);
+        return DeserialiseSuccess::FAILED;
+      }
+
+      auto e = (commit && sections.size() > 1 &&
+                size >= parallel_deserialise_threshold) ?
+        executor.get() :
+        nullptr;
+
+      // if we are not committing now then use NoVersion to deserialise
+      // otherwise the view will be considered as having a committed
+      // version
+      auto deserialise_version = (commit ? v : NoVersion);
+      std::vector<std::function<void()>> tasks;
+      for (auto& section : sections)
+      {
+        tasks.emplace_back([&section, deserialise_version]() {
+          try
+          {
+            section.ok =
+              section.view->deserialise(*section.d, deserialise_version) &&
+              section.d->end();
+          }
+          catch (...)
+          {
+            section.error = std::current_exception();
+          }
+        });
+      }
+
+      if (e != nullptr)
+      {
+        e->run(tasks);
+      }
+      else
+      {
+        for (auto& task : tasks)
+          task();
+      }
+
+      for (auto& section : sections)
+      {
+        if (section.error != nullptr)
+          std::rethrow_exception(section.error);
+
+        if (!section.ok)
         {
           LOG_FAIL_FMT(
             "Could not deserialise Tx for map {} at version {}",
-            map_name,
+            section.name,
             deserialise_version);
           return DeserialiseSuccess::FAILED;
         }
-
-        views[map_name] = {search->second.get(),
-                           std::unique_ptr<AbstractTxView<S, D>>(view)};
-      }
-
-      if (!d->end())
-      {
-        LOG_FAIL_FMT("Unexpected content in Tx at version {}", v);
-        return DeserialiseSuccess::FAILED;
       }
 
       auto success = DeserialiseSuccess::PASS;
 
       if (commit)
       {
-        success = commit_deserialised(views, v);
+        success = commit_deserialised(views, v, e);
         if (success == DeserialiseSuccess::FAILED)
         {
           return success;
@@ -1621,8 +2791,7 @@ namespace kv
         auto h = get_history();
         if (h)
         {
-          auto search = views.find("ccf.signatures");
-          if (search != views.end())
+          if (find_view(views, "ccf.signatures") != nullptr)
           {
             // Transactions containing a signature must only contain
             // a signature and must be verified
@@ -1641,7 +2810,10 @@ namespace kv
             success = DeserialiseSuccess::PASS_SIGNATURE;
           }
 
-          h->append(data.data(), data.size());
+          if (hash.has_value())
+            h->append(hash.value());
+          else
+            h->append(data, size);
         }
       }
       else
@@ -1654,15 +2826,13 @@ namespace kv
           return DeserialiseSuccess::FAILED;
         }
 
-        auto search = views.find("ccf.pbft.preprepares");
-        if (search != views.end())
+        if (find_view(views, "ccf.pbft.preprepares") != nullptr)
         {
           success = DeserialiseSuccess::PASS_PRE_PREPARE;
         }
         else
         {
-          auto search = views.find("ccf.pbft.requests");
-          if (search == views.end())
+          if (find_view(views, "ccf.pbft.requests") == nullptr)
           {
             // we have deserialised an entry that didn't belong to the pbft
             // requests nor the pbft pre prepares table
@@ -1679,6 +2849,21 @@ namespace kv
       return success;
     }
 
+  public:
+    DeserialiseSuccess deserialise_views(
+      const std::vector<uint8_t>& data,
+      bool public_only = false,
+      Term* term = nullptr,
+      Tx* tx = nullptr)
+    {
+      auto d = init_deserialiser(data.data(), data.size(), public_only);
+      if (d == nullptr)
+        return DeserialiseSuccess::FAILED;
+
+      return deserialise_views(
+        *d, data.data(), data.size(), std::nullopt, term, tx);
+    }
+
     DeserialiseSuccess deserialise(
       const std::vector<uint8_t>& data,
       bool public_only = false,
@@ -1687,6 +2872,148 @@ namespace kv
       return deserialise_views(data, public_only, term);
     }
 
+    /**
+     * First stage of deserialise(), which does not depend on the state of
+     * the store: decrypts the transaction and hashes it for the history. It
+     * may run on any thread, before the transactions preceding it are
+     * applied, as long as the encryptor already holds the key for its
+     * version.
+     */
+    PreparedTx prepare_deserialise(
+      std::vector<uint8_t>&& data, bool public_only = false)
+    {
+      PreparedTx prepared;
+      prepared.data = std::move(data);
+      prepared.d = init_deserialiser(
+        prepared.data.data(), prepared.data.size(), public_only);
+      if (get_history() != nullptr)
+        prepared.hash =
+          crypto::Sha256Hash({{prepared.data.data(), prepared.data.size()}});
+
+      return prepared;
+    }
+
+    /**
+     * Second stage of deserialise(), which applies a transaction prepared by
+     * prepare_deserialise() to the store. Must be called in order.
+     */
+    DeserialiseSuccess deserialise(PreparedTx&& prepared, Term* term = nullptr)
+    {
+      if (prepared.d == nullptr)
+        return DeserialiseSuccess::FAILED;
+
+      return deserialise_views(
+        *prepared.d,
+        prepared.data.data(),
+        prepared.data.size(),
+        prepared.hash,
+        term,
+        nullptr);
+    }
+
+    /**
+     * Replaces the state of the replicated maps and the history with a
+     * serialised snapshot, so that only the transactions after the snapshot
+     * version need to be deserialised. The store must not be in use while
+     * the snapshot is installed, and is left cleared if it fails.
+     */
+    DeserialiseSuccess deserialise_snapshot(const std::vector<uint8_t>& data)
+    {
+      auto d = init_deserialiser(data.data(), data.size(), false);
+      if (d == nullptr)
+        return DeserialiseSuccess::FAILED;
+
+      auto v = d->template deserialise_version<Version>();
+      auto tree = d->deserialise_raw();
+
+      auto h = get_history();
+      if (h && tree.empty())
+      {
+        LOG_FAIL_FMT("Snapshot at version {} has no history", v);
+        return DeserialiseSuccess::FAILED;
+      }
+
+      auto success = DeserialiseSuccess::PASS;
+      std::vector<AbstractMap<S, D>*> installed;
+      {
+        std::lock_guard<SpinLock> mguard(maps_lock);
+
+        for (auto& map : maps)
+          map.second->lock();
+
+        // Replicated maps that are not in the snapshot were empty at the
+        // snapshot version.
+        for (auto& map : maps)
+        {
+          if (map.second->is_replicated())
+            map.second->clear();
+        }
+
+        for (auto r = d->start_map(); r.has_value(); r = d->start_map())
+        {
+          const auto map_name = r.value();
+
+          auto search = maps.find(map_name);
+          if (search == maps.end())
+          {
+            LOG_FAIL_FMT("No such map {} in snapshot at {}", map_name, v);
+            success = DeserialiseSuccess::FAILED;
+            break;
+          }
+
+          if (!search->second->deserialise_snapshot(*d))
+          {
+            LOG_FAIL_FMT(
+              "Could not deserialise snapshot of map {} at {}", map_name, v);
+            success = DeserialiseSuccess::FAILED;
+            break;
+          }
+          installed.push_back(search->second.get());
+        }
+
+        if (success && !d->end())
+        {
+          LOG_FAIL_FMT("Unexpected content in snapshot at {}", v);
+          success = DeserialiseSuccess::FAILED;
+        }
+
+        if (!success)
+        {
+          for (auto& map : maps)
+            map.second->clear();
+        }
+
+        for (auto& map : maps)
+          map.second->unlock();
+      }
+
+      {
+        std::lock_guard<SpinLock> vguard(version_lock);
+        version = success ? v : 0;
+        compacted = version;
+        last_replicated = version;
+        last_committable = version;
+        rollback_count++;
+        pending_txs.clear();
+      }
+
+      if (success && h && !h->init_from_snapshot(tree))
+      {
+        LOG_FAIL_FMT("History in snapshot at {} failed to verify", v);
+        clear();
+        return DeserialiseSuccess::FAILED;
+      }
+
+      if (success)
+      {
+        std::lock_guard<SpinLock> mguard(maps_lock);
+        for (auto map : installed)
+          map->post_deserialise_snapshot();
+      }
+
+      return success;
+    }
+
     bool operator==(const Store<S, D>& that) const
     {
       // Only used for debugging, not thread safe.
@@ -1730,8 +3057,13 @@ namespace kv
       return compacted;
     }
 
+    using AbstractStore::commit;
+
     CommitSuccess commit(
-      Version version, PendingTx pending_tx, bool globally_committable) override
+      Version version,
+      PendingTx pending_tx,
+      bool globally_committable,
+      std::optional<crypto::Sha256Hash> hash) override
     {
       auto r = get_consensus();
       if (!r)
@@ -1754,7 +3086,8 @@ namespace kv
 
         pending_txs.insert(
           {version,
-           std::make_pair(std::move(pending_tx), globally_committable)});
+           std::make_tuple(
+             std::move(pending_tx), globally_committable, std::move(hash))});
 
         auto h = get_history();
 
@@ -1764,7 +3097,7 @@ namespace kv
           if (search == pending_txs.end())
             break;
 
-          auto& [pending_tx_, committable_] = search->second;
+          auto& [pending_tx_, committable_, hash_] = search->second;
           auto [success_, reqid, data_] = pending_tx_();
 
           // NB: this cannot happen currently. Regular Tx only make it here if
@@ -1776,7 +3109,10 @@ namespace kv
 
           if (h)
           {
-            h->add_result(reqid, version, data_.data(), data_.size());
+            if (hash_.has_value())
+              h->add_result(reqid, version, hash_.value());
+            else
+              h->add_result(reqid, version, data_.data(), data_.size());
           }
 
           LOG_DEBUG_FMT(
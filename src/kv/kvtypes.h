@@ -11,6 +11,7 @@
 #include <functional>
 #include <limits>
 #include <memory>
+#include <optional>
 #include <unordered_set>
 #include <vector>
 
@@ -26,6 +27,9 @@ namespace kv
   using Term = uint64_t;
   using NodeId = uint64_t;
   static const Version NoVersion = std::numeric_limits<Version>::min();
+  // Dense identifier of a map within its store, assigned when the map is
+  // created
+  using MapHandle = size_t;
 
   using BatchVector =
     std::vector<std::tuple<kv::Version, std::vector<uint8_t>, bool>>;
@@ -119,6 +123,8 @@ namespace kv
     virtual ~TxHistory() {}
     virtual void append(const std::vector<uint8_t>& replicated) = 0;
     virtual void append(const uint8_t* replicated, size_t replicated_size) = 0;
+    // Appends a replicated entry hashed ahead of time
+    virtual void append(const crypto::Sha256Hash& replicated_hash) = 0;
     virtual bool verify(Term* term = nullptr) = 0;
     virtual void emit_signature() = 0;
     virtual bool add_request(
@@ -136,6 +142,16 @@ namespace kv
       const uint8_t* replicated,
       size_t replicated_size) = 0;
     virtual void add_result(RequestID id, kv::Version version) = 0;
+    // Adds the result of a replicated entry hashed ahead of time
+    virtual void add_result(
+      RequestID id,
+      kv::Version version,
+      const crypto::Sha256Hash& replicated_hash) = 0;
+    // Hashes a replicated entry, so that the committing thread can do it
+    // before the entry is ordered. Returns nullopt if the history does not
+    // need the hash.
+    virtual std::optional<crypto::Sha256Hash> hash_entry(
+      const std::vector<uint8_t>& replicated) = 0;
     virtual void add_response(
       RequestID id, const std::vector<uint8_t>& response) = 0;
     virtual void register_on_result(ResultCallbackHandler func) = 0;
@@ -145,6 +161,13 @@ namespace kv
     virtual crypto::Sha256Hash get_replicated_state_root() = 0;
     virtual std::vector<uint8_t> get_receipt(Version v) = 0;
     virtual bool verify_receipt(const std::vector<uint8_t>& receipt) = 0;
+    // Serialises the history as it was at version v, for a snapshot of the
+    // store at that version
+    virtual std::vector<uint8_t> serialise_tree(Version v) = 0;
+    // Replaces the history with the one recorded in a snapshot, after the
+    // snapshot has been installed in the store. Returns false if the history
+    // does not match the latest signature in the snapshot.
+    virtual bool init_from_snapshot(const std::vector<uint8_t>& tree) = 0;
   };
 
   class Consensus
@@ -176,6 +199,21 @@ namespace kv
       std::vector<uint8_t> cert;
     };
 
+    // How the primary currently batches the entries it replicates
+    struct ReplicationMetrics
+    {
+      // Number of entries, and delay in milliseconds, after which new entries
+      // are sent to backups. 0 if entries are not batched adaptively.
+      size_t batch_size;
+      size_t flush_delay_ms;
+      // Why entries were last sent to backups
+      std::string flush_reason;
+      // Time a majority of nodes takes to replicate entries once sent
+      size_t replication_latency_p99_ms;
+      // Entries replicated per second
+      size_t arrival_rate;
+    };
+
     Consensus(NodeId id) : local_id(id), state(Backup){};
     virtual ~Consensus() {}
 
@@ -227,10 +265,28 @@ namespace kv
     }
 
     virtual void periodic(std::chrono::milliseconds elapsed) {}
+    virtual void ledger_durable(SeqNo seqno, size_t truncations) {}
     virtual void enable_all_domains() {}
     virtual void resume_replication() {}
     virtual void suspend_replication(kv::Version) {}
 
+    virtual std::optional<ReplicationMetrics> get_replication_metrics()
+    {
+      return std::nullopt;
+    }
+
+    // A primary that answers reads under a lease must stop once the lease has
+    // lapsed, as another primary may have been elected since
+    virtual bool uses_leader_lease()
+    {
+      return false;
+    }
+
+    virtual bool lease_lapsed()
+    {
+      return false;
+    }
+
     virtual void set_f(ccf::NodeId f) = 0;
     virtual void emit_signature() = 0;
     virtual ConsensusType type() = 0;
@@ -299,6 +355,15 @@ namespace kv
       std::vector<uint8_t>& serialised_header,
       std::vector<uint8_t>& cipher,
       kv::Version version) = 0;
+    // Encrypts plain into cipher, which must have room for plain.n bytes, and
+    // writes the serialised header (get_header_length() bytes) into
+    // serialised_header
+    virtual void encrypt(
+      CBuffer plain,
+      CBuffer additional_data,
+      uint8_t* serialised_header,
+      uint8_t* cipher,
+      kv::Version version) = 0;
     virtual bool decrypt(
       const std::vector<uint8_t>& cipher,
       const std::vector<uint8_t>& additional_data,
@@ -310,6 +375,15 @@ namespace kv
       Version version, const std::vector<uint8_t>& raw_ledger_key) = 0;
   };
 
+  class AbstractExecutor
+  {
+  public:
+    virtual ~AbstractExecutor() {}
+    // Runs all of the tasks, possibly concurrently on several threads, and
+    // returns once they have all completed. Tasks must not throw.
+    virtual void run(std::vector<std::function<void()>>& tasks) = 0;
+  };
+
   class AbstractStore
   {
   public:
@@ -326,8 +400,17 @@ namespace kv
       Term* term = nullptr) = 0;
     virtual void compact(Version v) = 0;
     virtual void rollback(Version v) = 0;
+    // hash is the hash of the pending transaction's entry, if the committing
+    // thread computed it ahead of time
     virtual CommitSuccess commit(
-      Version v, PendingTx pt, bool globally_committable) = 0;
+      Version v,
+      PendingTx pt,
+      bool globally_committable,
+      std::optional<crypto::Sha256Hash> hash) = 0;
+    CommitSuccess commit(Version v, PendingTx pt, bool globally_committable)
+    {
+      return commit(v, std::move(pt), globally_committable, std::nullopt);
+    }
     virtual size_t commit_gap() = 0;
   };
 
@@ -346,17 +429,26 @@ namespace kv
     virtual Version start_order() = 0;
     virtual Version end_order() = 0;
     virtual bool is_replicated() = 0;
+    virtual void set_read_only() = 0;
   };
 
   template <class S, class D>
   class AbstractMap
   {
   public:
+    class Snapshot
+    {
+    public:
+      virtual ~Snapshot() {}
+      virtual void serialise(S& s) = 0;
+    };
+
     virtual ~AbstractMap() {}
     virtual bool operator==(const AbstractMap<S, D>& that) const = 0;
     virtual bool operator!=(const AbstractMap<S, D>& that) const = 0;
 
     virtual AbstractStore* get_store() = 0;
+    virtual MapHandle get_handle() = 0;
     virtual AbstractTxView<S, D>* create_view(Version version) = 0;
     virtual void compact(Version v) = 0;
     virtual void post_compact() = 0;
@@ -366,6 +458,9 @@ namespace kv
     virtual SecurityDomain get_security_domain() = 0;
     virtual bool is_replicated() = 0;
     virtual void clear() = 0;
+    virtual std::unique_ptr<Snapshot> snapshot(Version v) = 0;
+    virtual bool deserialise_snapshot(D& d) = 0;
+    virtual void post_deserialise_snapshot() = 0;
 
     virtual AbstractMap<S, D>* clone(AbstractStore* store) = 0;
     virtual void swap(AbstractMap<S, D>* map) = 0;
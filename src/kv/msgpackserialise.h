@@ -2,11 +2,16 @@
 // Licensed under the Apache 2.0 License.
 #pragma once
 
+#include "../ds/arena.h"
 #include "../ds/msgpack_adaptor_nlohmann.h"
 #include "../ds/serialized.h"
+#include "fixedlayout.h"
 #include "genericserialisewrapper.h"
 #include "kvtypes.h"
 
+#include <algorithm>
+#include <array>
+#include <cstring>
 #include <iterator>
 #include <msgpack-c/msgpack.hpp>
 #include <nlohmann/json.hpp>
@@ -28,32 +33,111 @@ namespace kv
   class GenericDeserialiseWrapper;
   using KvStoreDeserialiser = GenericDeserialiseWrapper<MsgPackReader>;
 
+  // Fixed-layout values are packed as msgpack bins of exactly sizeof(T) bytes,
+  // so that their header is known at compile time
+  template <size_t size>
+  constexpr auto fixed_layout_header()
+  {
+    if constexpr (size <= 0xff)
+      return std::array<char, 2>{char(0xc4), char(size)};
+    else if constexpr (size <= 0xffff)
+      return std::array<char, 3>{char(0xc5), char(size >> 8), char(size)};
+    else
+      return std::array<char, 5>{char(0xc6),
+                                 char(size >> 24),
+                                 char(size >> 16),
+                                 char(size >> 8),
+                                 char(size)};
+  }
+
   class MsgPackWriter
   {
   private:
-    msgpack::sbuffer sb;
+    // Buffers are recycled by each thread, rather than allocated for every
+    // transaction. Buffers that grew larger than max_recycled_size, e.g. to
+    // serialise a snapshot, are freed instead.
+    using BufferPool = ds::ThreadLocalPool<msgpack::sbuffer>;
+    static constexpr size_t max_recycled_size = 1024 * 1024;
+
+    std::unique_ptr<msgpack::sbuffer> sb;
+    size_t max_size = 0;
+
+    // Section sizes are packed as fixed-width uint64s, so that they can be
+    // written before the size of the section is known
+    static constexpr uint8_t uint64_marker = 0xcf;
+    static constexpr size_t section_header_size = 1 + sizeof(uint64_t);
 
   public:
+    MsgPackWriter() : sb(BufferPool::acquire()) {}
+
+    MsgPackWriter(MsgPackWriter&& that) = default;
+
+    ~MsgPackWriter()
+    {
+      if (sb == nullptr)
+        return;
+
+      if (std::max(max_size, sb->size()) <= max_recycled_size)
+      {
+        sb->clear();
+        BufferPool::release(std::move(sb));
+      }
+    }
+
     template <typename T>
     void append(T&& t)
     {
-      msgpack::pack(sb, std::forward<T>(t));
+      if constexpr (is_fixed_layout_v<T>)
+      {
+        constexpr auto header = fixed_layout_header<sizeof(T)>();
+        sb->write(header.data(), header.size());
+        sb->write(reinterpret_cast<const char*>(&t), sizeof(T));
+      }
+      else
+      {
+        msgpack::pack(*sb, std::forward<T>(t));
+      }
+    }
+
+    // Reserves the size of a section that starts after it, and returns its
+    // position, to be passed to end_section() once the section is written
+    size_t start_section()
+    {
+      const auto pos = sb->size();
+      const uint8_t header[section_header_size] = {uint64_marker};
+      sb->write(reinterpret_cast<const char*>(header), sizeof(header));
+      return pos;
+    }
+
+    void end_section(size_t pos)
+    {
+      uint64_t size = sb->size() - pos - section_header_size;
+      auto data = reinterpret_cast<uint8_t*>(sb->data()) + pos + 1;
+      for (size_t i = 0; i < sizeof(uint64_t); ++i)
+        data[i] = (size >> (8 * (sizeof(uint64_t) - 1 - i))) & 0xff;
     }
 
     void clear()
     {
-      sb.clear();
+      max_size = std::max(max_size, sb->size());
+      sb->clear();
     }
 
     bool is_empty()
     {
-      return sb.size() == 0;
+      return sb->size() == 0;
     }
 
     std::vector<uint8_t> get_raw_data()
     {
-      return {reinterpret_cast<uint8_t*>(sb.data()),
-              reinterpret_cast<uint8_t*>(sb.data()) + sb.size()};
+      return {reinterpret_cast<uint8_t*>(sb->data()),
+              reinterpret_cast<uint8_t*>(sb->data()) + sb->size()};
+    }
+
+    // Refers to the serialised data, until the writer is next modified
+    CBuffer get_raw_data_view()
+    {
+      return {reinterpret_cast<const uint8_t*>(sb->data()), sb->size()};
     }
   };
 
@@ -65,6 +149,28 @@ namespace kv
     size_t data_size;
     msgpack::object_handle msg;
 
+  private:
+    template <typename T>
+    T read_fixed_layout(size_t& offset)
+    {
+      constexpr auto header = fixed_layout_header<sizeof(T)>();
+      if (
+        offset > data_size ||
+        data_size - offset < header.size() + sizeof(T) ||
+        memcmp(data_ptr + offset, header.data(), header.size()) != 0)
+      {
+        throw KvSerialiserException(fmt::format(
+          "Expected a value of fixed layout and size {} at offset {}",
+          sizeof(T),
+          offset));
+      }
+
+      T t;
+      memcpy(&t, data_ptr + offset + header.size(), sizeof(T));
+      offset += header.size() + sizeof(T);
+      return t;
+    }
+
   public:
     MsgPackReader(const MsgPackReader& other) = delete;
     MsgPackReader& operator=(const MsgPackReader& other) = delete;
@@ -81,20 +187,53 @@ namespace kv
       data_size = data_in_size;
     }
 
+    // Reads the size bytes that follow the current position of other
+    void init_section(const MsgPackReader& other, size_t size)
+    {
+      data_offset = 0;
+      data_ptr = other.data_ptr + other.data_offset;
+      data_size = size;
+    }
+
+    void skip(size_t size)
+    {
+      data_offset += size;
+    }
+
+    size_t remaining()
+    {
+      return is_eos() ? 0 : data_size - data_offset;
+    }
+
     template <typename T>
     T read_next()
     {
-      msgpack::unpack(msg, data_ptr, data_size, data_offset);
-      return msg->as<T>();
+      if constexpr (is_fixed_layout_v<T>)
+      {
+        return read_fixed_layout<T>(data_offset);
+      }
+      else
+      {
+        msgpack::unpack(msg, data_ptr, data_size, data_offset);
+        return msg->as<T>();
+      }
     }
 
     template <typename T>
     T peek_next()
     {
-      auto before_offset = data_offset;
-      msgpack::unpack(msg, data_ptr, data_size, data_offset);
-      data_offset = before_offset;
-      return msg->as<T>();
+      if constexpr (is_fixed_layout_v<T>)
+      {
+        auto offset = data_offset;
+        return read_fixed_layout<T>(offset);
+      }
+      else
+      {
+        auto before_offset = data_offset;
+        msgpack::unpack(msg, data_ptr, data_size, data_offset);
+        data_offset = before_offset;
+        return msg->as<T>();
+      }
     }
 
     bool is_eos()
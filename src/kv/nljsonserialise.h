@@ -4,9 +4,11 @@
 
 #include "../ds/json.h"
 #include "../ds/serialized.h"
+#include "fixedlayout.h"
 #include "genericserialisewrapper.h"
 #include "kvtypes.h"
 
+#include <cstring>
 #include <iterator>
 #include <nlohmann/json.hpp>
 #include <sstream>
@@ -28,13 +30,35 @@ namespace kv
   {
   private:
     nlohmann::json arr;
+    std::vector<uint8_t> raw;
 
   public:
     template <typename T>
     void append(T&& t)
     {
-      nlohmann::json obj = t;
-      arr.push_back(obj);
+      if constexpr (is_fixed_layout_v<T>)
+      {
+        auto data = reinterpret_cast<const uint8_t*>(&t);
+        arr.push_back(std::vector<uint8_t>(data, data + sizeof(T)));
+      }
+      else
+      {
+        nlohmann::json obj = t;
+        arr.push_back(obj);
+      }
+    }
+
+    // Reserves the size of a section that starts after it, and returns its
+    // position, to be passed to end_section() once the section is written
+    size_t start_section()
+    {
+      arr.push_back(0);
+      return arr.size();
+    }
+
+    void end_section(size_t pos)
+    {
+      arr[pos - 1] = arr.size() - pos;
     }
 
     void clear()
@@ -51,13 +75,22 @@ namespace kv
     {
       return nlohmann::json::to_msgpack(arr);
     }
+
+    // Refers to the serialised data, until the writer is next modified
+    CBuffer get_raw_data_view()
+    {
+      raw = nlohmann::json::to_msgpack(arr);
+      return raw;
+    }
   };
 
   class JsonReader
   {
   public:
-    nlohmann::json arr;
+    // Shared with the readers of sections of the same transaction
+    std::shared_ptr<const nlohmann::json> arr;
     size_t data_offset;
+    size_t data_end;
 
   public:
     JsonReader(const JsonReader& other) = delete;
@@ -73,9 +106,32 @@ namespace kv
       data_offset = 0;
       if (data_in_ptr && data_in_size)
       {
-        arr =
-          nlohmann::json::from_msgpack(data_in_ptr, data_in_ptr + data_in_size);
+        arr = std::make_shared<nlohmann::json>(nlohmann::json::from_msgpack(
+          data_in_ptr, data_in_ptr + data_in_size));
+      }
+      else
+      {
+        arr = std::make_shared<nlohmann::json>();
       }
+      data_end = arr->size();
+    }
+
+    // Reads the size entries that follow the current position of other
+    void init_section(const JsonReader& other, size_t size)
+    {
+      arr = other.arr;
+      data_offset = other.data_offset;
+      data_end = data_offset + size;
+    }
+
+    void skip(size_t size)
+    {
+      data_offset += size;
+    }
+
+    size_t remaining()
+    {
+      return is_eos() ? 0 : data_end - data_offset;
     }
 
     template <typename T>
@@ -89,13 +145,32 @@ namespace kv
     template <typename T>
     T peek_next()
     {
-      T ret = arr[data_offset];
-      return ret;
+      if constexpr (is_fixed_layout_v<T>)
+      {
+        const auto& j = (*arr)[data_offset];
+        if (!j.is_array() || j.size() != sizeof(T))
+        {
+          throw KvSerialiserException(fmt::format(
+            "Expected a value of fixed layout and size {}, got {}",
+            sizeof(T),
+            j.dump()));
+        }
+
+        const auto data = j.get<std::vector<uint8_t>>();
+        T ret;
+        memcpy(&ret, data.data(), sizeof(T));
+        return ret;
+      }
+      else
+      {
+        T ret = (*arr)[data_offset];
+        return ret;
+      }
     }
 
     bool is_eos()
     {
-      return data_offset >= arr.size();
+      return data_offset >= data_end;
     }
   };
 }
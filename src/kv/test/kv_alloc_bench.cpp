@@ -0,0 +1,125 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the Apache 2.0 License.
+#define PICOBENCH_IMPLEMENT_WITH_MAIN
+
+#include "enclave/appinterface.h"
+#include "kv/kv.h"
+#include "node/encryptor.h"
+#include "stub_consensus.h"
+
+#include <picobench/picobench.hpp>
+#include <set>
+#include <string>
+
+using namespace ccfapp;
+using namespace ccf;
+
+// Heap allocations are counted to measure the number of allocations made by
+// each transaction. This replaces the allocator for the whole binary, so it
+// is kept apart from the timing benchmarks in kv_bench. Only allocations made
+// by the benchmark's thread while counting is enabled are counted.
+static thread_local bool counting_allocations = false;
+static thread_local size_t allocation_count = 0;
+
+extern "C"
+{
+  void* __libc_malloc(size_t size);
+  void* __libc_calloc(size_t n, size_t size);
+  void* __libc_realloc(void* p, size_t size);
+
+  void* malloc(size_t size)
+  {
+    if (counting_allocations)
+      allocation_count++;
+    return __libc_malloc(size);
+  }
+
+  void* calloc(size_t n, size_t size)
+  {
+    if (counting_allocations)
+      allocation_count++;
+    return __libc_calloc(n, size);
+  }
+
+  void* realloc(void* p, size_t size)
+  {
+    if (counting_allocations)
+      allocation_count++;
+    return __libc_realloc(p, size);
+  }
+}
+
+// Helper functions to use a dummy encryption key
+std::shared_ptr<ccf::LedgerSecrets> create_ledger_secrets()
+{
+  auto secrets = std::make_shared<ccf::LedgerSecrets>();
+  auto new_secret = ccf::LedgerSecret(true);
+  secrets->set_secret(
+    1, new_secret.master); // Create new secrets valid from version 1
+
+  return secrets;
+}
+
+// Test functions
+template <kv::SecurityDomain SD>
+static void commit_allocations(picobench::state& s)
+{
+  logger::config::level() = logger::INFO;
+
+  Store kv_store;
+  auto secrets = create_ledger_secrets();
+  auto encryptor = std::make_shared<ccf::TxEncryptor>(0x1, secrets);
+  kv_store.set_encryptor(encryptor);
+
+  auto& map0 = kv_store.create<std::string, std::string>("map0", SD);
+  auto& map1 = kv_store.create<std::string, std::string>("map1", SD);
+
+  auto commit_tx = [&](int i) {
+    Store::Tx tx;
+    auto [tx0, tx1] = tx.get_view(map0, map1);
+    auto key = "key" + std::to_string(i % 10);
+    tx0->get(key);
+    tx1->put(key, "value");
+
+    auto rc = tx.commit();
+    if (rc != kv::CommitSuccess::OK)
+      throw std::logic_error(
+        "Transaction commit failed: " + std::to_string(rc));
+  };
+
+  // Transactions after the first reuse the memory recycled by their thread
+  commit_tx(0);
+
+  allocation_count = 0;
+  counting_allocations = true;
+  s.start_timer();
+  for (int i = 0; i < s.iterations(); i++)
+    commit_tx(i);
+  s.stop_timer();
+  counting_allocations = false;
+  auto allocations = allocation_count;
+
+  static std::set<std::pair<kv::SecurityDomain, int>> reported;
+  if (reported.emplace(SD, s.iterations()).second)
+  {
+    std::cout << fmt::format(
+                   "commit_allocations<{}>: {} allocations per transaction",
+                   SD == kv::SecurityDomain::PUBLIC ? "PUBLIC" : "PRIVATE",
+                   (double)allocations / s.iterations())
+              << std::endl;
+  }
+}
+
+const std::vector<int> tx_count = {10, 100, 200};
+const uint32_t sample_size = 100;
+
+using SD = kv::SecurityDomain;
+
+PICOBENCH_SUITE("commit_allocations");
+PICOBENCH(commit_allocations<SD::PUBLIC>)
+  .iterations(tx_count)
+  .samples(sample_size)
+  .baseline();
+PICOBENCH(commit_allocations<SD::PRIVATE>)
+  .iterations(tx_count)
+  .samples(sample_size);
@@ -7,8 +7,10 @@
 #include "node/encryptor.h"
 #include "stub_consensus.h"
 
+#include <atomic>
 #include <picobench/picobench.hpp>
 #include <string>
+#include <thread>
 
 using namespace ccfapp;
 using namespace ccf;
@@ -91,7 +93,275 @@ static void deserialise(picobench::state& s)
   s.stop_timer();
 }
 
+// Values of the same layout, packed by the serialiser or copied as is
+struct PackedValue
+{
+  uint64_t balance;
+  uint64_t nonce;
+  uint64_t updated;
+  uint64_t flags;
+
+  MSGPACK_DEFINE(balance, nonce, updated, flags);
+};
+DECLARE_JSON_TYPE(PackedValue)
+DECLARE_JSON_REQUIRED_FIELDS(PackedValue, balance, nonce, updated, flags)
+
+struct FixedLayoutValue
+{
+  uint64_t balance;
+  uint64_t nonce;
+  uint64_t updated;
+  uint64_t flags;
+};
+DECLARE_KV_FIXED_LAYOUT(FixedLayoutValue)
+
+template <typename V>
+static void serialise_values(picobench::state& s)
+{
+  logger::config::level() = logger::INFO;
+
+  Store kv_store;
+  auto& map = kv_store.create<size_t, V>("map", kv::SecurityDomain::PUBLIC);
+  Store::Tx tx;
+  auto view = tx.get_view(map);
+
+  for (size_t i = 0; i < s.iterations(); i++)
+    view->put(i, {i, i, i, i});
+
+  s.start_timer();
+  auto rc = tx.commit();
+  if (rc != kv::CommitSuccess::OK)
+    throw std::logic_error("Transaction commit failed: " + std::to_string(rc));
+  s.stop_timer();
+}
+
+template <typename V>
+static void deserialise_values(picobench::state& s)
+{
+  logger::config::level() = logger::INFO;
+
+  auto consensus = std::make_shared<kv::StubConsensus>();
+  Store kv_store(consensus);
+  Store kv_store2;
+
+  auto& map = kv_store.create<size_t, V>("map", kv::SecurityDomain::PUBLIC);
+  kv_store2.clone_schema(kv_store);
+  Store::Tx tx;
+  auto view = tx.get_view(map);
+
+  for (size_t i = 0; i < s.iterations(); i++)
+    view->put(i, {i, i, i, i});
+  tx.commit();
+
+  s.start_timer();
+  auto rc = kv_store2.deserialise(consensus->get_latest_data().first);
+  if (rc != kv::DeserialiseSuccess::PASS)
+    throw std::logic_error(
+      "Transaction deserialisation failed: " + std::to_string(rc));
+  s.stop_timer();
+}
+
+// Each transaction updates one of a fixed set of keys, so that the ledger grows
+// with the number of transactions while the state does not
+const size_t join_key_count = 100;
+// Number of transactions committed after the snapshot, to be replayed by the
+// joining node
+const size_t join_suffix_count = 10;
+
+template <kv::SecurityDomain SD>
+static std::vector<std::vector<uint8_t>> make_join_ledger(
+  picobench::state& s,
+  std::shared_ptr<kv::StubConsensus> consensus,
+  Store& kv_store)
+{
+  auto& map = kv_store.create<std::string, std::string>("map", SD);
+
+  for (int i = 0; i < s.iterations(); i++)
+  {
+    Store::Tx tx;
+    auto view = tx.get_view(map);
+    view->put("key" + std::to_string(i % join_key_count), std::to_string(i));
+    tx.commit();
+  }
+
+  std::vector<std::vector<uint8_t>> ledger;
+  for (auto data = consensus->pop_oldest_data(); data.second;
+       data = consensus->pop_oldest_data())
+  {
+    ledger.push_back(data.first);
+  }
+  return ledger;
+}
+
+template <kv::SecurityDomain SD>
+static void replay_ledger(picobench::state& s)
+{
+  logger::config::level() = logger::INFO;
+
+  auto consensus = std::make_shared<kv::StubConsensus>();
+  Store kv_store(consensus);
+  Store kv_store2;
+
+  auto secrets = create_ledger_secrets();
+  auto encryptor = std::make_shared<ccf::TxEncryptor>(0x1, secrets);
+  kv_store.set_encryptor(encryptor);
+  kv_store2.set_encryptor(encryptor);
+
+  auto ledger = make_join_ledger<SD>(s, consensus, kv_store);
+  kv_store2.clone_schema(kv_store);
+
+  s.start_timer();
+  for (auto& entry : ledger)
+  {
+    auto rc = kv_store2.deserialise(entry);
+    if (rc != kv::DeserialiseSuccess::PASS)
+      throw std::logic_error(
+        "Transaction deserialisation failed: " + std::to_string(rc));
+  }
+  s.stop_timer();
+}
+
+template <kv::SecurityDomain SD>
+static void install_snapshot(picobench::state& s)
+{
+  logger::config::level() = logger::INFO;
+
+  auto consensus = std::make_shared<kv::StubConsensus>();
+  Store kv_store(consensus);
+  Store kv_store2;
+
+  auto secrets = create_ledger_secrets();
+  auto encryptor = std::make_shared<ccf::TxEncryptor>(0x1, secrets);
+  kv_store.set_encryptor(encryptor);
+  kv_store2.set_encryptor(encryptor);
+
+  auto ledger = make_join_ledger<SD>(s, consensus, kv_store);
+  kv_store2.clone_schema(kv_store);
+
+  auto snapshot_version = kv_store.current_version() - join_suffix_count;
+  kv_store.compact(snapshot_version);
+  auto snapshot = kv_store.snapshot(snapshot_version)->serialise();
+
+  s.start_timer();
+  auto rc = kv_store2.deserialise_snapshot(snapshot);
+  if (rc != kv::DeserialiseSuccess::PASS)
+    throw std::logic_error(
+      "Snapshot deserialisation failed: " + std::to_string(rc));
+
+  for (auto entry = ledger.end() - join_suffix_count; entry != ledger.end();
+       ++entry)
+  {
+    rc = kv_store2.deserialise(*entry);
+    if (rc != kv::DeserialiseSuccess::PASS)
+      throw std::logic_error(
+        "Transaction deserialisation failed: " + std::to_string(rc));
+  }
+  s.stop_timer();
+}
+
+// Each worker commits its share of the transactions against the same map,
+// writing to its own keys so that transactions do not conflict
+const size_t parallel_key_count = 10;
+
+template <size_t threads>
+static void commit_parallel(picobench::state& s)
+{
+  logger::config::level() = logger::INFO;
+
+  Store kv_store;
+  auto secrets = create_ledger_secrets();
+  auto encryptor = std::make_shared<ccf::TxEncryptor>(0x1, secrets);
+  kv_store.set_encryptor(encryptor);
+
+  auto& map = kv_store.create<std::string, std::string>(
+    "map", kv::SecurityDomain::PRIVATE);
+
+  SpinLock create_lock;
+  std::atomic<size_t> num_pending_threads = threads;
+  std::vector<std::thread> workers;
+
+  s.start_timer();
+  for (size_t t = 0; t < threads; t++)
+  {
+    workers.emplace_back([&, t]() {
+      // Workers are registered as enclave threads are, so that each uses its
+      // own encryption context
+      {
+        std::lock_guard<SpinLock> guard(create_lock);
+        thread_ids[std::this_thread::get_id()] = t + 1;
+        num_pending_threads.fetch_sub(1);
+      }
+
+      while (num_pending_threads != 0)
+      {
+      }
+
+      for (int i = t; i < s.iterations(); i += threads)
+      {
+        auto key = fmt::format("{}.{}", t, i % parallel_key_count);
+        while (true)
+        {
+          Store::Tx tx;
+          auto view = tx.get_view(map);
+          auto count = view->get(key).value_or("");
+          view->put(key, count + "+");
+
+          if (tx.commit() == kv::CommitSuccess::OK)
+            break;
+        }
+      }
+    });
+  }
+
+  for (auto& worker : workers)
+    worker.join();
+  s.stop_timer();
+}
+
+// Each transaction reads a few keys, as read-only endpoints such as LOG_GET do
+const size_t read_key_count = 1000;
+const size_t reads_per_tx = 10;
+
+template <bool read_only>
+static void read(picobench::state& s)
+{
+  logger::config::level() = logger::INFO;
+
+  Store kv_store;
+  auto& map = kv_store.create<std::string, std::string>(
+    "map", kv::SecurityDomain::PUBLIC);
+
+  {
+    Store::Tx tx;
+    auto view = tx.get_view(map);
+    for (size_t i = 0; i < read_key_count; i++)
+      view->put("key" + std::to_string(i), "value");
+    tx.commit();
+  }
+
+  s.start_timer();
+  for (int i = 0; i < s.iterations(); i++)
+  {
+    Store::Tx tx;
+    if (read_only)
+      tx.set_read_only();
+    auto view = tx.get_view(map);
+    for (size_t j = 0; j < reads_per_tx; j++)
+      view->get("key" + std::to_string((i + j) % read_key_count));
+
+    auto rc = tx.commit();
+    if (rc != kv::CommitSuccess::OK)
+      throw std::logic_error(
+        "Transaction commit failed: " + std::to_string(rc));
+  }
+  s.stop_timer();
+}
+
 const std::vector<int> tx_count = {10, 100, 200};
+const std::vector<int> value_count = {1000, 10000};
+const std::vector<int> join_tx_count = {1000, 10000};
+const std::vector<int> parallel_tx_count = {10000};
+const std::vector<int> read_tx_count = {1000, 10000};
 const uint32_t sample_size = 100;
 
 using SD = kv::SecurityDomain;
@@ -109,3 +379,43 @@ PICOBENCH(deserialise<SD::PUBLIC>)
   .samples(sample_size)
   .baseline();
 PICOBENCH(deserialise<SD::PRIVATE>).iterations(tx_count).samples(sample_size);
+
+PICOBENCH_SUITE("serialise_values");
+PICOBENCH(serialise_values<PackedValue>)
+  .iterations(value_count)
+  .samples(sample_size)
+  .baseline();
+PICOBENCH(serialise_values<FixedLayoutValue>)
+  .iterations(value_count)
+  .samples(sample_size);
+
+PICOBENCH_SUITE("deserialise_values");
+PICOBENCH(deserialise_values<PackedValue>)
+  .iterations(value_count)
+  .samples(sample_size)
+  .baseline();
+PICOBENCH(deserialise_values<FixedLayoutValue>)
+  .iterations(value_count)
+  .samples(sample_size);
+
+PICOBENCH_SUITE("join");
+PICOBENCH(replay_ledger<SD::PUBLIC>)
+  .iterations(join_tx_count)
+  .samples(10)
+  .baseline();
+PICOBENCH(install_snapshot<SD::PUBLIC>).iterations(join_tx_count).samples(10);
+PICOBENCH(replay_ledger<SD::PRIVATE>).iterations(join_tx_count).samples(10);
+PICOBENCH(install_snapshot<SD::PRIVATE>).iterations(join_tx_count).samples(10);
+
+PICOBENCH_SUITE("read");
+PICOBENCH(read<false>).iterations(read_tx_count).samples(10).baseline();
+PICOBENCH(read<true>).iterations(read_tx_count).samples(10);
+
+PICOBENCH_SUITE("commit_parallel");
+PICOBENCH(commit_parallel<1>)
+  .iterations(parallel_tx_count)
+  .samples(10)
+  .baseline();
+PICOBENCH(commit_parallel<2>).iterations(parallel_tx_count).samples(10);
+PICOBENCH(commit_parallel<4>).iterations(parallel_tx_count).samples(10);
+PICOBENCH(commit_parallel<8>).iterations(parallel_tx_count).samples(10);
@@ -5,11 +5,14 @@
 #include "kv/kv.h"
 #include "kv/kvserialiser.h"
 #include "node/encryptor.h"
+#include "node/history.h"
 #include "stub_consensus.h"
 
+#include <array>
 #include <doctest/doctest.h>
 #include <msgpack-c/msgpack.hpp>
 #include <string>
+#include <thread>
 #include <vector>
 
 using namespace ccf;
@@ -193,6 +196,155 @@ TEST_CASE(
   }
 }
 
+TEST_CASE(
+  "Deserialise prepared transactions" * doctest::test_suite("serialisation"))
+{
+  auto consensus = std::make_shared<kv::StubConsensus>();
+  auto encryptor = std::make_shared<ccf::NullTxEncryptor>();
+
+  Store kv_store(consensus);
+  kv_store.set_encryptor(encryptor);
+  Store kv_store_target;
+  kv_store_target.set_encryptor(encryptor);
+
+  auto& priv_map = kv_store.create<std::string, std::string>("priv_map");
+  auto& pub_map = kv_store.create<std::string, std::string>(
+    "pub_map", kv::SecurityDomain::PUBLIC);
+  kv_store_target.clone_schema(kv_store);
+
+  const size_t tx_count = 5;
+  for (size_t i = 0; i < tx_count; ++i)
+  {
+    Store::Tx tx;
+    auto [view_priv, view_pub] = tx.get_view(priv_map, pub_map);
+    view_priv->put("privk", std::to_string(i));
+    view_pub->put("pubk", std::to_string(i));
+    REQUIRE(tx.commit() == kv::CommitSuccess::OK);
+  }
+
+  std::vector<std::vector<uint8_t>> entries;
+  for (auto data = consensus->pop_oldest_data(); data.second;
+       data = consensus->pop_oldest_data())
+  {
+    entries.push_back(data.first);
+  }
+  REQUIRE(entries.size() == tx_count);
+
+  INFO("Transactions are prepared ahead of being applied");
+  std::vector<Store::PreparedTx> prepared;
+  for (auto& entry : entries)
+  {
+    prepared.push_back(
+      kv_store_target.prepare_deserialise(std::vector<uint8_t>(entry)));
+  }
+  REQUIRE(kv_store_target.current_version() == 0);
+
+  INFO("Prepared transactions must be applied in order");
+  REQUIRE(
+    kv_store_target.deserialise(kv_store_target.prepare_deserialise(
+      std::vector<uint8_t>(entries[1]))) == kv::DeserialiseSuccess::FAILED);
+
+  for (auto& p : prepared)
+  {
+    REQUIRE(
+      kv_store_target.deserialise(std::move(p)) ==
+      kv::DeserialiseSuccess::PASS);
+  }
+  REQUIRE(kv_store_target.current_version() == tx_count);
+
+  Store::Tx tx_target;
+  auto [view_priv, view_pub] = tx_target.get_view(
+    *kv_store_target.get<std::string, std::string>("priv_map"),
+    *kv_store_target.get<std::string, std::string>("pub_map"));
+  REQUIRE(view_priv->get("privk") == std::to_string(tx_count - 1));
+  REQUIRE(view_pub->get("pubk") == std::to_string(tx_count - 1));
+}
+
+class ThreadExecutor : public kv::AbstractExecutor
+{
+public:
+  size_t batches = 0;
+
+  void run(std::vector<std::function<void()>>& tasks) override
+  {
+    batches++;
+    std::vector<std::thread> threads;
+    for (auto& task : tasks)
+      threads.emplace_back(task);
+    for (auto& thread : threads)
+      thread.join();
+  }
+};
+
+TEST_CASE(
+  "Deserialise maps concurrently" * doctest::test_suite("serialisation"))
+{
+  auto consensus = std::make_shared<kv::StubConsensus>();
+  auto encryptor = std::make_shared<ccf::NullTxEncryptor>();
+  auto executor = std::make_shared<ThreadExecutor>();
+
+  Store kv_store(consensus);
+  kv_store.set_encryptor(encryptor);
+  Store kv_store_target;
+  kv_store_target.set_encryptor(encryptor);
+  kv_store_target.set_executor(executor);
+
+  constexpr size_t map_count = 4;
+  std::vector<Store::Map<std::string, std::string>*> maps;
+  for (size_t i = 0; i < map_count; ++i)
+  {
+    maps.push_back(&kv_store.create<std::string, std::string>(
+      "map" + std::to_string(i),
+      i % 2 == 0 ? kv::SecurityDomain::PRIVATE : kv::SecurityDomain::PUBLIC));
+  }
+  kv_store_target.clone_schema(kv_store);
+
+  const std::string large_value(1024, 'x');
+  const size_t large_count = 16;
+
+  INFO("Small transactions are deserialised on the calling thread");
+  {
+    Store::Tx tx;
+    for (auto map : maps)
+      tx.get_view(*map)->put("key", "value");
+    REQUIRE(tx.commit() == kv::CommitSuccess::OK);
+
+    REQUIRE(
+      kv_store_target.deserialise(consensus->get_latest_data().first) ==
+      kv::DeserialiseSuccess::PASS);
+    REQUIRE(executor->batches == 0);
+  }
+
+  INFO("Maps of large transactions are deserialised and committed by tasks");
+  {
+    Store::Tx tx;
+    for (auto map : maps)
+    {
+      auto view = tx.get_view(*map);
+      view->remove("key");
+      for (size_t i = 0; i < large_count; ++i)
+        view->put(std::to_string(i), large_value);
+    }
+    REQUIRE(tx.commit() == kv::CommitSuccess::OK);
+
+    REQUIRE(
+      kv_store_target.deserialise(consensus->get_latest_data().first) ==
+      kv::DeserialiseSuccess::PASS);
+    REQUIRE(executor->batches == 2);
+  }
+
+  REQUIRE(kv_store_target.current_version() == 2);
+  for (size_t i = 0; i < map_count; ++i)
+  {
+    Store::Tx tx;
+    auto view = tx.get_view(*kv_store_target.get<std::string, std::string>(
+      "map" + std::to_string(i)));
+    REQUIRE(!view->get("key").has_value());
+    for (size_t j = 0; j < large_count; ++j)
+      REQUIRE(view->get(std::to_string(j)) == large_value);
+  }
+}
+
 TEST_CASE(
   "Serialise/deserialise removed keys" * doctest::test_suite("serialisation"))
 {
@@ -531,4 +683,294 @@ TEST_CASE("Exceptional serdes" * doctest::test_suite("serialisation"))
 
     REQUIRE_THROWS_AS(tx.commit(), kv::KvSerialiserException);
   }
-}
\ No newline at end of file
+}
+
+struct FixedLayoutKey
+{
+  uint64_t id;
+  uint32_t major;
+  uint32_t minor;
+
+  bool operator==(const FixedLayoutKey& other) const
+  {
+    return id == other.id && major == other.major && minor == other.minor;
+  }
+};
+
+struct FixedLayoutValue
+{
+  uint64_t counter;
+  std::array<uint8_t, 16> digest;
+};
+
+namespace std
+{
+  template <>
+  struct hash<FixedLayoutKey>
+  {
+    std::size_t operator()(const FixedLayoutKey& key) const
+    {
+      return key.id ^ ((size_t)key.major << 32) ^ key.minor;
+    }
+  };
+}
+
+// Neither type has a msgpack or JSON representation
+DECLARE_KV_FIXED_LAYOUT(FixedLayoutKey)
+DECLARE_KV_FIXED_LAYOUT(FixedLayoutValue)
+
+TEST_CASE("Fixed layout serialisation" * doctest::test_suite("serialisation"))
+{
+  auto encryptor = std::make_shared<ccf::NullTxEncryptor>();
+  auto consensus = std::make_shared<kv::StubConsensus>();
+
+  Store store(consensus);
+  store.set_encryptor(encryptor);
+  auto& fixed_map = store.create<FixedLayoutKey, FixedLayoutValue>(
+    "fixed_map", kv::SecurityDomain::PUBLIC);
+  auto& mixed_map = store.create<FixedLayoutKey, std::string>("mixed_map");
+
+  Store target_store;
+  target_store.set_encryptor(encryptor);
+  target_store.clone_schema(store);
+
+  const FixedLayoutKey k1{1, 2, 3};
+  const FixedLayoutKey k2{4, 5, 6};
+  FixedLayoutValue v1{42, {}};
+  v1.digest.fill(0xab);
+
+  INFO("Fixed layout keys and values are serialised with other types");
+  {
+    Store::Tx tx;
+    auto [fixed_view, mixed_view] = tx.get_view(fixed_map, mixed_map);
+    fixed_view->put(k1, v1);
+    fixed_view->put(k2, {43, {}});
+    fixed_view->remove(k2);
+    mixed_view->put(k1, "value");
+    REQUIRE(tx.commit() == kv::CommitSuccess::OK);
+
+    REQUIRE(
+      target_store.deserialise(consensus->get_latest_data().first) ==
+      kv::DeserialiseSuccess::PASS);
+
+    Store::Tx target_tx;
+    auto [target_fixed_view, target_mixed_view] = target_tx.get_view(
+      *target_store.get<FixedLayoutKey, FixedLayoutValue>("fixed_map"),
+      *target_store.get<FixedLayoutKey, std::string>("mixed_map"));
+    auto v = target_fixed_view->get(k1);
+    REQUIRE(v.has_value());
+    REQUIRE(v->counter == v1.counter);
+    REQUIRE(v->digest == v1.digest);
+    REQUIRE(!target_fixed_view->get(k2).has_value());
+    REQUIRE(target_mixed_view->get(k1) == "value");
+  }
+
+  INFO("Values of other types are not read as fixed layout values");
+  {
+    auto& map = store.create<uint64_t, uint64_t>(
+      "map", kv::SecurityDomain::PUBLIC);
+    target_store.create<uint64_t, FixedLayoutValue>(
+      "map", kv::SecurityDomain::PUBLIC);
+
+    Store::Tx tx;
+    auto view = tx.get_view(map);
+    view->put(1, 42);
+    REQUIRE(tx.commit() == kv::CommitSuccess::OK);
+
+    REQUIRE_THROWS_AS(
+      target_store.deserialise(consensus->get_latest_data().first),
+      kv::KvSerialiserException);
+  }
+}
+
+// Serialises a placeholder tree into snapshots, and rejects any snapshot it
+// is asked to verify
+class UnverifiableHistory : public ccf::NullTxHistory
+{
+public:
+  using NullTxHistory::NullTxHistory;
+
+  std::vector<uint8_t> serialise_tree(kv::Version v) override
+  {
+    return {1};
+  }
+
+  bool init_from_snapshot(const std::vector<uint8_t>& tree) override
+  {
+    return false;
+  }
+};
+
+TEST_CASE("Snapshot" * doctest::test_suite("serialisation"))
+{
+  auto encryptor = std::make_shared<ccf::NullTxEncryptor>();
+  auto consensus = std::make_shared<kv::StubConsensus>();
+
+  Store store(consensus);
+  store.set_encryptor(encryptor);
+
+  auto& public_map = store.create<std::string, std::string>(
+    "public", kv::SecurityDomain::PUBLIC);
+  auto& private_map = store.create<std::string, std::string>("private");
+  store.create<std::string, std::string>("empty");
+
+  {
+    Store::Tx tx;
+    auto [public_view, private_view] = tx.get_view(public_map, private_map);
+    public_view->put("key0", "value0");
+    private_view->put("key0", "value0");
+    REQUIRE(tx.commit() == kv::CommitSuccess::OK);
+  }
+
+  {
+    Store::Tx tx;
+    auto [public_view, private_view] = tx.get_view(public_map, private_map);
+    public_view->put("key1", "value1");
+    private_view->remove("key0");
+    REQUIRE(tx.commit() == kv::CommitSuccess::OK);
+  }
+
+  INFO("Only committed versions can be snapshotted");
+  {
+    REQUIRE_THROWS_AS(store.snapshot(2), std::logic_error);
+    store.compact(2);
+  }
+
+  auto snapshot = store.snapshot(2);
+  REQUIRE(snapshot->get_version() == 2);
+
+  INFO("Later transactions are not included in the snapshot");
+  {
+    Store::Tx tx;
+    auto public_view = tx.get_view(public_map);
+    public_view->put("key0", "value2");
+    REQUIRE(tx.commit() == kv::CommitSuccess::OK);
+  }
+
+  INFO("Versions which have been compacted cannot be snapshotted");
+  {
+    REQUIRE_THROWS_AS(store.snapshot(1), std::logic_error);
+  }
+
+  auto serialised_snapshot = snapshot->serialise();
+
+  INFO("Install the snapshot and replay the transactions after it");
+  {
+    Store target_store;
+    target_store.set_encryptor(encryptor);
+    target_store.clone_schema(store);
+
+    REQUIRE(
+      target_store.deserialise_snapshot(serialised_snapshot) ==
+      kv::DeserialiseSuccess::PASS);
+    REQUIRE(target_store.current_version() == 2);
+    REQUIRE(target_store.commit_version() == 2);
+
+    auto target_public_map =
+      target_store.get<std::string, std::string>("public");
+    auto target_private_map =
+      target_store.get<std::string, std::string>("private");
+    {
+      Store::Tx tx;
+      auto [public_view, private_view] =
+        tx.get_view(*target_public_map, *target_private_map);
+      REQUIRE(public_view->get("key0") == "value0");
+      REQUIRE(public_view->get("key1") == "value1");
+      REQUIRE(!private_view->get("key0").has_value());
+    }
+
+    consensus->pop_oldest_data();
+    consensus->pop_oldest_data();
+    auto [suffix, ok] = consensus->pop_oldest_data();
+    REQUIRE(ok);
+    REQUIRE(target_store.deserialise(suffix) == kv::DeserialiseSuccess::PASS);
+    REQUIRE(target_store == store);
+  }
+
+  INFO("Local hooks are run on the installed state");
+  {
+    using MapType = Store::Map<std::string, std::string>;
+    std::vector<std::pair<kv::Version, MapType::Write>> hook_calls;
+
+    Store target_store;
+    target_store.set_encryptor(encryptor);
+    target_store.create<std::string, std::string>(
+      "public",
+      kv::SecurityDomain::PUBLIC,
+      [&](kv::Version v, const MapType::State&, const MapType::Write& w) {
+        hook_calls.emplace_back(v, w);
+      });
+    target_store.create<std::string, std::string>("private");
+    target_store.create<std::string, std::string>("empty");
+
+    REQUIRE(
+      target_store.deserialise_snapshot(serialised_snapshot) ==
+      kv::DeserialiseSuccess::PASS);
+    REQUIRE(hook_calls.size() == 1);
+    REQUIRE(hook_calls[0].first == 2);
+    REQUIRE(hook_calls[0].second.size() == 2);
+    REQUIRE(hook_calls[0].second.at("key0").value == "value0");
+    REQUIRE(hook_calls[0].second.at("key1").value == "value1");
+  }
+
+  INFO("Local hooks are not run if the snapshot fails to verify");
+  {
+    using MapType = Store::Map<std::string, std::string>;
+    auto kp = tls::make_key_pair();
+
+    Store source_store;
+    source_store.set_encryptor(encryptor);
+    auto& source_map = source_store.create<std::string, std::string>(
+      "public", kv::SecurityDomain::PUBLIC);
+    auto& source_signatures = source_store.create<ccf::Signatures>(
+      ccf::Tables::SIGNATURES, kv::SecurityDomain::PUBLIC);
+    auto& source_nodes = source_store.create<ccf::Nodes>(
+      ccf::Tables::NODES, kv::SecurityDomain::PUBLIC);
+    source_store.set_history(std::make_shared<UnverifiableHistory>(
+      source_store, 0, *kp, source_signatures, source_nodes));
+
+    {
+      Store::Tx tx;
+      auto view = tx.get_view(source_map);
+      view->put("key0", "value0");
+      REQUIRE(tx.commit() == kv::CommitSuccess::OK);
+    }
+    source_store.compact(1);
+    auto unverifiable_snapshot = source_store.snapshot(1)->serialise();
+
+    size_t hook_calls = 0;
+    Store target_store;
+    target_store.set_encryptor(encryptor);
+    target_store.create<std::string, std::string>(
+      "public",
+      kv::SecurityDomain::PUBLIC,
+      [&](kv::Version, const MapType::State&, const MapType::Write&) {
+        hook_calls++;
+      });
+    auto& target_signatures = target_store.create<ccf::Signatures>(
+      ccf::Tables::SIGNATURES, kv::SecurityDomain::PUBLIC);
+    auto& target_nodes = target_store.create<ccf::Nodes>(
+      ccf::Tables::NODES, kv::SecurityDomain::PUBLIC);
+    target_store.set_history(std::make_shared<UnverifiableHistory>(
+      target_store, 1, *kp, target_signatures, target_nodes));
+
+    REQUIRE(
+      target_store.deserialise_snapshot(unverifiable_snapshot) ==
+      kv::DeserialiseSuccess::FAILED);
+    REQUIRE(hook_calls == 0);
+    REQUIRE(target_store.current_version() == 0);
+  }
+
+  INFO("A snapshot cannot be installed in a store with a different schema");
+  {
+    Store target_store;
+    target_store.set_encryptor(encryptor);
+    target_store.create<std::string, std::string>(
+      "public", kv::SecurityDomain::PUBLIC);
+
+    REQUIRE(
+      target_store.deserialise_snapshot(serialised_snapshot) ==
+      kv::DeserialiseSuccess::FAILED);
+    REQUIRE(target_store.current_version() == 0);
+  }
+}
@@ -438,6 +438,91 @@ TEST_CASE("Global commit hooks")
   }
 }
 
+TEST_CASE("Batched global commit hooks")
+{
+  using State = Store::Map<std::string, std::string>::State;
+  using Write = Store::Map<std::string, std::string>::Write;
+  struct BatchedHookInput
+  {
+    kv::Version from;
+    kv::Version to;
+    const Write* writes;
+  };
+
+  std::vector<kv::Version> global_versions;
+  std::vector<BatchedHookInput> batches1, batches2;
+  std::optional<std::string> key1_at_hook;
+
+  Store kv_store;
+  auto& map = kv_store.create<std::string, std::string>(
+    "map",
+    kv::SecurityDomain::PUBLIC,
+    nullptr,
+    [&](kv::Version v, const State& s, const Write& w) {
+      global_versions.push_back(v);
+    });
+  auto& other = kv_store.create<std::string, std::string>(
+    "other", kv::SecurityDomain::PUBLIC);
+
+  map.add_batched_global_hook(
+    [&](kv::Version from, kv::Version to, const State& s, const Write& w) {
+      batches1.push_back({from, to, &w});
+      REQUIRE(w.size() == 2);
+      REQUIRE(w.at("key1").value == "value3");
+      REQUIRE(w.at("key2").version < 0);
+
+      auto key1 = s.get("key1");
+      REQUIRE(key1.has_value());
+      key1_at_hook = key1->value;
+    });
+  map.add_batched_global_hook(
+    [&](kv::Version from, kv::Version to, const State& s, const Write& w) {
+      batches2.push_back({from, to, &w});
+    });
+
+  auto commit = [&](auto& m, const std::string& key, const std::string& v) {
+    Store::Tx tx;
+    auto view = tx.get_view(m);
+    if (v.empty())
+      view->remove(key);
+    else
+      view->put(key, v);
+    REQUIRE(tx.commit() == kv::CommitSuccess::OK);
+  };
+
+  INFO("Writes of all globally committed versions are delivered at once");
+  {
+    commit(map, "key1", "value1");
+    commit(map, "key2", "value2");
+    commit(other, "key", "value");
+    commit(map, "key1", "value3");
+    commit(map, "key2", "");
+
+    kv_store.compact(5);
+
+    REQUIRE(global_versions == std::vector<kv::Version>{1, 2, 4, 5});
+    REQUIRE(batches1.size() == 1);
+    REQUIRE(batches1[0].from == 1);
+    REQUIRE(batches1[0].to == 5);
+    REQUIRE(key1_at_hook == "value3");
+
+    // Subscribers share the same merged write set
+    REQUIRE(batches2.size() == 1);
+    REQUIRE(batches2[0].from == 1);
+    REQUIRE(batches2[0].to == 5);
+    REQUIRE(batches2[0].writes == batches1[0].writes);
+  }
+
+  INFO("Batched hooks are not called when the map has not changed");
+  {
+    commit(other, "key", "value2");
+    kv_store.compact(6);
+
+    REQUIRE(batches1.size() == 1);
+    REQUIRE(batches2.size() == 1);
+  }
+}
+
 TEST_CASE("Clone schema")
 {
   auto encryptor = std::make_shared<ccf::NullTxEncryptor>();
@@ -811,4 +896,418 @@ TEST_CASE("Conflict resolution")
   // Re-running a _committed_ transaction is exceptionally bad
   REQUIRE_THROWS(tx1.commit());
   REQUIRE_THROWS(tx2.commit());
-}
\ No newline at end of file
+}
+
+TEST_CASE("Ordered map range queries")
+{
+  Store kv_store;
+  using StringString = Store::OrderedMap<std::string, std::string>;
+  auto& map =
+    kv_store.create<StringString>("map", kv::SecurityDomain::PUBLIC);
+
+  using Entries = std::vector<std::pair<std::string, std::string>>;
+  auto collect = [](Entries& entries) {
+    return [&entries](const std::string& k, const std::string& v) {
+      entries.emplace_back(k, v);
+      return true;
+    };
+  };
+
+  {
+    Store::Tx tx;
+    auto view = tx.get_view(map);
+    for (const auto& k : {"b", "a/1", "d", "a/2", "c", "a"})
+      view->put(k, k);
+    REQUIRE(tx.commit() == kv::CommitSuccess::OK);
+  }
+
+  INFO("Entries are visited in key order");
+  {
+    Store::Tx tx;
+    auto view = tx.get_view(map);
+    Entries entries;
+    view->foreach(collect(entries));
+    REQUIRE(entries.size() == 6);
+
+    entries.clear();
+    REQUIRE(view->range("a/2", "d", collect(entries)));
+    REQUIRE(entries == Entries{{"a/2", "a/2"}, {"b", "b"}, {"c", "c"}});
+
+    entries.clear();
+    REQUIRE(view->foreach_prefix("a/", collect(entries)));
+    REQUIRE(entries == Entries{{"a/1", "a/1"}, {"a/2", "a/2"}});
+  }
+
+  INFO("Writes in the transaction are included in range queries");
+  {
+    Store::Tx tx;
+    auto view = tx.get_view(map);
+    view->put("bb", "bb");
+    view->put("c", "new");
+    view->remove("b");
+    view->put("z", "z");
+
+    Entries entries;
+    REQUIRE(view->range("a/2", "d", collect(entries)));
+    REQUIRE(
+      entries == Entries{{"a/2", "a/2"}, {"bb", "bb"}, {"c", "new"}});
+
+    entries.clear();
+    REQUIRE(!view->range("a", "z", [&entries](const auto& k, const auto& v) {
+      entries.emplace_back(k, v);
+      return entries.size() < 2;
+    }));
+    REQUIRE(entries == Entries{{"a", "a"}, {"a/1", "a/1"}});
+  }
+
+  INFO("Writes in a range that has been read cause a conflict");
+  {
+    Store::Tx tx1;
+    auto view1 = tx1.get_view(map);
+    Entries entries;
+    view1->range("b", "c", collect(entries));
+    view1->put("result", std::to_string(entries.size()));
+
+    Store::Tx tx2;
+    auto view2 = tx2.get_view(map);
+    view2->put("bb", "bb");
+    REQUIRE(tx2.commit() == kv::CommitSuccess::OK);
+
+    REQUIRE(tx1.commit() == kv::CommitSuccess::CONFLICT);
+  }
+
+  INFO("Writes outside of a range that has been read do not conflict");
+  {
+    Store::Tx tx1;
+    auto view1 = tx1.get_view(map);
+    Entries entries;
+    view1->foreach_prefix("a/", collect(entries));
+    view1->put("result", std::to_string(entries.size()));
+
+    Store::Tx tx2;
+    auto view2 = tx2.get_view(map);
+    view2->put("a", "new");
+    view2->put("a0", "a0");
+    REQUIRE(tx2.commit() == kv::CommitSuccess::OK);
+
+    REQUIRE(tx1.commit() == kv::CommitSuccess::OK);
+  }
+}
+
+TEST_CASE("Secondary indexes")
+{
+  Store kv_store;
+  auto& map = kv_store.create<std::string, std::string>(
+    "map", kv::SecurityDomain::PUBLIC);
+
+  // Index entries by the first letter of their value
+  auto& by_initial = map.add_index<char>(
+    [](const std::string& k, const std::string& v) { return v.at(0); });
+
+  using Keys = std::vector<std::string>;
+  auto sorted = [](Keys keys) {
+    std::sort(keys.begin(), keys.end());
+    return keys;
+  };
+
+  INFO("Writes in the transaction are included in index queries");
+  {
+    Store::Tx tx;
+    auto view = tx.get_view(map);
+    view->put("k1", "apple");
+    view->put("k2", "avocado");
+    view->put("k3", "banana");
+    REQUIRE(sorted(view->get_by_index(by_initial, 'a')) == Keys{"k1", "k2"});
+    REQUIRE(tx.commit() == kv::CommitSuccess::OK);
+  }
+
+  INFO("Index is updated on commit");
+  {
+    Store::Tx tx;
+    auto view = tx.get_view(map);
+    REQUIRE(sorted(view->get_by_index(by_initial, 'a')) == Keys{"k1", "k2"});
+    REQUIRE(view->get_by_index(by_initial, 'b') == Keys{"k3"});
+    REQUIRE(view->get_by_index(by_initial, 'c').empty());
+  }
+
+  INFO("Updates and removals move keys between index entries");
+  {
+    Store::Tx tx;
+    auto view = tx.get_view(map);
+    view->put("k1", "cherry");
+    view->remove("k3");
+    REQUIRE(tx.commit() == kv::CommitSuccess::OK);
+
+    Store::Tx tx2;
+    auto view2 = tx2.get_view(map);
+    REQUIRE(view2->get_by_index(by_initial, 'a') == Keys{"k2"});
+    REQUIRE(view2->get_by_index(by_initial, 'b').empty());
+    REQUIRE(view2->get_by_index(by_initial, 'c') == Keys{"k1"});
+  }
+
+  INFO("Index is read at the version the transaction started from");
+  {
+    Store::Tx tx1;
+    auto view1 = tx1.get_view(map);
+
+    Store::Tx tx2;
+    auto view2 = tx2.get_view(map);
+    view2->put("k4", "apricot");
+    REQUIRE(tx2.commit() == kv::CommitSuccess::OK);
+
+    REQUIRE(view1->get_by_index(by_initial, 'a') == Keys{"k2"});
+    view1->put("k5", "date");
+    REQUIRE(tx1.commit() == kv::CommitSuccess::CONFLICT);
+  }
+
+  INFO("Index added to a map with existing entries");
+  {
+    auto& by_length = map.add_index<size_t>(
+      [](const std::string& k, const std::string& v) { return v.size(); });
+
+    Store::Tx tx;
+    auto view = tx.get_view(map);
+    REQUIRE(sorted(view->get_by_index(by_length, size_t(7))) == Keys{"k2", "k4"});
+    REQUIRE(view->get_by_index(by_length, size_t(6)) == Keys{"k1"});
+  }
+
+  INFO("Index added after a view was created is built for that view");
+  {
+    Store::Tx tx;
+    auto view = tx.get_view(map);
+
+    auto& by_final = map.add_index<char>(
+      [](const std::string& k, const std::string& v) { return v.back(); });
+
+    REQUIRE(view->get_by_index(by_final, 'o') == Keys{"k2"});
+    REQUIRE(view->get_by_index(by_final, 't') == Keys{"k4"});
+    REQUIRE(view->get_by_index(by_final, 'a').empty());
+  }
+
+  INFO("Index is cleared with the store");
+  {
+    kv_store.clear();
+
+    Store::Tx tx;
+    auto view = tx.get_view(map);
+    REQUIRE(view->get_by_index(by_initial, 'a').empty());
+  }
+}
+
+TEST_CASE("Read-only transactions")
+{
+  Store kv_store;
+  auto& map = kv_store.create<std::string, std::string>(
+    "map", kv::SecurityDomain::PUBLIC);
+
+  {
+    Store::Tx tx;
+    auto view = tx.get_view(map);
+    view->put("key", "value1");
+    REQUIRE(tx.commit() == kv::CommitSuccess::OK);
+  }
+
+  INFO("Read-only transactions do not conflict with concurrent writes");
+  {
+    Store::Tx tx1;
+    tx1.set_read_only();
+    auto view1 = tx1.get_view(map);
+    REQUIRE(view1->get("key") == "value1");
+
+    Store::Tx tx2;
+    auto view2 = tx2.get_view(map);
+    view2->put("key", "value2");
+    REQUIRE(tx2.commit() == kv::CommitSuccess::OK);
+
+    REQUIRE(view1->get("key") == "value1");
+    REQUIRE(tx1.commit() == kv::CommitSuccess::OK);
+    REQUIRE(tx1.commit_version() == 0);
+  }
+
+  INFO("Read-only transactions cannot write");
+  {
+    Store::Tx tx;
+    auto view = tx.get_view(map);
+    REQUIRE(view->get("key") == "value2");
+    tx.set_read_only();
+    REQUIRE_THROWS_AS(view->put("key", "value3"), std::logic_error);
+    REQUIRE_THROWS_AS(view->remove("key"), std::logic_error);
+    REQUIRE(tx.commit() == kv::CommitSuccess::OK);
+  }
+
+  INFO("Transactions that have written cannot be made read-only");
+  {
+    Store::Tx tx;
+    auto view = tx.get_view(map);
+    view->put("key", "value3");
+    REQUIRE_THROWS_AS(tx.set_read_only(), std::logic_error);
+  }
+
+  INFO("Read-only transactions conflict if a map is compacted before viewing");
+  {
+    auto& other = kv_store.create<std::string, std::string>(
+      "other", kv::SecurityDomain::PUBLIC);
+
+    Store::Tx tx1;
+    tx1.set_read_only();
+    auto view1 = tx1.get_view(map);
+    REQUIRE(view1->get("key") == "value2");
+    const auto read_version = tx1.get_read_version();
+
+    Store::Tx tx2;
+    auto view2 = tx2.get_view(other);
+    view2->put("key", "value");
+    REQUIRE(tx2.commit() == kv::CommitSuccess::OK);
+    kv_store.compact(tx2.commit_version());
+
+    // The state of other at the read version is no longer in its roll
+    auto other_view1 = tx1.get_view(other);
+    REQUIRE(other_view1->start_order() > read_version);
+    REQUIRE(tx1.commit() == kv::CommitSuccess::CONFLICT);
+
+    // Retried, the transaction reads both maps at the compacted version
+    view1 = tx1.get_view(map);
+    other_view1 = tx1.get_view(other);
+    REQUIRE(view1->get("key") == "value2");
+    REQUIRE(other_view1->get("key") == "value");
+    REQUIRE(tx1.commit() == kv::CommitSuccess::OK);
+  }
+}
+
+TEST_CASE("Historical reads")
+{
+  Store kv_store;
+  auto& map = kv_store.create<std::string, std::string>(
+    "map", kv::SecurityDomain::PUBLIC);
+  auto& other = kv_store.create<std::string, std::string>(
+    "other", kv::SecurityDomain::PUBLIC);
+  kv_store.set_history_retention({3});
+
+  auto write = [&](auto& m, const std::string& value) {
+    Store::Tx tx;
+    auto view = tx.get_view(m);
+    view->put("key", value);
+    REQUIRE(tx.commit() == kv::CommitSuccess::OK);
+    return tx.commit_version();
+  };
+
+  auto read_at = [&](auto& m, kv::Version v) {
+    Store::Tx tx;
+    tx.set_read_historical(v);
+    auto view = tx.get_view(m);
+    auto value = view->get("key");
+    REQUIRE(tx.commit() == kv::CommitSuccess::OK);
+    return value;
+  };
+
+  // Versions 1 to 5, where other is only written at version 3
+  for (size_t i = 1; i <= 5; ++i)
+  {
+    auto v = write(i == 3 ? other : map, "value" + std::to_string(i));
+    REQUIRE(v == i);
+  }
+
+  INFO("Versions that are not globally committed cannot be read");
+  {
+    kv_store.compact(2);
+    REQUIRE_THROWS_AS(read_at(map, 3), std::logic_error);
+  }
+
+  INFO("Retained versions can be read after compaction");
+  {
+    kv_store.compact(5);
+    REQUIRE(read_at(map, 2) == "value2");
+    REQUIRE(read_at(map, 3) == "value2");
+    REQUIRE(read_at(map, 5) == "value5");
+    REQUIRE(!read_at(other, 2).has_value());
+    REQUIRE(read_at(other, 4) == "value3");
+
+    // Normal transactions read the latest state
+    Store::Tx tx;
+    REQUIRE(tx.get_view(map)->get("key") == "value5");
+  }
+
+  INFO("Historical transactions cannot write");
+  {
+    Store::Tx tx;
+    tx.set_read_historical(2);
+    auto view = tx.get_view(map);
+    REQUIRE_THROWS_AS(view->put("key", "value"), std::logic_error);
+  }
+
+  INFO("States out of the retention window are evicted");
+  {
+    REQUIRE_THROWS_AS(read_at(map, 1), std::logic_error);
+
+    for (size_t i = 6; i <= 8; ++i)
+      write(map, "value" + std::to_string(i));
+    kv_store.compact(8);
+
+    REQUIRE_THROWS_AS(read_at(map, 4), std::logic_error);
+    REQUIRE(read_at(map, 5) == "value5");
+    REQUIRE(read_at(map, 8) == "value8");
+
+    // The state of other at version 3 is still needed to read at version 5
+    REQUIRE(read_at(other, 5) == "value3");
+  }
+
+  INFO("States over the write budget are evicted");
+  {
+    kv_store.set_history_retention({10, 1});
+    write(map, "value9");
+    kv_store.compact(9);
+
+    REQUIRE_THROWS_AS(read_at(map, 7), std::logic_error);
+    REQUIRE(read_at(map, 8) == "value8");
+    REQUIRE(read_at(map, 9) == "value9");
+  }
+
+  INFO("Historical reads must be set before any view is created");
+  {
+    Store::Tx tx;
+    tx.get_view(map);
+    REQUIRE_THROWS_AS(tx.set_read_historical(5), std::logic_error);
+  }
+}
+
+TEST_CASE("Map handles")
+{
+  Store kv_store;
+  auto& map_b = kv_store.create<std::string, std::string>(
+    "b", kv::SecurityDomain::PUBLIC);
+  auto& map_a = kv_store.create<std::string, std::string>(
+    "a", kv::SecurityDomain::PUBLIC);
+
+  INFO("Handles are dense and assigned in creation order");
+  REQUIRE(map_b.get_handle() == 0);
+  REQUIRE(map_a.get_handle() == 1);
+
+  INFO("Cloned schemas keep the handles of the original maps");
+  Store kv_store2;
+  kv_store2.clone_schema(kv_store);
+  REQUIRE(kv_store2.get<std::string, std::string>("b")->get_handle() == 0);
+  REQUIRE(kv_store2.get<std::string, std::string>("a")->get_handle() == 1);
+  auto& map_c = kv_store2.create<std::string, std::string>(
+    "c", kv::SecurityDomain::PUBLIC);
+  REQUIRE(map_c.get_handle() == 2);
+
+  INFO("Views are found by handle");
+  {
+    Store::Tx tx;
+    auto view_a = tx.get_view(map_a);
+    auto [view_b, view_a2] = tx.get_view(map_b, map_a);
+    REQUIRE(view_a == view_a2);
+    view_a->put("key", "a");
+    view_b->put("key", "b");
+    REQUIRE(tx.commit() == kv::CommitSuccess::OK);
+  }
+
+  INFO("Views over maps of another store with the same handle are rejected");
+  {
+    Store::Tx tx;
+    tx.get_view(map_a);
+    REQUIRE_THROWS_AS(
+      tx.get_view(*kv_store2.get<std::string, std::string>("a")),
+      std::logic_error);
+  }
+}
@@ -30,6 +30,18 @@ namespace ccf
       cipher = plain;
     }
 
+    void encrypt(
+      CBuffer plain,
+      CBuffer additional_data,
+      uint8_t* serialised_header,
+      uint8_t* cipher,
+      kv::Version version) override
+    {
+      memset(serialised_header, 0, get_header_length());
+      if (plain.n > 0)
+        memcpy(cipher, plain.p, plain.n);
+    }
+
     bool decrypt(
       const std::vector<uint8_t>& cipher,
       const std::vector<uint8_t>& additional_data,
@@ -151,16 +163,48 @@ namespace ccf
       std::vector<uint8_t>& cipher,
       kv::Version version) override
     {
-      crypto::GcmHeader<crypto::GCM_SIZE_IV> gcm_hdr;
+      serialised_header.resize(get_header_length());
       cipher.resize(plain.size());
 
+      encrypt(
+        plain,
+        additional_data,
+        serialised_header.data(),
+        cipher.data(),
+        version);
+    }
+
+    /**
+     * Encrypt data in place, e.g. directly into a serialised transaction.
+     *
+     * @param[in]   plain             Plaintext to encrypt
+     * @param[in]   additional_data   Additional data to tag
+     * @param[out]  serialised_header Serialised header (iv + tag), of
+     * get_header_length() bytes
+     * @param[out]  cipher            Encrypted ciphertext, of plain.n bytes
+     * @param[in]   version           Version used to retrieve the corresponding
+     * encryption key
+     */
+    void encrypt(
+      CBuffer plain,
+      CBuffer additional_data,
+      uint8_t* serialised_header,
+      uint8_t* cipher,
+      kv::Version version) override
+    {
+      crypto::GcmHeader<crypto::GCM_SIZE_IV> gcm_hdr;
+
       // Set IV
       set_iv(gcm_hdr);
 
       get_encryption_key(version).encrypt(
-        gcm_hdr.get_iv(), plain, additional_data, cipher.data(), gcm_hdr.tag);
+        gcm_hdr.get_iv(), plain, additional_data, cipher, gcm_hdr.tag);
 
-      serialised_header = std::move(gcm_hdr.serialise());
+      memcpy(serialised_header, gcm_hdr.tag, sizeof(gcm_hdr.tag));
+      memcpy(
+        serialised_header + sizeof(gcm_hdr.tag),
+        gcm_hdr.iv,
+        sizeof(gcm_hdr.iv));
     }
 
     /**
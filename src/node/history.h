@@ -108,6 +108,8 @@ namespace ccf
 
     void append(const uint8_t* replicated, size_t replicated_size) override {}
 
+    void append(const crypto::Sha256Hash& replicated_hash) override {}
+
     bool verify(kv::Term* term = nullptr) override
     {
       return true;
@@ -157,6 +159,18 @@ namespace ccf
 
     void add_result(RequestID id, kv::Version version) override {}
 
+    void add_result(
+      RequestID id,
+      kv::Version version,
+      const crypto::Sha256Hash& replicated_hash) override
+    {}
+
+    std::optional<crypto::Sha256Hash> hash_entry(
+      const std::vector<uint8_t>& replicated) override
+    {
+      return std::nullopt;
+    }
+
     void add_response(
       kv::TxHistory::RequestID id,
       const std::vector<uint8_t>& response) override
@@ -184,6 +198,16 @@ namespace ccf
     {
       return true;
     }
+
+    std::vector<uint8_t> serialise_tree(kv::Version v) override
+    {
+      return {};
+    }
+
+    bool init_from_snapshot(const std::vector<uint8_t>& tree) override
+    {
+      return true;
+    }
   };
 
   class Receipt
@@ -267,6 +291,8 @@ namespace ccf
     MerkleTreeHistory(const std::vector<uint8_t>& serialised)
     {
       tree = mt_deserialize(serialised.data(), serialised.size());
+      if (tree == nullptr)
+        throw std::logic_error("Failed to deserialise merkle tree");
     }
 
     MerkleTreeHistory()
@@ -337,6 +363,11 @@ namespace ccf
       mt_serialize(tree, output.data(), output.capacity());
       return output;
     }
+
+    void swap(MerkleTreeHistory& other)
+    {
+      std::swap(tree, other.tree);
+    }
   };
 
   template <class T>
@@ -413,12 +444,21 @@ namespace ccf
 
     void append(const uint8_t* replicated, size_t replicated_size) override
     {
-      crypto::Sha256Hash rh({{replicated, replicated_size}});
-      log_hash(rh, APPEND);
-      replicated_state_tree.append(rh);
+      append(crypto::Sha256Hash({{replicated, replicated_size}}));
+    }
+
+    void append(const crypto::Sha256Hash& replicated_hash) override
+    {
+      log_hash(replicated_hash, APPEND);
+      replicated_state_tree.append(replicated_hash);
     }
 
     bool verify(kv::Term* term = nullptr) override
+    {
+      return verify_root(replicated_state_tree.get_root(), term);
+    }
+
+    bool verify_root(const crypto::Sha256Hash& root, kv::Term* term = nullptr)
     {
       Store::Tx tx;
       auto [sig_tv, ni_tv] = tx.get_view(signatures, nodes);
@@ -440,7 +480,6 @@ namespace ccf
         return false;
       }
       tls::VerifierPtr from_cert = tls::make_verifier(ni.value().cert);
-      crypto::Sha256Hash root = replicated_state_tree.get_root();
       log_hash(root, VERIFY);
       return from_cert->verify_hash(
         root.h, root.SIZE, sig_value.sig.data(), sig_value.sig.size());
@@ -525,15 +564,22 @@ namespace ccf
       size_t replicated_size) override
     {
       append(replicated, replicated_size);
-#ifdef PBFT
-      if (on_result.has_value())
-      {
-        auto root = get_replicated_state_root();
-        LOG_DEBUG_FMT("HISTORY: add_result {0} {1} {2}", id, version, root);
-        results[id] = {version, root};
-        on_result.value()({id, version, root});
-      }
-#endif
+      add_result(id, version);
+    }
+
+    void add_result(
+      RequestID id,
+      kv::Version version,
+      const crypto::Sha256Hash& replicated_hash) override
+    {
+      append(replicated_hash);
+      add_result(id, version);
+    }
+
+    std::optional<crypto::Sha256Hash> hash_entry(
+      const std::vector<uint8_t>& replicated) override
+    {
+      return crypto::Sha256Hash({{replicated.data(), replicated.size()}});
     }
 
     void add_result(kv::TxHistory::RequestID id, kv::Version version) override
@@ -567,6 +613,35 @@ namespace ccf
       auto r = Receipt::from_v(v);
       return replicated_state_tree.verify(r);
     }
+
+    std::vector<uint8_t> serialise_tree(kv::Version v) override
+    {
+      T tree(replicated_state_tree.serialise());
+      tree.retract(v);
+      return tree.serialise();
+    }
+
+    bool init_from_snapshot(const std::vector<uint8_t>& tree) override
+    {
+      T snapshot_tree(tree);
+
+      // The latest signature in the snapshot signs the root of the tree as it
+      // was before the signature transaction itself was appended
+      Store::Tx tx;
+      auto sig_tv = tx.get_view(signatures);
+      auto sig = sig_tv->get(0);
+      if (sig.has_value())
+      {
+        T signed_tree(tree);
+        signed_tree.retract(sig->index - 1);
+        if (!verify_root(signed_tree.get_root()))
+          return false;
+      }
+
+      replicated_state_tree.swap(snapshot_tree);
+      log_hash(replicated_state_tree.get_root(), APPEND);
+      return true;
+    }
   };
 
   using MerkleTxHistory = HashedTxHistory<MerkleTreeHistory>;
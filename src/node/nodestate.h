@@ -7,6 +7,7 @@
 #include "consensus/raft/raftconsensus.h"
 #include "crypto/cryptobox.h"
 #include "ds/logger.h"
+#include "ds/thread_messaging.h"
 #include "enclave/rpcsessions.h"
 #include "encryptor.h"
 #include "entities.h"
@@ -22,6 +23,7 @@
 #include "seal.h"
 #include "secretshare.h"
 #include "timer.h"
+#include "workerexecutor.h"
 #include "tls/25519.h"
 #include "tls/client.h"
 #include "tls/entropy.h"
@@ -37,6 +39,7 @@
 #include <atomic>
 #include <chrono>
 #include <fmt/format_header_only.h>
+#include <map>
 #include <nlohmann/json.hpp>
 #include <stdexcept>
 #include <unordered_set>
@@ -184,6 +187,10 @@ namespace ccf
 
     std::shared_ptr<kv::TxHistory> history;
     std::shared_ptr<kv::AbstractTxEncryptor> encryptor;
+    // Deserialises and commits the maps of large transactions on the worker
+    // threads
+    std::shared_ptr<kv::AbstractExecutor> executor =
+      std::make_shared<WorkerThreadExecutor>();
 
     std::shared_ptr<Seal> seal;
 
@@ -204,7 +211,60 @@ namespace ccf
     std::vector<kv::Version> term_history;
     kv::Version last_recovered_commit_idx = 1;
 
+    // During recovery, ledger entries are requested from the host in ranges
+    // of up to ledger_range_size entries, and go through a pipeline:
+    // - the host reads the next range while the current one is processed,
+    //   as long as no more than ledger_read_ahead entries are pending
+    // - worker threads decrypt and hash the entries of each range in parallel
+    // - the main thread applies the prepared entries to the store, in order
+    static constexpr consensus::Index ledger_range_size = 1000;
+    static constexpr consensus::Index ledger_read_ahead =
+      4 * ledger_range_size;
+    // Index of the last ledger entry applied during recovery
     consensus::Index ledger_idx = 0;
+    // Index of the last ledger entry read from the host during recovery
+    consensus::Index ledger_read_idx = 0;
+    bool ledger_range_requested = false;
+    bool ledger_end_read = false;
+    // Changes whenever reading the ledger starts or stops, so that entries
+    // prepared for a previous read are discarded
+    size_t ledger_read_id = 0;
+    // Prepared entries waiting to be applied, by index of their first entry
+    std::map<consensus::Index, std::vector<Store::PreparedTx>>
+      prepared_ledger_entries;
+
+    struct PrepareLedgerEntriesMsg
+    {
+      NodeState* self;
+      size_t read_id;
+      std::shared_ptr<Store> store;
+      bool public_only;
+      consensus::Index from;
+      std::vector<std::vector<uint8_t>> entries;
+      std::vector<Store::PreparedTx> prepared;
+    };
+
+    struct ApplyEntriesMsg
+    {
+      RaftType* raft;
+    };
+
+    static void apply_entries_cb(
+      std::unique_ptr<enclave::Tmsg<ApplyEntriesMsg>> msg)
+    {
+      msg->data.raft->apply_entries();
+    }
+
+    struct SerialiseSnapshotMsg
+    {
+      RaftType* raft;
+    };
+
+    static void serialise_snapshot_cb(
+      std::unique_ptr<enclave::Tmsg<SerialiseSnapshotMsg>> msg)
+    {
+      msg->data.raft->serialise_snapshot();
+    }
 
   public:
     NodeState(
@@ -245,6 +305,7 @@ namespace ccf
       // Capture rpc_map to pass to pbft for frontend execution
       rpc_map = rpc_map_;
       cmd_forwarder = cmd_forwarder_;
+      network.tables->set_executor(executor);
       sm.advance(State::initialized);
     }
 
@@ -486,25 +547,24 @@ namespace ccf
       std::lock_guard<SpinLock> guard(lock);
       sm.expect(State::readingPublicLedger);
       LOG_INFO_FMT("Start public recovery");
-      read_ledger_idx(++ledger_idx);
+      start_reading_ledger();
     }
 
-    void recover_public_ledger_entry(const std::vector<uint8_t>& ledger_entry)
+    // Returns true if the next entry of the public ledger should be applied
+    bool recover_public_ledger_entry_unsafe(Store::PreparedTx&& ledger_entry)
     {
-      std::lock_guard<SpinLock> guard(lock);
       sm.expect(State::readingPublicLedger);
 
-      LOG_DEBUG_FMT(
-        "Deserialising public ledger entry ({})", ledger_entry.size());
+      LOG_DEBUG_FMT("Deserialising public ledger entry {}", ledger_idx);
 
       // When reading the public ledger, deserialise in the real store
-      auto result = network.tables->deserialise(ledger_entry, true);
+      auto result = network.tables->deserialise(std::move(ledger_entry));
       if (result == kv::DeserialiseSuccess::FAILED)
       {
         LOG_FAIL_FMT("Failed to deserialise entry in public ledger");
         network.tables->rollback(ledger_idx - 1);
         recover_public_ledger_end_unsafe();
-        return;
+        return false;
       }
 
       // If the ledger entry is a signature, it is safe to compact the store
@@ -530,12 +590,13 @@ namespace ccf
         }
       }
 
-      read_ledger_idx(++ledger_idx);
+      return true;
     }
 
     void recover_public_ledger_end_unsafe()
     {
       sm.expect(State::readingPublicLedger);
+      stop_reading_ledger();
 
       // When reaching the end of the public ledger, truncate to last signed
       // index and promote network secrets to this index
@@ -611,22 +672,21 @@ namespace ccf
     //
     // funcs in state "readingPrivateLedger"
     //
-    void recover_private_ledger_entry(const std::vector<uint8_t>& ledger_entry)
+    // Returns true if the next entry of the private ledger should be applied
+    bool recover_private_ledger_entry_unsafe(Store::PreparedTx&& ledger_entry)
     {
-      std::lock_guard<SpinLock> guard(lock);
       sm.expect(State::readingPrivateLedger);
 
-      LOG_INFO_FMT(
-        "Deserialising private ledger entry ({})", ledger_entry.size());
+      LOG_INFO_FMT("Deserialising private ledger entry {}", ledger_idx);
 
       // When reading the private ledger, deserialise in the recovery store
-      auto result = recovery_store->deserialise(ledger_entry);
+      auto result = recovery_store->deserialise(std::move(ledger_entry));
       if (result == kv::DeserialiseSuccess::FAILED)
       {
         LOG_FAIL_FMT("Failed to deserialise entry in private ledger");
         recovery_store->rollback(ledger_idx - 1);
         recover_private_ledger_end_unsafe();
-        return;
+        return false;
       }
 
       if (result == kv::DeserialiseSuccess::PASS_SIGNATURE)
@@ -636,16 +696,16 @@ namespace ccf
       {
         LOG_INFO_FMT("Reached recovery final version at {}", recovery_v);
         recover_private_ledger_end_unsafe();
+        return false;
       }
-      else
-      {
-        read_ledger_idx(++ledger_idx);
-      }
+
+      return true;
     }
 
     void recover_private_ledger_end_unsafe()
     {
       sm.expect(State::readingPrivateLedger);
+      stop_reading_ledger();
 
       // When reaching the end of the private ledger, make sure the same
       // ledger has been read and swap in private state
@@ -695,24 +755,59 @@ namespace ccf
     //
     // funcs in state "readingPublicLedger" or "readingPrivateLedger"
     //
-    void recover_ledger_end()
+    void recover_ledger_entries(
+      consensus::Index from,
+      consensus::Index to,
+      const uint8_t* data,
+      size_t size)
     {
       std::lock_guard<SpinLock> guard(lock);
 
-      if (is_reading_public_ledger())
+      if (!is_expected_ledger_range(from))
       {
-        recover_public_ledger_end_unsafe();
+        LOG_DEBUG_FMT("Ignoring stale ledger entries [{}, {}]", from, to);
+        return;
       }
-      else if (is_reading_private_ledger())
+
+      ledger_range_requested = false;
+      ledger_read_idx = to;
+      read_next_ledger_range();
+
+      std::vector<std::vector<uint8_t>> entries;
+      while (size > 0)
       {
-        recover_private_ledger_end_unsafe();
+        auto entry_size = serialized::read<uint32_t>(data, size);
+        entries.emplace_back(data, data + entry_size);
+        serialized::skip(data, size, entry_size);
       }
-      else
+
+      if (entries.size() != to - from + 1)
       {
-        throw std::logic_error(
-          "Cannot end ledger recovery if not reading public or private "
-          "ledger");
+        throw std::logic_error(fmt::format(
+          "Expected {} ledger entries in [{}, {}], read {}",
+          to - from + 1,
+          from,
+          to,
+          entries.size()));
       }
+
+      LOG_DEBUG_FMT("Preparing ledger entries [{}, {}]", from, to);
+      prepare_ledger_entries(from, std::move(entries));
+    }
+
+    void recover_ledger_end(consensus::Index from)
+    {
+      std::lock_guard<SpinLock> guard(lock);
+
+      if (!is_expected_ledger_range(from))
+      {
+        LOG_DEBUG_FMT("Ignoring stale end of ledger at {}", from);
+        return;
+      }
+
+      ledger_range_requested = false;
+      ledger_end_read = true;
+      apply_prepared_ledger_entries();
     }
 
     //
@@ -746,6 +841,7 @@ namespace ccf
 
       recovery_store->set_history(recovery_history);
       recovery_store->set_encryptor(recovery_encryptor);
+      recovery_store->set_executor(executor);
 
       // Record real store version and root
       recovery_v = network.tables->current_version();
@@ -790,8 +886,7 @@ namespace ccf
       setup_private_recovery_store();
 
       // Start reading private security domain of ledger
-      ledger_idx = 0;
-      read_ledger_idx(++ledger_idx);
+      start_reading_ledger();
 
       sm.advance(State::readingPrivateLedger);
       return true;
@@ -810,6 +905,17 @@ namespace ccf
       consensus->periodic(elapsed);
     }
 
+    void ledger_durable(consensus::Index idx, size_t truncations)
+    {
+      // The host only reports changes to the durable index, so reports are
+      // passed on as soon as consensus is set up, even before the node is part
+      // of the network
+      if (consensus == nullptr)
+        return;
+
+      consensus->ledger_durable(idx, truncations);
+    }
+
     void node_msg(const std::vector<uint8_t>& data)
     {
       // Only process messages once part of network
@@ -1267,8 +1373,7 @@ namespace ccf
       consensus->suspend_replication(recovery_v + 1);
 
       // Start reading private security domain of ledger
-      ledger_idx = 0;
-      read_ledger_idx(++ledger_idx);
+      start_reading_ledger();
 
       sm.advance(State::readingPrivateLedger);
     }
@@ -1395,7 +1500,48 @@ namespace ccf
         self,
         std::chrono::milliseconds(raft_config.request_timeout),
         std::chrono::milliseconds(raft_config.election_timeout),
-        public_only);
+        public_only,
+        true,
+        raft_config.max_inflight_batches,
+        raft_config.max_inflight_bytes,
+        std::chrono::milliseconds(raft_config.commit_latency_target),
+        raft_config.leader_lease,
+        std::chrono::milliseconds(raft_config.lease_clock_drift),
+        raft_config.snapshot_min_lag);
+
+      // Entries received as a follower are applied on the first worker thread,
+      // so that the main thread can acknowledge further entries meanwhile.
+      // Nodes in recovery apply entries as they receive them.
+      if (
+        raft_config.async_apply && !public_only &&
+        enclave::ThreadMessaging::thread_count > 1)
+      {
+        auto raft_ = raft.get();
+        raft->set_apply_scheduler([raft_]() {
+          auto msg = std::make_unique<enclave::Tmsg<ApplyEntriesMsg>>(
+            &apply_entries_cb);
+          msg->data.raft = raft_;
+          enclave::ThreadMessaging::thread_messaging.add_task<ApplyEntriesMsg>(
+            1, std::move(msg));
+        });
+      }
+
+      // Snapshots for followers are serialised on the last worker thread, so
+      // that the main thread can send entries meanwhile
+      if (
+        raft_config.snapshot_min_lag > 0 &&
+        enclave::ThreadMessaging::thread_count > 1)
+      {
+        auto raft_ = raft.get();
+        raft->set_snapshot_scheduler([raft_]() {
+          auto msg = std::make_unique<enclave::Tmsg<SerialiseSnapshotMsg>>(
+            &serialise_snapshot_cb);
+          msg->data.raft = raft_;
+          enclave::ThreadMessaging::thread_messaging
+            .add_task<SerialiseSnapshotMsg>(
+              enclave::ThreadMessaging::thread_count - 1, std::move(msg));
+        });
+      }
 
       consensus = std::make_shared<RaftConsensusType>(std::move(raft));
 
@@ -1499,9 +1645,154 @@ namespace ccf
       }
     }
 
-    void read_ledger_idx(consensus::Index idx)
+    void start_reading_ledger()
+    {
+      stop_reading_ledger();
+      ledger_idx = 0;
+      ledger_read_idx = 0;
+      ledger_range_requested = false;
+      ledger_end_read = false;
+      read_next_ledger_range();
+    }
+
+    void stop_reading_ledger()
+    {
+      ledger_read_id++;
+      prepared_ledger_entries.clear();
+    }
+
+    bool is_expected_ledger_range(consensus::Index from)
+    {
+      return (is_reading_public_ledger() || is_reading_private_ledger()) &&
+        ledger_range_requested && from == ledger_read_idx + 1;
+    }
+
+    void read_next_ledger_range()
+    {
+      if (
+        ledger_range_requested || ledger_end_read ||
+        ledger_read_idx - ledger_idx >= ledger_read_ahead)
+        return;
+
+      ledger_range_requested = true;
+      RINGBUFFER_WRITE_MESSAGE(
+        consensus::ledger_get_range,
+        to_host,
+        ledger_read_idx + 1,
+        ledger_read_idx + ledger_range_size);
+    }
+
+    // Decrypts and hashes the entries on the worker threads, if any. Entries
+    // may be decrypted ahead of the entries before them being applied, as all
+    // ledger secrets are known before the private ledger is read.
+    void prepare_ledger_entries(
+      consensus::Index from, std::vector<std::vector<uint8_t>>&& entries)
     {
-      RINGBUFFER_WRITE_MESSAGE(consensus::ledger_get, to_host, idx);
+      auto store = is_reading_public_ledger() ? network.tables : recovery_store;
+      auto public_only = is_reading_public_ledger();
+
+      size_t workers = 0;
+      if (enclave::ThreadMessaging::thread_count > 1)
+        workers = enclave::ThreadMessaging::thread_count - 1;
+
+      if (workers == 0)
+      {
+        std::vector<Store::PreparedTx> prepared;
+        for (auto& entry : entries)
+        {
+          prepared.push_back(
+            store->prepare_deserialise(std::move(entry), public_only));
+        }
+        prepared_ledger_entries.emplace(from, std::move(prepared));
+        apply_prepared_ledger_entries();
+        return;
+      }
+
+      const auto batch_size = (entries.size() + workers - 1) / workers;
+      for (size_t i = 0; i < workers && i * batch_size < entries.size(); ++i)
+      {
+        auto begin = entries.begin() + i * batch_size;
+        auto end = entries.begin() +
+          std::min((i + 1) * batch_size, entries.size());
+
+        auto msg = std::make_unique<enclave::Tmsg<PrepareLedgerEntriesMsg>>(
+          &prepare_ledger_entries_cb);
+        msg->data.self = this;
+        msg->data.read_id = ledger_read_id;
+        msg->data.store = store;
+        msg->data.public_only = public_only;
+        msg->data.from = from + i * batch_size;
+        msg->data.entries.assign(
+          std::make_move_iterator(begin), std::make_move_iterator(end));
+
+        enclave::ThreadMessaging::thread_messaging
+          .add_task<PrepareLedgerEntriesMsg>(i + 1, std::move(msg));
+      }
+    }
+
+    static void prepare_ledger_entries_cb(
+      std::unique_ptr<enclave::Tmsg<PrepareLedgerEntriesMsg>> msg)
+    {
+      auto& data = msg->data;
+      for (auto& entry : data.entries)
+      {
+        data.prepared.push_back(
+          data.store->prepare_deserialise(std::move(entry), data.public_only));
+      }
+      data.entries.clear();
+
+      auto reply = std::make_unique<enclave::Tmsg<PrepareLedgerEntriesMsg>>(
+        &prepared_ledger_entries_cb);
+      reply->data = std::move(data);
+      enclave::ThreadMessaging::thread_messaging
+        .add_task<PrepareLedgerEntriesMsg>(
+          enclave::ThreadMessaging::main_thread, std::move(reply));
+    }
+
+    static void prepared_ledger_entries_cb(
+      std::unique_ptr<enclave::Tmsg<PrepareLedgerEntriesMsg>> msg)
+    {
+      auto& data = msg->data;
+      std::lock_guard<SpinLock> guard(data.self->lock);
+      if (data.read_id != data.self->ledger_read_id)
+        return;
+
+      data.self->prepared_ledger_entries.emplace(
+        data.from, std::move(data.prepared));
+      data.self->apply_prepared_ledger_entries();
+    }
+
+    // Applies the prepared entries that follow the last applied entry, and
+    // ends recovery once all entries have been applied
+    void apply_prepared_ledger_entries()
+    {
+      while (!prepared_ledger_entries.empty() &&
+             prepared_ledger_entries.begin()->first == ledger_idx + 1)
+      {
+        auto entries = std::move(prepared_ledger_entries.begin()->second);
+        prepared_ledger_entries.erase(prepared_ledger_entries.begin());
+
+        for (auto& entry : entries)
+        {
+          ledger_idx++;
+          auto next = is_reading_public_ledger() ?
+            recover_public_ledger_entry_unsafe(std::move(entry)) :
+            recover_private_ledger_entry_unsafe(std::move(entry));
+          if (!next)
+            return;
+        }
+      }
+
+      if (ledger_end_read && ledger_idx == ledger_read_idx)
+      {
+        if (is_reading_public_ledger())
+          recover_public_ledger_end_unsafe();
+        else
+          recover_private_ledger_end_unsafe();
+        return;
+      }
+
+      read_next_ledger_range();
     }
 
     void ledger_truncate(consensus::Index idx)
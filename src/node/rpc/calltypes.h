@@ -36,10 +36,20 @@ namespace ccf
       nlohmann::json buckets = {};
     };
 
+    struct Replication
+    {
+      size_t batch_size;
+      size_t flush_delay_ms;
+      std::string flush_reason;
+      size_t replication_latency_p99_ms;
+      size_t arrival_rate;
+    };
+
     struct Out
     {
       HistogramResults histogram;
       nlohmann::json tx_rates;
+      std::optional<Replication> replication = std::nullopt;
     };
   };
 
@@ -53,6 +53,21 @@ namespace ccf
 
       auto get_metrics = [this](Store::Tx& tx, const nlohmann::json& params) {
         auto result = metrics.get_metrics();
+
+        if (consensus != nullptr)
+        {
+          auto replication = consensus->get_replication_metrics();
+          if (replication.has_value())
+          {
+            result.replication = GetMetrics::Replication{
+              replication->batch_size,
+              replication->flush_delay_ms,
+              replication->flush_reason,
+              replication->replication_latency_p99_ms,
+              replication->arrival_rate};
+          }
+        }
+
         return make_success(result);
       };
 
@@ -124,6 +124,23 @@ namespace ccf
       }
     }
 
+#ifndef PBFT
+    // Whether ctx is a Read handler that this primary answers under a leader
+    // lease
+    bool is_lease_read(std::shared_ptr<enclave::RpcContext> ctx)
+    {
+      if (
+        consensus == nullptr || ctx->is_create_request ||
+        !consensus->uses_leader_lease() || !consensus->is_primary())
+        return false;
+
+      const auto method = ctx->get_method();
+      const auto local_method = method.substr(method.find_first_not_of('/'));
+      auto handler = handlers.find_handler(local_method);
+      return handler != nullptr && handler->rw == HandlerRegistry::Read;
+    }
+#endif
+
     bool verify_client_signature(
       const std::vector<uint8_t>& caller,
       const CallerId caller_id,
@@ -208,6 +225,17 @@ namespace ccf
 
       Store::Tx tx;
 
+#ifndef PBFT
+      // The lease only guarantees that no other primary has been elected.
+      // Entries this primary has not committed yet may still be rolled back by
+      // its successor, so reads under the lease see the globally committed
+      // state, from the caller lookup onwards
+      if (is_lease_read(ctx))
+      {
+        tx.set_read_committed();
+      }
+#endif
+
       // Retrieve id of caller
       std::optional<CallerId> caller_id;
       if (ctx->is_create_request)
@@ -480,8 +508,28 @@ namespace ccf
           }
         }
       }
+      else if (
+        handler->rw == HandlerRegistry::Read && consensus != nullptr &&
+        consensus->is_primary() && consensus->lease_lapsed())
+      {
+        // Reads answered under a lease see all globally committed
+        // transactions, without waiting for a replication round. Once the
+        // lease has lapsed, this node may no longer be primary and could
+        // answer from stale state.
+        return ctx->error_response(
+          jsonrpc::CCFErrorCodes::TX_PRIMARY_UNKNOWN,
+          "Primary lease has lapsed, primary unknown.");
+      }
 #endif
 
+      // Handlers that only read run in read-only transactions, which do not
+      // track their reads and only conflict if a map they read is compacted
+      // while they run
+      if (handler->rw == HandlerRegistry::Read && !tx.has_writes())
+      {
+        tx.set_read_only();
+      }
+
       auto func = handler->func;
       auto args = RequestArgs{ctx, tx, caller_id};
 
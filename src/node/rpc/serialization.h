@@ -65,8 +65,17 @@ namespace ccf
   DECLARE_JSON_TYPE(GetMetrics::HistogramResults)
   DECLARE_JSON_REQUIRED_FIELDS(
     GetMetrics::HistogramResults, low, high, overflow, underflow, buckets)
-  DECLARE_JSON_TYPE(GetMetrics::Out)
+  DECLARE_JSON_TYPE(GetMetrics::Replication)
+  DECLARE_JSON_REQUIRED_FIELDS(
+    GetMetrics::Replication,
+    batch_size,
+    flush_delay_ms,
+    flush_reason,
+    replication_latency_p99_ms,
+    arrival_rate)
+  DECLARE_JSON_TYPE_WITH_OPTIONAL_FIELDS(GetMetrics::Out)
   DECLARE_JSON_REQUIRED_FIELDS(GetMetrics::Out, histogram, tx_rates)
+  DECLARE_JSON_OPTIONAL_FIELDS(GetMetrics::Out, replication)
 
   DECLARE_JSON_TYPE(GetPrimaryInfo::Out)
   DECLARE_JSON_REQUIRED_FIELDS(
@@ -268,6 +268,36 @@ public:
   }
 };
 
+class TestLeaseReadFrontend : public SimpleUserRpcFrontend
+{
+public:
+  using Values = Store::Map<size_t, size_t>;
+  Values& values;
+
+  TestLeaseReadFrontend(Store& tables, Values& values_) :
+    SimpleUserRpcFrontend(tables),
+    values(values_)
+  {
+    open();
+
+    auto get_value = [this](Store::Tx& tx, const nlohmann::json& params) {
+      auto value = tx.get_view(values)->get(0);
+      return make_success(value.value_or(0));
+    };
+    install("get_value", handler_adapter(get_value), HandlerRegistry::Read);
+  }
+};
+
+// A primary that holds a leader lease
+class LeaseStubConsensus : public kv::PrimaryStubConsensus
+{
+public:
+  bool uses_leader_lease() override
+  {
+    return true;
+  }
+};
+
 // used throughout
 auto kp = tls::make_key_pair();
 NetworkState network;
@@ -734,6 +764,38 @@ TEST_CASE("Signed read requests can be executed on backup")
   CHECK(response[jsonrpc::RESULT] == true);
 }
 
+TEST_CASE("Reads under a leader lease only see globally committed state")
+{
+  prepare_callers();
+
+  auto& values = network.tables->create<TestLeaseReadFrontend::Values>(
+    "lease_values", kv::SecurityDomain::PUBLIC);
+  TestLeaseReadFrontend frontend(*network.tables, values);
+
+  auto lease_consensus = std::make_shared<LeaseStubConsensus>();
+  network.tables->set_consensus(lease_consensus);
+  network.tables->compact(network.tables->current_version());
+
+  auto get_value = [&frontend]() {
+    auto call = create_simple_request("get_value");
+    auto serialized_call = call.build_request();
+    auto rpc_ctx = enclave::make_rpc_context(user_session, serialized_call);
+    auto response = parse_response(frontend.process(rpc_ctx).value());
+    return response[jsonrpc::RESULT];
+  };
+
+  Store::Tx tx;
+  tx.get_view(values)->put(0, 42);
+  REQUIRE(tx.commit() == kv::CommitSuccess::OK);
+
+  INFO("Writes that are not globally committed are not visible");
+  CHECK(get_value() == 0);
+
+  INFO("Writes are visible once globally committed");
+  network.tables->compact(network.tables->current_version());
+  CHECK(get_value() == 42);
+}
+
 TEST_CASE("Forwarding" * doctest::test_suite("forwarding"))
 {
   prepare_callers();
@@ -156,4 +156,34 @@ TEST_CASE("Encryption/decryption with multiple ledger secrets")
     REQUIRE_FALSE(
       encryptor->decrypt(cipher, {}, serialised_header, decrypted_cipher, 1));
   }
-}
\ No newline at end of file
+}
+
+TEST_CASE("Encryption into buffers")
+{
+  uint64_t node_id = 0;
+  auto secrets = std::make_shared<ccf::LedgerSecrets>();
+  secrets->set_secret(1, std::vector<uint8_t>(16, 0x42));
+  auto encryptor = std::make_shared<ccf::TxEncryptor>(node_id, secrets);
+
+  std::vector<uint8_t> plain(128, 0x42);
+  std::vector<uint8_t> additional_data(256, 0x10);
+  kv::Version version = 10;
+
+  // Header and cipher are written next to each other in a single buffer
+  const auto header_length = encryptor->get_header_length();
+  std::vector<uint8_t> buffer(header_length + plain.size());
+  encryptor->encrypt(
+    {plain.data(), plain.size()},
+    {additional_data.data(), additional_data.size()},
+    buffer.data(),
+    buffer.data() + header_length,
+    version);
+
+  std::vector<uint8_t> serialised_header(
+    buffer.begin(), buffer.begin() + header_length);
+  std::vector<uint8_t> cipher(buffer.begin() + header_length, buffer.end());
+  std::vector<uint8_t> decrypted_cipher;
+  REQUIRE(encryptor->decrypt(
+    cipher, additional_data, serialised_header, decrypted_cipher, version));
+  REQUIRE(plain == decrypted_cipher);
+}
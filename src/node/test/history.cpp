@@ -443,6 +443,76 @@ TEST_CASE(
   }
 }
 
+TEST_CASE("Snapshot history is verified against its signature")
+{
+  auto encryptor = std::make_shared<ccf::NullTxEncryptor>();
+  Store primary_store;
+  primary_store.set_encryptor(encryptor);
+  auto& primary_nodes = primary_store.create<ccf::Nodes>(
+    ccf::Tables::NODES, kv::SecurityDomain::PUBLIC);
+  auto& primary_signatures = primary_store.create<ccf::Signatures>(
+    ccf::Tables::SIGNATURES, kv::SecurityDomain::PUBLIC);
+
+  Store backup_store;
+  backup_store.set_encryptor(encryptor);
+  auto& backup_nodes = backup_store.create<ccf::Nodes>(
+    ccf::Tables::NODES, kv::SecurityDomain::PUBLIC);
+  auto& backup_signatures = backup_store.create<ccf::Signatures>(
+    ccf::Tables::SIGNATURES, kv::SecurityDomain::PUBLIC);
+
+  auto kp = tls::make_key_pair();
+
+  std::shared_ptr<DummyConsensus> consensus =
+    std::make_shared<DummyConsensus>(nullptr);
+  primary_store.set_consensus(consensus);
+  std::shared_ptr<kv::Consensus> null_consensus =
+    std::make_shared<DummyConsensus>(nullptr);
+  backup_store.set_consensus(null_consensus);
+
+  std::shared_ptr<kv::TxHistory> primary_history =
+    std::make_shared<ccf::MerkleTxHistory>(
+      primary_store, 0, *kp, primary_signatures, primary_nodes);
+  primary_store.set_history(primary_history);
+
+  std::shared_ptr<kv::TxHistory> backup_history =
+    std::make_shared<ccf::MerkleTxHistory>(
+      backup_store, 1, *kp, backup_signatures, backup_nodes);
+  backup_store.set_history(backup_history);
+
+  INFO("Write certificate");
+  {
+    Store::Tx txs;
+    auto tx = txs.get_view(primary_nodes);
+    ccf::NodeInfo ni;
+    ni.cert = kp->self_sign("CN=name");
+    tx->put(0, ni);
+    REQUIRE(txs.commit() == kv::CommitSuccess::OK);
+  }
+
+#ifndef PBFT
+  INFO("Snapshot at the signature, and install it on the backup");
+  {
+    primary_history->emit_signature();
+    primary_store.compact(2);
+    auto snapshot = primary_store.snapshot(2)->serialise();
+
+    REQUIRE(
+      backup_store.deserialise_snapshot(snapshot) ==
+      kv::DeserialiseSuccess::PASS);
+    REQUIRE(
+      backup_history->get_replicated_state_root() ==
+      primary_history->get_replicated_state_root());
+  }
+
+  INFO("Next signature verifies successfully on the backup");
+  {
+    consensus->store = &backup_store;
+    primary_history->emit_signature();
+    REQUIRE(backup_store.current_version() == 3);
+  }
+#endif
+}
+
 // We need an explicit main to initialize kremlib and EverCrypt
 int main(int argc, char** argv)
 {
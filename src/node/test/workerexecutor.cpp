@@ -0,0 +1,140 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the Apache 2.0 License.
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+
+#include "../workerexecutor.h"
+
+#include <atomic>
+#include <chrono>
+#include <doctest/doctest.h>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+enclave::ThreadMessaging enclave::ThreadMessaging::thread_messaging;
+std::atomic<uint16_t> enclave::ThreadMessaging::thread_count = 0;
+
+constexpr uint16_t worker_count = 3;
+
+// Registers the calling thread as the main thread, and the worker threads as
+// enclave worker threads are, before any of them reads thread_ids
+void register_threads(std::vector<std::thread>& workers, bool run_workers)
+{
+  thread_ids[std::this_thread::get_id()] = 0;
+  enclave::ThreadMessaging::thread_count = worker_count + 1;
+
+  std::mutex lock;
+  std::atomic<uint16_t> pending = worker_count;
+  for (uint16_t tid = 1; tid <= worker_count; ++tid)
+  {
+    workers.emplace_back([&lock, &pending, tid, run_workers]() {
+      {
+        std::lock_guard<std::mutex> guard(lock);
+        thread_ids[std::this_thread::get_id()] = tid;
+      }
+      pending--;
+
+      if (run_workers)
+        enclave::ThreadMessaging::thread_messaging.run();
+    });
+  }
+
+  while (pending.load() != 0)
+    std::this_thread::yield();
+}
+
+void stop_workers(std::vector<std::thread>& workers)
+{
+  enclave::ThreadMessaging::thread_messaging.set_finished();
+  for (auto& worker : workers)
+    worker.join();
+  workers.clear();
+
+  // Drain anything the workers had not picked up, so that the next test case
+  // starts from empty queues
+  for (uint16_t tid = 1; tid <= worker_count; ++tid)
+    while (enclave::ThreadMessaging::thread_messaging.run_one(tid))
+      ;
+  enclave::ThreadMessaging::thread_messaging.set_finished(false);
+}
+
+TEST_CASE("Tasks run once each, on the caller and the workers")
+{
+  std::vector<std::thread> workers;
+  register_threads(workers, true);
+
+  ccf::WorkerThreadExecutor executor;
+
+  for (size_t round = 0; round < 100; ++round)
+  {
+    constexpr size_t task_count = 16;
+    std::vector<std::atomic<size_t>> runs(task_count);
+    std::vector<std::function<void()>> tasks;
+    for (size_t i = 0; i < task_count; ++i)
+      tasks.emplace_back([&runs, i]() { runs[i]++; });
+
+    executor.run(tasks);
+
+    for (auto& r : runs)
+      REQUIRE(r.load() == 1);
+  }
+
+  INFO("The caller waits for tasks already started by workers");
+  {
+    // Each task waits for the other, so one of them must run on a worker
+    std::atomic<size_t> started = 0;
+    std::atomic<size_t> completed = 0;
+    std::vector<std::function<void()>> tasks;
+    for (size_t i = 0; i < 2; ++i)
+    {
+      tasks.emplace_back([&started, &completed]() {
+        started++;
+        while (started.load() < 2)
+          std::this_thread::yield();
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        completed++;
+      });
+    }
+
+    executor.run(tasks);
+    REQUIRE(completed.load() == 2);
+  }
+
+  stop_workers(workers);
+}
+
+TEST_CASE("The caller claims tasks that no worker has started")
+{
+  // Workers are registered but do not process their messages, as if they were
+  // all busy
+  std::vector<std::thread> workers;
+  register_threads(workers, false);
+  for (auto& worker : workers)
+    worker.join();
+  workers.clear();
+
+  ccf::WorkerThreadExecutor executor;
+  std::atomic<size_t> runs = 0;
+
+  {
+    std::vector<std::function<void()>> tasks;
+    for (size_t i = 0; i < 8; ++i)
+      tasks.emplace_back([&runs]() { runs++; });
+
+    executor.run(tasks);
+    REQUIRE(runs.load() == 8);
+  }
+
+  INFO("Workers that start late do not run the tasks again");
+  {
+    // The tasks have been destroyed by now, so running any of them would be
+    // an error
+    size_t messages = 0;
+    for (uint16_t tid = 1; tid <= worker_count; ++tid)
+      while (enclave::ThreadMessaging::thread_messaging.run_one(tid))
+        messages++;
+
+    REQUIRE(messages > 0);
+    REQUIRE(runs.load() == 8);
+  }
+}
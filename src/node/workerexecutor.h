@@ -0,0 +1,83 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the Apache 2.0 License.
+#pragma once
+
+#include "ds/ringbuffer.h"
+#include "ds/thread_messaging.h"
+#include "kv/kvtypes.h"
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <vector>
+
+namespace ccf
+{
+  // Runs tasks on the enclave worker threads. The calling thread runs tasks
+  // too, and claims any task that no worker has started yet, so that it only
+  // waits for tasks that are already running.
+  class WorkerThreadExecutor : public kv::AbstractExecutor
+  {
+  private:
+    struct Batch
+    {
+      std::vector<std::function<void()>>* tasks;
+      size_t count;
+      std::atomic<size_t> next = 0;
+      std::atomic<size_t> done = 0;
+
+      // Workers may only start after all tasks have been claimed, and the
+      // caller may already have returned. They must not touch tasks then.
+      void run_tasks()
+      {
+        for (auto i = next++; i < count; i = next++)
+        {
+          (*tasks)[i]();
+          done++;
+        }
+      }
+    };
+
+    struct RunTasksMsg
+    {
+      std::shared_ptr<Batch> batch;
+    };
+
+    static void run_tasks_cb(std::unique_ptr<enclave::Tmsg<RunTasksMsg>> msg)
+    {
+      msg->data.batch->run_tasks();
+    }
+
+  public:
+    void run(std::vector<std::function<void()>>& tasks) override
+    {
+      const uint16_t thread_count = enclave::ThreadMessaging::thread_count;
+      const auto self = thread_ids[std::this_thread::get_id()];
+
+      auto batch = std::make_shared<Batch>();
+      batch->tasks = &tasks;
+      batch->count = tasks.size();
+
+      // Thread 0 is the main thread, the others are workers
+      size_t helpers = 0;
+      for (uint16_t tid = 1; tid < thread_count && helpers + 1 < tasks.size();
+           ++tid)
+      {
+        if (tid == self)
+          continue;
+
+        auto msg = std::make_unique<enclave::Tmsg<RunTasksMsg>>(&run_tasks_cb);
+        msg->data.batch = batch;
+        enclave::ThreadMessaging::thread_messaging.add_task<RunTasksMsg>(
+          tid, std::move(msg));
+        helpers++;
+      }
+
+      batch->run_tasks();
+
+      while (batch->done.load() < batch->count)
+        CCF_PAUSE();
+    }
+  };
+}
@@ -1,6 +1,7 @@
 # Copyright (c) Microsoft Corporation. All rights reserved.
 # Licensed under the Apache 2.0 License.
 import io
+import os
 import msgpack
 import struct
 
@@ -8,6 +9,8 @@ GCM_SIZE_TAG = 16
 GCM_SIZE_IV = 12
 LEDGER_TRANSACTION_SIZE = 4
 LEDGER_DOMAIN_SIZE = 8
+LEDGER_HEADER_SIZE = 8
+LEDGER_CHUNK_PREFIX = "ledger_"
 
 
 def to_uint_32(buffer):
@@ -59,6 +62,8 @@ class LedgerDomain:
         while self._buffer_size > self._unpacker.tell():
             map_start_indicator = self._read_next()
             map_name = self._read_next_string()
+            # size of the map's contents, which are read in full below
+            self._read_next()
             records = {}
             self._tables[map_name] = records
             read_version = self._read_next()
@@ -99,14 +104,27 @@ class Transaction:
     _file_size = 0
     gcm_header = None
 
-    def __init__(self, filename):
-        self._file = open(filename, mode="rb")
-        self._file.seek(0, 2)
-        self._file_size = self._file.tell()
-        self._file.seek(0, 0)
+    def __init__(self, filenames):
+        self._filenames = iter(filenames)
 
     def __del__(self):
-        self._file.close()
+        if self._file:
+            self._file.close()
+
+    def _open_next_file(self):
+        if self._file:
+            self._file.close()
+        self._file = open(next(self._filenames), mode="rb")
+
+        # Completed ledger files end with a table of entry offsets, whose
+        # offset is recorded in the file header
+        positions_offset = to_uint_64(
+            _byte_read_safe(self._file, LEDGER_HEADER_SIZE)
+        )
+        self._file.seek(0, 2)
+        self._file_size = positions_offset or self._file.tell()
+        self._next_offset = LEDGER_HEADER_SIZE
+        self._file.seek(LEDGER_HEADER_SIZE, 0)
 
     def _read_header(self):
         # read the size of the transaction
@@ -137,8 +155,8 @@ class Transaction:
         return self
 
     def __next__(self):
-        if self._next_offset == self._file_size:
-            raise StopIteration()
+        while self._next_offset == self._file_size:
+            self._open_next_file()
         try:
             self._complete_read()
             self._read_header()
@@ -149,10 +167,18 @@ class Transaction:
 
 class Ledger:
 
-    _filename = None
+    _dirname = None
+
+    def __init__(self, dirname):
+        self._dirname = dirname
 
-    def __init__(self, filename):
-        self._filename = filename
+    def _chunk_filenames(self):
+        chunks = []
+        for name in os.listdir(self._dirname):
+            if name.startswith(LEDGER_CHUNK_PREFIX):
+                start_idx = int(name[len(LEDGER_CHUNK_PREFIX) :].split("-")[0])
+                chunks.append((start_idx, os.path.join(self._dirname, name)))
+        return [path for _, path in sorted(chunks)]
 
     def __iter__(self):
-        return Transaction(self._filename)
+        return Transaction(self._chunk_filenames())